@@ -1,55 +1,714 @@
-#include <cusp/coo_matrix.h>
+#include <cusp/csr_matrix.h>
 #include <cusp/print.h>
 #include <cusp/monitor.h>
+#include <cusp/blas.h>
 #include <cusp/krylov/cg.h>
+#include <cusp/precond/diagonal.h>
+#include <cusp/precond/ainv.h>
+#include <cusp/precond/smoothed_aggregation.h>
+#include <cusp/linear_operator.h>
+
+#include <thrust/fill.h>
+#include <thrust/for_each.h>
+#include <thrust/memory.h>
+#include <thrust/iterator/counting_iterator.h>
+
+#include <cmath>
+#include <vector>
 
 // uncomment if you want to save matrix to disk in MatrixMarket format
 #include <cusp/io/matrix_market.h>
 #include "./include/cusp_device.h"
+#include "./include/Profiler.h"
+#include "./include/SellMatrix.h"
+#include "./include/FusedCG.h"
 
 //cudaError_t error; 
 
-void solve_on_device( cusp::coo_matrix<int, float, cusp::host_memory>& coo_host, 
-                      cusp::array1d<float, cusp::host_memory>& rhs_host, 
-                      cusp::array1d<float, cusp::host_memory>& result_host ) {
+// default_monitor that also puts each CG iteration on the Profiler's
+// timeline (cusp::krylov::cg calls finished() once per iteration)
+template <class ValueType>
+class tracing_monitor : public cusp::default_monitor<ValueType> {
+  public:
+    template <class Vector>
+    tracing_monitor( const Vector& b, size_t iteration_limit, ValueType relative_tolerance )
+    : cusp::default_monitor<ValueType>( b, iteration_limit, relative_tolerance ),
+      last( Profiler::now() ) {}
+
+    template <class Vector>
+    bool finished( const Vector& r ) {
+        bool done = cusp::default_monitor<ValueType>::finished( r );
+        if( Profiler::tracing() ) {
+            double t = Profiler::now();
+            Profiler::trace( "cg iteration", last, t - last,
+                             this->iteration_count(), this->residual_norm() );
+            last = t;
+        }
+        return done;
+    }
+
+  protected:
+    double last; // end of the previous iteration
+};
+
+// stopping criteria of the fused CG variants, which compute the residual
+// norm within their sweeps and pass it rather than the residual; like
+// tracing_monitor, it puts each iteration on the Profiler's timeline
+template <class ValueType>
+class norm_monitor {
+  public:
+    template <class Vector>
+    norm_monitor( const Vector& b, size_t iteration_limit, ValueType relative_tolerance )
+    : iterations( 0 ),
+      limit( iteration_limit ),
+      tolerance( relative_tolerance * cusp::blas::nrm2( b )),
+      norm( 0. ),
+      last( Profiler::now() ) {}
+
+    bool finished( double residual_norm ) {
+        norm = residual_norm;
+        if( Profiler::tracing() ) {
+            double t = Profiler::now();
+            Profiler::trace( "cg iteration", last, t - last, iterations, norm );
+            last = t;
+        }
+        return converged() || iterations >= limit;
+    }
+
+    void operator++( void ) {
+        iterations++;
+    }
+
+    bool converged( void ) const {
+        return norm <= tolerance;
+    }
+
+    size_t iteration_count( void ) const {
+        return iterations;
+    }
+
+    double residual_norm( void ) const {
+        return norm;
+    }
+
+  protected:
+    size_t iterations, limit;
+    double tolerance; // absolute
+    double norm;
+    double last; // end of the previous iteration
+};
+
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ < 600
+// atomicAdd on doubles needs compute capability 6.0; before that, it is
+// built from a compare-and-swap loop on the bit pattern
+__device__ double atomicAdd( double* address, double value ) {
+    unsigned long long int* bits = (unsigned long long int*) address;
+    unsigned long long int old = *bits, assumed;
+    do {
+        assumed = old;
+        old = atomicCAS( bits, assumed,
+                         __double_as_longlong( value + __longlong_as_double( assumed )));
+    } while( assumed != old );
+    return __longlong_as_double( old );
+}
+#endif
+
+// adds value to *address -- other threads may be adding to the same
+// element, so the update has to be atomic: on the device, and on the host
+// when Thrust's host system is OpenMP (THRUST_HOST_SYSTEM_OMP)
+template <class ValueType>
+__host__ __device__ void atomic_add( ValueType* address, ValueType value ) {
+#ifdef __CUDA_ARCH__
+    atomicAdd( address, value );
+#else
+    #pragma omp atomic
+    *address += value;
+#endif
+}
+
+// multiplies row i of a CSR matrix by x; the columns of the row are stored
+// either as they are or, if deltas is set, as differences from the previous
+// column (the first from first_columns[i]); if the matrix is the upper
+// triangle of a symmetric one, the row is also applied transposed
+template <class IndexType, class ValueType>
+struct csr_multiply_row {
+    const IndexType* row_offsets;
+    const IndexType* columns;
+    const IndexType* first_columns;
+    const unsigned short* deltas;
+    const ValueType* values;
+    const ValueType* x;
+    ValueType* y;
+    bool symmetric;
+
+    // returns the product of entry k, in column j, with x and, for a
+    // symmetric matrix, applies the mirrored entry to y
+    __host__ __device__ ValueType entry( IndexType i, IndexType j, IndexType k ) const {
+        if( symmetric && j != i ) {
+            atomic_add( y+j, values[k] * x[i] );
+        }
+        return values[k] * x[j];
+    }
+
+    __host__ __device__ void operator()( IndexType i ) const {
+        ValueType sum = 0;
+        if( deltas ) {
+            IndexType j = first_columns[i];
+            for( IndexType k = row_offsets[i]; k < row_offsets[i+1]; k++ ) {
+                j += deltas[k];
+                sum += entry( i, j, k );
+            }
+        }
+        else {
+            for( IndexType k = row_offsets[i]; k < row_offsets[i+1]; k++ ) {
+                sum += entry( i, columns[k], k );
+            }
+        }
+
+        // other rows add to y[i] too if the matrix is symmetric
+        if( symmetric ) {
+            atomic_add( y+i, sum );
+        }
+        else {
+            y[i] = sum;
+        }
+    }
+};
+
+// CSR matrix whose SpMV reads fewer bytes than CUSP's: its column indices
+// may be compressed to 16-bit differences within each row, and it may hold
+// only the upper triangle of a symmetric matrix
+template <class IndexType, class ValueType, class MemorySpace>
+class csr_operator : public cusp::linear_operator<ValueType, MemorySpace> {
+  public:
+    csr_operator( void )
+    : symmetric( false ) {}
+
+    template <class OtherSpace>
+    csr_operator( const csr_operator<IndexType, ValueType, OtherSpace>& other )
+    : cusp::linear_operator<ValueType, MemorySpace>( other.num_rows, other.num_cols, other.num_entries ),
+      row_offsets( other.row_offsets ),
+      column_indices( other.column_indices ),
+      first_columns( other.first_columns ),
+      deltas( other.deltas ),
+      values( other.values ),
+      symmetric( other.symmetric ) {}
+
+    bool compressed( void ) const {
+        return !deltas.empty();
+    }
+
+    double bytes( void ) const {
+        // matrix and vector bytes one multiply reads and writes
+        double index = compressed() ? sizeof(unsigned short) : sizeof(IndexType);
+        return (double) this->num_entries * ( index + sizeof(ValueType) ) +
+               ( this->num_rows + 1. ) * sizeof(IndexType) +
+               ( compressed() ? (double) this->num_rows * sizeof(IndexType) : 0. ) +
+               ( symmetric ? 3. : 2. ) * this->num_rows * sizeof(ValueType);
+    }
+
+    template <class Array1, class Array2>
+    void operator()( const Array1& x, Array2& y ) const {
+        csr_multiply_row<IndexType, ValueType> row;
+        row.row_offsets = thrust::raw_pointer_cast( &row_offsets[0] );
+        row.columns = compressed() ? NULL : thrust::raw_pointer_cast( &column_indices[0] );
+        row.first_columns = compressed() ? thrust::raw_pointer_cast( &first_columns[0] ) : NULL;
+        row.deltas = compressed() ? thrust::raw_pointer_cast( &deltas[0] ) : NULL;
+        row.values = thrust::raw_pointer_cast( &values[0] );
+        row.x = thrust::raw_pointer_cast( &x[0] );
+        row.y = thrust::raw_pointer_cast( &y[0] );
+        row.symmetric = symmetric;
+
+        if( symmetric ) {
+            thrust::fill( y.begin(), y.end(), ValueType( 0 ));
+        }
+        thrust::for_each( thrust::counting_iterator<IndexType, MemorySpace>( 0 ),
+                          thrust::counting_iterator<IndexType, MemorySpace>( this->num_rows ),
+                          row );
+    }
+
+    cusp::array1d<IndexType, MemorySpace> row_offsets;
+    cusp::array1d<IndexType, MemorySpace> column_indices; // unless compressed
+    cusp::array1d<IndexType, MemorySpace> first_columns;  // if compressed
+    cusp::array1d<unsigned short, MemorySpace> deltas;    // if compressed
+    cusp::array1d<ValueType, MemorySpace> values;
+    bool symmetric;
+};
+
+// sets up A on the host from csr, with column differences in place of
+// column indices if compress is set and every difference fits in 16 bits
+template <class IndexType, class ValueType>
+static void build_operator( const cusp::csr_matrix<IndexType, ValueType, cusp::host_memory>& csr,
+                            bool symmetric, bool compress,
+                            csr_operator<IndexType, ValueType, cusp::host_memory>& A ) {
+
+    A.num_rows = csr.num_rows;
+    A.num_cols = csr.num_cols;
+    A.num_entries = csr.num_entries;
+    A.row_offsets = csr.row_offsets;
+    A.values = csr.values;
+    A.symmetric = symmetric;
+
+    if( compress ) {
+        A.first_columns.resize( csr.num_rows, 0 );
+        A.deltas.resize( csr.num_entries );
+        for( size_t i = 0; i < csr.num_rows && compress; i++ ) {
+            IndexType previous = 0;
+            if( csr.row_offsets[i] < csr.row_offsets[i+1] ) {
+                previous = A.first_columns[i] = csr.column_indices[ csr.row_offsets[i] ];
+            }
+            for( IndexType k = csr.row_offsets[i]; k < csr.row_offsets[i+1]; k++ ) {
+                IndexType delta = csr.column_indices[k] - previous;
+                if( delta < 0 || delta > 65535 ) {
+                    compress = false;
+                    break;
+                }
+                A.deltas[k] = delta;
+                previous = csr.column_indices[k];
+            }
+        }
+    }
+
+    if( compress ) {
+        return;
+    }
+
+    // some difference doesn't fit, so keep the column indices
+    A.first_columns.clear();
+    A.deltas.clear();
+    A.column_indices = csr.column_indices;
+}
+
+// SELL-C-sigma matrix on the host, applied by CUSP's CG through the SIMD
+// kernel of SellMatrix
+template <class ValueType>
+class sell_operator : public cusp::linear_operator<ValueType, cusp::host_memory> {
+  public:
+    sell_operator( const SellMatrix<ValueType>& S )
+    : cusp::linear_operator<ValueType, cusp::host_memory>( S.size(), S.size(), S.entries() ),
+      S( S ) {}
+
+    template <class Array1, class Array2>
+    void operator()( const Array1& x, Array2& y ) const {
+        S.multiply( thrust::raw_pointer_cast( &x[0] ), thrust::raw_pointer_cast( &y[0] ));
+    }
+
+    const SellMatrix<ValueType>& S;
+};
+
+// the fused CG variants apply the identity preconditioner for free, by
+// letting the preconditioned vectors share storage with the plain ones
+template <class Preconditioner>
+static bool is_identity( const Preconditioner& M ) {
+    return false;
+}
+
+template <class ValueType, class MemorySpace>
+static bool is_identity( const cusp::identity_operator<ValueType, MemorySpace>& M ) {
+    return true;
+}
+
+// Chronopoulos-Gear CG: per iteration, one update sweep, the SpMV, and one
+// sweep for all three inner products (see FusedCG.h)
+template <class LinearOperator, class ValueType, class Preconditioner>
+static void fused_cg( LinearOperator& A,
+                      cusp::array1d<ValueType, cusp::host_memory>& x,
+                      cusp::array1d<ValueType, cusp::host_memory>& b,
+                      Preconditioner& M, norm_monitor<ValueType>& monitor ) {
+
+    typedef cusp::array1d<ValueType, cusp::host_memory> Array;
+    int size = x.size();
+    bool preconditioned = !is_identity( M );
+
+    // without a preconditioner, u is r
+    Array r( size ), w( size ), p( size, ValueType( 0 )), s( size, ValueType( 0 ));
+    Array u( preconditioned ? size : 0 );
+    Array& ur = preconditioned ? u : r;
+
+    // r = b - Ax, u = Mr, w = Au
+    cusp::multiply( A, x, r );
+    cusp::blas::axpby( b, r, r, ValueType( 1 ), ValueType( -1 ));
+    if( preconditioned ) cusp::multiply( M, r, u );
+    cusp::multiply( A, ur, w );
+
+    double gamma, delta, rr, previousGamma = 0., alpha = 0.;
+    FusedCG<ValueType>::dots( size, thrust::raw_pointer_cast( &r[0] ), thrust::raw_pointer_cast( &ur[0] ),
+                              thrust::raw_pointer_cast( &w[0] ), gamma, delta, rr );
+
+    while( !monitor.finished( sqrt( rr ))) {
+        double beta = 0.;
+        if( monitor.iteration_count() == 0 ) {
+            alpha = gamma / delta;
+        }
+        else {
+            beta = gamma / previousGamma;
+            alpha = gamma / ( delta - beta * gamma / alpha );
+        }
+
+        FusedCG<ValueType>::update( size, (ValueType) alpha, (ValueType) beta,
+                                    thrust::raw_pointer_cast( &ur[0] ), thrust::raw_pointer_cast( &w[0] ),
+                                    thrust::raw_pointer_cast( &p[0] ), thrust::raw_pointer_cast( &s[0] ),
+                                    thrust::raw_pointer_cast( &x[0] ), thrust::raw_pointer_cast( &r[0] ));
+        if( preconditioned ) cusp::multiply( M, r, u );
+        cusp::multiply( A, ur, w );
+
+        previousGamma = gamma;
+        FusedCG<ValueType>::dots( size, thrust::raw_pointer_cast( &r[0] ), thrust::raw_pointer_cast( &ur[0] ),
+                                  thrust::raw_pointer_cast( &w[0] ), gamma, delta, rr );
+        ++monitor;
+    }
+}
+
+// Ghysels-Vanroose pipelined CG: per iteration, one sweep that updates the
+// vectors and computes the inner products, then the SpMV, whose input
+// doesn't depend on the inner products (see FusedCG.h)
+template <class LinearOperator, class ValueType, class Preconditioner>
+static void pipelined_cg( LinearOperator& A,
+                          cusp::array1d<ValueType, cusp::host_memory>& x,
+                          cusp::array1d<ValueType, cusp::host_memory>& b,
+                          Preconditioner& M, norm_monitor<ValueType>& monitor ) {
+
+    typedef cusp::array1d<ValueType, cusp::host_memory> Array;
+    int size = x.size();
+    bool preconditioned = !is_identity( M );
+
+    // without a preconditioner, u is r, m is w and q is s
+    Array r( size ), w( size ), n( size );
+    Array z( size, ValueType( 0 )), s( size, ValueType( 0 )), p( size, ValueType( 0 ));
+    Array u( preconditioned ? size : 0 ), m( preconditioned ? size : 0 );
+    Array q( preconditioned ? size : 0, ValueType( 0 ));
+    Array& ur = preconditioned ? u : r;
+    Array& mw = preconditioned ? m : w;
+    Array& qs = preconditioned ? q : s;
+
+    // r = b - Ax, u = Mr, w = Au, m = Mw, n = Am
+    cusp::multiply( A, x, r );
+    cusp::blas::axpby( b, r, r, ValueType( 1 ), ValueType( -1 ));
+    if( preconditioned ) cusp::multiply( M, r, u );
+    cusp::multiply( A, ur, w );
+
+    double gamma, delta, rr, previousGamma = 0., alpha = 0.;
+    FusedCG<ValueType>::dots( size, thrust::raw_pointer_cast( &r[0] ), thrust::raw_pointer_cast( &ur[0] ),
+                              thrust::raw_pointer_cast( &w[0] ), gamma, delta, rr );
+    if( preconditioned ) cusp::multiply( M, w, m );
+    cusp::multiply( A, mw, n );
+
+    while( !monitor.finished( sqrt( rr ))) {
+        double beta = 0.;
+        if( monitor.iteration_count() == 0 ) {
+            alpha = gamma / delta;
+        }
+        else {
+            beta = gamma / previousGamma;
+            alpha = gamma / ( delta - beta * gamma / alpha );
+        }
+
+        previousGamma = gamma;
+        FusedCG<ValueType>::pipelinedUpdate( size, (ValueType) alpha, (ValueType) beta,
+                                             thrust::raw_pointer_cast( &n[0] ), thrust::raw_pointer_cast( &mw[0] ),
+                                             thrust::raw_pointer_cast( &z[0] ), thrust::raw_pointer_cast( &qs[0] ),
+                                             thrust::raw_pointer_cast( &s[0] ), thrust::raw_pointer_cast( &p[0] ),
+                                             thrust::raw_pointer_cast( &x[0] ), thrust::raw_pointer_cast( &r[0] ),
+                                             thrust::raw_pointer_cast( &ur[0] ), thrust::raw_pointer_cast( &w[0] ),
+                                             preconditioned, gamma, delta, rr );
+
+        // the recurrences for r, w, s and z drift from b - Ax, Au, Ap and Aq
+        // (in single precision, the eigen systems end up with a true
+        // residual 15% above standard CG's after 100 iterations), so every
+        // 25 iterations they are recomputed, at the cost of four SpMVs
+        if(( monitor.iteration_count() + 1 ) % 25 == 0 ) {
+            cusp::multiply( A, x, r );
+            cusp::blas::axpby( b, r, r, ValueType( 1 ), ValueType( -1 ));
+            if( preconditioned ) cusp::multiply( M, r, u );
+            cusp::multiply( A, ur, w );
+            cusp::multiply( A, p, s );
+            if( preconditioned ) cusp::multiply( M, s, q );
+            cusp::multiply( A, qs, z );
+            FusedCG<ValueType>::dots( size, thrust::raw_pointer_cast( &r[0] ), thrust::raw_pointer_cast( &ur[0] ),
+                                      thrust::raw_pointer_cast( &w[0] ), gamma, delta, rr );
+        }
+
+        if( preconditioned ) cusp::multiply( M, w, m );
+        cusp::multiply( A, mw, n );
+        ++monitor;
+    }
+}
+
+// runs the CG variant selected by options if x and b are in host memory;
+// returns false otherwise
+template <class Matrix, class Array, class Preconditioner>
+static bool run_fused_cg( Matrix& A, Array& x, Array& b, Preconditioner& M,
+                          const SolverOptions& options, SolverStatistics& stats ) {
+    return false;
+}
+
+template <class Matrix, class ValueType, class Preconditioner>
+static bool run_fused_cg( Matrix& A,
+                          cusp::array1d<ValueType, cusp::host_memory>& x,
+                          cusp::array1d<ValueType, cusp::host_memory>& b,
+                          Preconditioner& M,
+                          const SolverOptions& options, SolverStatistics& stats ) {
+
+    norm_monitor<ValueType> monitor( b, options.maxIterations, (ValueType) options.tolerance );
+    if( options.method == SolverOptions::pipelined ) {
+        pipelined_cg( A, x, b, M, monitor );
+    }
+    else {
+        fused_cg( A, x, b, M, monitor );
+    }
+    stats.iterations = monitor.iteration_count();
+    stats.residual = monitor.residual_norm();
+    stats.converged = monitor.converged();
+    return true;
+}
+
+// runs CG in MemorySpace with preconditioner M; the matrix, right-hand
+// side and initial guess have already been copied there
+template <class Matrix, class Array, class Preconditioner>
+static void run_cg( Matrix& A, Array& x, Array& b, Preconditioner& M,
+                    const SolverOptions& options, SolverStatistics& stats ) {
+
+    typedef typename Array::value_type ValueType;
+
+    if( options.method != SolverOptions::standard &&
+        run_fused_cg( A, x, b, M, options, stats )) {
+        return;
+    }
+
+    // set stopping criteria (by default iteration_limit = 100, 
+    // relative_tolerance = 1e-2); the outcome goes into the profile rather
+    // than to stdout
+    tracing_monitor<ValueType> monitor( b, options.maxIterations, (ValueType) options.tolerance );
+
+    // solve the linear system A * x = b
+    cusp::krylov::cg( A, x, b, monitor, M );
+    stats.iterations = monitor.iteration_count();
+    stats.residual = monitor.residual_norm();
+    stats.converged = monitor.converged();
+}
+
+// builds the preconditioner selected by options from csr (which holds the
+// entries of A, in MemorySpace) and runs CG on A
+template <class LinearOperator, class Matrix, class Array>
+static void run_preconditioned( LinearOperator& A, const Matrix& csr, Array& x, Array& b,
+                                const SolverOptions& options, SolverStatistics& stats ) {
+
+    typedef typename Matrix::value_type ValueType;
+    typedef typename Matrix::memory_space MemorySpace;
+
+    // the preconditioner's setup counts towards the solve
+    switch( options.preconditioner ) {
+        case SolverOptions::diagonal: {
+            cusp::precond::diagonal<ValueType, MemorySpace> M( csr );
+            run_cg( A, x, b, M, options, stats );
+            break;
+        }
+        case SolverOptions::ainv: {
+            cusp::precond::scaled_bridson_ainv<ValueType, MemorySpace> M( csr, .1 );
+            run_cg( A, x, b, M, options, stats );
+            break;
+        }
+        case SolverOptions::aggregation: {
+            cusp::precond::smoothed_aggregation<int, ValueType, MemorySpace> M( csr );
+            run_cg( A, x, b, M, options, stats );
+            break;
+        }
+        default: {
+            cusp::identity_operator<ValueType, MemorySpace> M( A.num_rows, A.num_rows );
+            run_cg( A, x, b, M, options, stats );
+            break;
+        }
+    }
+}
+
+template <class MemorySpace, class ValueType>
+static SolverStatistics solve_in( const cusp::csr_matrix<int, ValueType, cusp::host_memory>& csr_host, 
+                                  cusp::array1d<ValueType, cusp::host_memory>& rhs_host, 
+                                  cusp::array1d<ValueType, cusp::host_memory>& result_host,
+                                  const SolverOptions& options,
+                                  bool symmetric ) {
+
+    // the approximate inverse and aggregation need every entry of A, so
+    // they get the full matrix
+    if( symmetric && ( options.preconditioner == SolverOptions::ainv ||
+                       options.preconditioner == SolverOptions::aggregation )) {
+        cusp::csr_matrix<int, ValueType, cusp::host_memory> full;
+        expand_symmetric( csr_host, full );
+        return solve_in<MemorySpace>( full, rhs_host, result_host, options, false );
+    }
+
+    SolverStatistics stats;
+    double t0 = Profiler::now();
+
+    // CUSP's own SpMV handles the plain case; the upper triangle and
+    // compressed indices need csr_operator, next to which CUSP's matrix is
+    // only kept to set up a preconditioner
+    bool plain = !symmetric && !options.compressIndices;
+    csr_operator<int, ValueType, cusp::host_memory> compact;
+    if( !plain ) {
+        build_operator( csr_host, symmetric, options.compressIndices, compact );
+    }
     	 															
-    // transfer COO to the device
-    cusp::coo_matrix<int, float, cusp::device_memory> coo_cusp_device = coo_host;
-    //cusp::io::write_matrix_market_file( coo_cusp_device, "coo_cusp_device.mtx" );
-    //cusp::print(coo_cusp_device);
-	
-	 // transfer rhs_host to the device
-    cusp::array1d<float, cusp::device_memory> rhs_device = rhs_host;
-    //cusp::print(rhs_device);
-    //cusp::io::write_matrix_market_file( rhs_device, "rhs_device.mtx" );
-
-	 // transfer result_host to the device	
-    cusp::array1d<float, cusp::device_memory> result_device = result_host;
-         
-    // set stopping criteria (iteration_limit = 100, relative_tolerance = 1e-2)
-    cusp::verbose_monitor<float> monitor(rhs_device, 100, 1e-2);
-    
-    // set preconditioner (identity) doesn't affect the speed of convergence
-    cusp::identity_operator<float, cusp::device_memory> M( coo_cusp_device.num_rows, 
-	 																		  coo_cusp_device.num_rows );
-
-    // solve the linear system A * x = b -> coo_cusp_device * result_device = rhs_device 
-    cusp::krylov::cg(coo_cusp_device, result_device, rhs_device, monitor, M);	 
-    //cusp::print(x);
-    //cusp::io::write_matrix_market_file(result_device, "result_device.mtx");
+    // transfer the matrix, rhs_host and result_host to MemorySpace (for the
+    // host backend, these are plain copies)
+    cusp::csr_matrix<int, ValueType, MemorySpace> csr_device;
+    if( plain || options.preconditioner != SolverOptions::identity ) {
+        csr_device = csr_host;
+    }
+    csr_operator<int, ValueType, MemorySpace> compact_device( compact );
+    cusp::array1d<ValueType, MemorySpace> rhs_device = rhs_host;
+    cusp::array1d<ValueType, MemorySpace> result_device = result_host;
+    //cusp::io::write_matrix_market_file( csr_device, "csr_device.mtx" );
+
+    stats.start = Profiler::now();
+    if( Profiler::enabled() ) Profiler::record( "upload", t0, stats.start - t0 );
+
+    if( plain ) {
+        run_preconditioned( csr_device, csr_device, result_device, rhs_device, options, stats );
+    }
+    else {
+        run_preconditioned( compact_device, csr_device, result_device, rhs_device, options, stats );
+    }
+    stats.seconds = Profiler::now() - stats.start;
+
+    // one CSR SpMV reads the row offsets, every (column, value) pair and x,
+    // and writes y
+    if( plain ) {
+        stats.spmvBytes = (double) csr_host.num_entries * ( sizeof(int) + sizeof(ValueType) ) +
+                          ( csr_host.num_rows + 1. ) * sizeof(int) +
+                          2. * csr_host.num_rows * sizeof(ValueType);
+    }
+    else {
+        stats.spmvBytes = compact.bytes();
+    }
     
     // return the result on the host 
     // behind each '=' there is a call to cudamalloc
+    double t1 = Profiler::now();
     result_host = result_device; 
+    if( Profiler::enabled() ) Profiler::record( "download", t1, Profiler::now() - t1 );
     
     //cusp::io::write_matrix_market_file(result_host, "result_host_final.mtx");
 
+    return stats;
 }
+
+// runs CG on the host with A in SELL-C-sigma format -- sell if given, and
+// csr_host converted otherwise; csr_host only serves to set up a
+// preconditioner
+template <class ValueType>
+static SolverStatistics solve_sell( const cusp::csr_matrix<int, ValueType, cusp::host_memory>& csr_host, 
+                                    cusp::array1d<ValueType, cusp::host_memory>& rhs_host, 
+                                    cusp::array1d<ValueType, cusp::host_memory>& result_host,
+                                    const SolverOptions& options,
+                                    bool symmetric,
+                                    const SellMatrix<ValueType>* sell ) {
+
+    SolverStatistics stats;
+    double t0 = Profiler::now();
+
+    SellMatrix<ValueType> converted;
+    if( !sell ) {
+        converted.build( csr_host, symmetric );
+        sell = &converted;
+    }
+    const SellMatrix<ValueType>& S( *sell );
+    sell_operator<ValueType> A( S );
+
+    // preconditioners need the entries of the full matrix
+    cusp::csr_matrix<int, ValueType, cusp::host_memory> full;
+    if( symmetric && options.preconditioner != SolverOptions::identity ) {
+        expand_symmetric( csr_host, full );
+    }
+    const cusp::csr_matrix<int, ValueType, cusp::host_memory>& csr( symmetric ? full : csr_host );
+
+    stats.start = Profiler::now();
+    if( Profiler::enabled() ) Profiler::record( "sell convert", t0, stats.start - t0 );
+
+    run_preconditioned( A, csr, result_host, rhs_host, options, stats );
+    stats.seconds = Profiler::now() - stats.start;
+    stats.spmvBytes = S.bytes();
+
+    return stats;
+}
+
+template <class ValueType>
+SolverStatistics solve_on_device( const cusp::csr_matrix<int, ValueType, cusp::host_memory>& csr_host, 
+                      cusp::array1d<ValueType, cusp::host_memory>& rhs_host, 
+                      cusp::array1d<ValueType, cusp::host_memory>& result_host,
+                      const SolverOptions& options,
+                      bool symmetric,
+                      const SellMatrix<ValueType>* sell ) {
+
+    if( options.backend == SolverOptions::sell ) {
+        return solve_sell( csr_host, rhs_host, result_host, options, symmetric, sell );
+    }
+    if( options.backend == SolverOptions::host ) {
+        return solve_in<cusp::host_memory>( csr_host, rhs_host, result_host, options, symmetric );
+    }
+    return solve_in<cusp::device_memory>( csr_host, rhs_host, result_host, options, symmetric );
+}
+
+template <class ValueType>
+void expand_symmetric( const cusp::csr_matrix<int, ValueType, cusp::host_memory>& upper,
+                             cusp::csr_matrix<int, ValueType, cusp::host_memory>& full ) {
+
+    // count the entries of each row, including the mirrored ones
+    std::vector<int> start( upper.num_rows+1, 0 );
+    for( size_t i = 0; i < upper.num_rows; i++ ) {
+        for( int k = upper.row_offsets[i]; k < upper.row_offsets[i+1]; k++ ) {
+            int j = upper.column_indices[k];
+            start[i+1]++;
+            if( j != (int) i ) start[j+1]++;
+        }
+    }
+    for( size_t r = 0; r < upper.num_rows; r++ ) {
+        start[r+1] += start[r];
+    }
+
+    // the mirror of (i,j) lands in row j before any entry stored in row j
+    // (because i < j), and mirrors arrive in order of i, so rows stay sorted
+    full.resize( upper.num_rows, upper.num_cols, start[upper.num_rows] );
+    full.row_offsets = start;
+    std::vector<int> next( start.begin(), start.end()-1 );
+    for( size_t i = 0; i < upper.num_rows; i++ ) {
+        for( int k = upper.row_offsets[i]; k < upper.row_offsets[i+1]; k++ ) {
+            int j = upper.column_indices[k];
+
+            int a = next[i]++;
+            full.column_indices[a] = j;
+            full.values[a] = upper.values[k];
+
+            if( j != (int) i ) {
+                int b = next[j]++;
+                full.column_indices[b] = i;
+                full.values[b] = upper.values[k];
+            }
+        }
+    }
+}
+
 	// CUSP's preconditioners (diagonal, smoothed_aggregation, approximate inverse) 
 	// fail to work. On the linear system, matrices of quaternions are converted 
 	// into a system of reals, so it might be just that preconditioners for real 
-	// matrices don't work for quaternionic matrices.
+	// matrices don't work for quaternionic matrices.  They stay selectable through
+	// SolverOptions so that they can be retried offline on captured systems
+	// (see tools/replay.cpp); the pipeline uses the identity.
 
     // diagonal preconditioner results in NaN
-    // cusp::precond::diagonal<float, cusp::device_memory> M( coo_cusp_device ); 
-																																					  																		  																		  
+
+// explicit instantiations (double requires a device of compute capability 1.3+)
+template SolverStatistics solve_on_device<float>( const cusp::csr_matrix<int, float, cusp::host_memory>&,
+                                      cusp::array1d<float, cusp::host_memory>&,
+                                      cusp::array1d<float, cusp::host_memory>&,
+                                      const SolverOptions&, bool,
+                                      const SellMatrix<float>* );
+template SolverStatistics solve_on_device<double>( const cusp::csr_matrix<int, double, cusp::host_memory>&,
+                                       cusp::array1d<double, cusp::host_memory>&,
+                                       cusp::array1d<double, cusp::host_memory>&,
+                                       const SolverOptions&, bool,
+                                       const SellMatrix<double>* );
+template void expand_symmetric<float>( const cusp::csr_matrix<int, float, cusp::host_memory>&,
+                                             cusp::csr_matrix<int, float, cusp::host_memory>& );
+template void expand_symmetric<double>( const cusp::csr_matrix<int, double, cusp::host_memory>&,
+                                              cusp::csr_matrix<int, double, cusp::host_memory>& );
@@ -0,0 +1,66 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- BufferedFile.h
+//
+// BufferedFile is a write-only file that collects output in a large memory
+// buffer and hands it to the operating system in a few big write() calls.
+// Text can be formatted in place, e.g.,
+//
+//    BufferedFile out;
+//    if( out.open( "mesh.obj" ))
+//    {
+//       char* p = out.reserve( 64 );
+//       p = formatReal( p, x );
+//       *p++ = '\n';
+//       out.commit( p );
+//       ...
+//       out.close();
+//    }
+//
+// where reserve() guarantees the requested number of writable bytes.  Remaining
+// data is flushed by close() or when the object goes out of scope.
+//
+
+#ifndef SPINXFORM_BUFFEREDFILE_H
+#define SPINXFORM_BUFFEREDFILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+class BufferedFile
+{
+   public:
+      BufferedFile( size_t capacity = 1<<20 );
+      ~BufferedFile( void );
+
+      bool open( const std::string& filename );
+      // creates (or truncates) the file; returns false on failure
+
+      bool close( void );
+      // flushes the buffer and closes the file; returns false if any write failed
+
+      char* reserve( size_t n );
+      // returns a pointer to at least n writable bytes at the end of the buffer
+
+      void commit( char* end );
+      // marks the bytes up to end (obtained from reserve()) as written
+
+      void write( const void* data, size_t n );
+      // appends n raw bytes
+
+   protected:
+      BufferedFile( const BufferedFile& );
+      BufferedFile& operator=( const BufferedFile& );
+      // files are not copyable
+
+      void flush( void );
+      // passes the buffered bytes to the operating system
+
+      int fd; // file descriptor (-1 if closed)
+      bool failed; // whether any write has failed
+      std::vector<char> buffer; // pending output
+      size_t used; // number of pending bytes
+};
+
+#endif
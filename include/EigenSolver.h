@@ -41,8 +41,12 @@
 
 			A x_{n+1} = x_n, where x_0 is the starting estimate
 
-	Currently the solver applies a fixed number of iterations and no
-	other convergence criteria are considered.  Better results might be
+	The solver applies a fixed number of iterations (fewer on a warm
+	start that has already converged).  The linear solves may be
+	inexact: early iterations, whose x_n is still far from the
+	eigenvector, gain little from an accurate solve, so the CG
+	tolerance can be tied to the current eigen-residual, which makes
+	the first solves cheaper and the last ones more accurate.  Better results might be
 	obtained by using a more sophisticated eigensolver such as SLEPc,
 	PRIMME, or ARPACK (available as "eigs" in MATLAB).  Additionally, if
 	a good initial guess x_0 for the eigenvector is available, faster
@@ -59,20 +63,47 @@
 #define SPINXFORM_EIGENSOLVER_H
 
 #include "QuaternionMatrix.h"
+#include "cusp_device.h"
 #include <vector>
 
 using namespace std;
 
+template <class T>
 class EigenSolver
 {
    public:
-      static void solve( QuaternionMatrix& A,
-                         vector<Quaternion>& x );
+      static T solve( QuaternionMatrix<T>& A,
+                      vector< Quaternion<T> >& x,
+                      bool warmStart = false,
+                      T tolerance = 0.,
+                      int iterations = 3,
+                      const SolverOptions& options = SolverOptions(),
+                      T innerFactor = 0. );
       // solves the eigenvalue problem Ax = cx for the
-      // eigenvector x with the smallest eigenvalue c
+      // eigenvector x with the smallest eigenvalue c and returns
+      // the estimate of c, using the given number of inverse
+      // iterations, each a CG solve run with options; if warmStart
+      // is set, the current value of x is used as the initial
+      // guess, and iteration stops early once |Ax-cx|/|Ax| is at
+      // most tolerance; if innerFactor is nonzero, each CG solve
+      // instead runs to innerFactor times the current |Ax-cx|/|Ax|
+      // (see innerTolerance()); a warm start whose eigenvalue
+      // estimate is negligible falls back to a cold start
 
    protected:
-      static void normalize( vector<Quaternion>& x );
+      static T rayleighQuotient( const QuaternionMatrix<T>& A,
+                                 const vector< Quaternion<T> >& x,
+                                 T* residual = NULL,
+                                 T* cosine = NULL );
+      // returns (x'*A*x)/(x'*x); also stores the relative residual
+      // |Ax-cx|/|Ax| in *residual and the cosine of the angle between
+      // x and Ax in *cosine if they are given
+
+      static T innerTolerance( T residual, T innerFactor, const SolverOptions& options );
+      // returns the CG tolerance for an inverse iteration whose current
+      // relative eigen-residual is residual
+
+      static void normalize( vector< Quaternion<T> >& x );
       // rescales x to have unit length
 };
 
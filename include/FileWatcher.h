@@ -0,0 +1,63 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- FileWatcher.h
+//
+// FileWatcher reports when files on disk are rewritten, using Linux inotify.
+// Standard usage might look something like
+//
+//    FileWatcher watcher;
+//    watcher.add( "image.tga" );
+//    while( true )
+//    {
+//       vector<string> changed = watcher.wait();
+//       ...
+//    }
+//
+// The directories containing the files are watched rather than the files
+// themselves, so that files replaced by rename (as many editors do) are
+// still reported.  Only completed writes are reported, never partial ones.
+//
+
+#ifndef SPINXFORM_FILEWATCHER_H
+#define SPINXFORM_FILEWATCHER_H
+
+#include <string>
+#include <vector>
+
+class FileWatcher
+{
+   public:
+      FileWatcher( void );
+      ~FileWatcher( void );
+
+      bool add( const std::string& filename );
+      // starts watching filename; returns false on failure
+
+      std::vector<std::string> wait( int settleMilliseconds = 100 );
+      // blocks until at least one watched file has been rewritten and returns
+      // the names (as passed to add()) of all changed files -- events are
+      // collected until no more arrive for settleMilliseconds, so that a
+      // burst of saves is handled only once
+
+   protected:
+      FileWatcher( const FileWatcher& );
+      FileWatcher& operator=( const FileWatcher& );
+      // watchers are not copyable
+
+      bool read( int timeoutMilliseconds, std::vector<std::string>& changed );
+      // waits up to timeoutMilliseconds (-1 for no limit) for events and
+      // appends changed files; returns false on timeout
+
+      class Entry
+      {
+         public:
+            int directory; // inotify watch descriptor of the parent directory
+            std::string name; // file name within that directory
+            std::string path; // name as passed to add()
+      };
+
+      int fd; // inotify descriptor
+      std::vector<Entry> entries; // watched files
+};
+
+#endif
@@ -0,0 +1,74 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- FusedCG.h
+//
+// FusedCG holds the vector sweeps of two reformulations of preconditioned CG
+// that need fewer passes over memory, and fewer barriers between threads,
+// than cusp::krylov::cg (which runs two dot products, three axpys and a norm
+// as separate passes):
+//
+//    - Chronopoulos and Gear's CG computes all three inner products of an
+//      iteration in a single reduction right after the SpMV, so that an
+//      iteration is one update sweep, the SpMV and one reduction sweep;
+//
+//    - Ghysels and Vanroose's pipelined CG carries A times the residual and
+//      search direction along as extra vectors, which moves the reduction
+//      into the update sweep, so that an iteration is a single sweep and
+//      the SpMV, and the reduction no longer has to wait for the SpMV.
+//
+// Both use the vectors' own storage (host memory) and OpenMP; the SpMV and
+// any preconditioner other than the identity are applied by the caller (see
+// solve_on_device() in cusp_device.cu).  Standard usage of the pipelined
+// variant might look something like
+//
+//    // initially r = b - Ax, u = Mr, w = Au, m = Mw, n = Am and z, q, s, p = 0
+//    FusedCG<float>::dots( size, &r[0], &u[0], &w[0], gamma, delta, rr );
+//    while( sqrt( rr ) > tolerance )
+//    {
+//       // alpha and beta from gamma, delta and their previous values
+//       FusedCG<float>::pipelinedUpdate( size, alpha, beta, &n[0], &m[0],
+//                                        &z[0], &q[0], &s[0], &p[0], &x[0],
+//                                        &r[0], &u[0], &w[0],
+//                                        preconditioned, gamma, delta, rr );
+//       // m = Mw, n = Am
+//    }
+//
+// The inner products are accumulated in double precision.  The recurrences
+// are algebraically equivalent to CG, but rounding errors accumulate
+// differently: in single precision, the pipelined variant's residual drifts
+// noticeably from b - Ax, so pipelined_cg() in cusp_device.cu recomputes it
+// (and the vectors derived from it) every 25 iterations.
+//
+
+#ifndef SPINXFORM_FUSEDCG_H
+#define SPINXFORM_FUSEDCG_H
+
+template <class T>
+class FusedCG
+{
+   public:
+      static void dots( int size, const T* r, const T* u, const T* w,
+                        double& gamma, double& delta, double& rr );
+      // computes gamma = <r,u>, delta = <w,u> and rr = <r,r> in one sweep
+
+      static void update( int size, T alpha, T beta, const T* u, const T* w,
+                          T* p, T* s, T* x, T* r );
+      // Chronopoulos-Gear update, in one sweep:
+      //    p = u + beta p, s = w + beta s, x += alpha p, r -= alpha s
+      // (u may be r, when there is no preconditioner)
+
+      static void pipelinedUpdate( int size, T alpha, T beta,
+                                   const T* n, const T* m,
+                                   T* z, T* q, T* s, T* p, T* x, T* r, T* u, T* w,
+                                   bool preconditioned,
+                                   double& gamma, double& delta, double& rr );
+      // Ghysels-Vanroose update followed by the next iteration's inner
+      // products, in one sweep:
+      //    z = n + beta z, q = m + beta q, s = w + beta s, p = u + beta p,
+      //    x += alpha p, r -= alpha s, u -= alpha q, w -= alpha z,
+      //    gamma = <r,u>, delta = <w,u>, rr = <r,r>
+      // without a preconditioner, u is r, m is w and q is s, and only the
+      // first of each pair is passed on and updated
+};
+
+#endif
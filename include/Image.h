@@ -25,6 +25,15 @@
 //    float p[2] = { .5, 1.23 };
 //    float value = im.sample( p[0], p[1] );
 //
+// Reading an image also builds a mip pyramid of successively halved copies,
+// so that the average over a region roughly 2^lod pixels wide can be looked
+// up in constant time via sample( x, y, lod ).  Many points can be sampled at
+// once with sampleBatch(), which is vectorized when compiled with AVX2.
+//
+// Pixels are kept as 8-bit values, copied out of the memory-mapped file once
+// the header has been validated; the coarser mip levels use 16-bit fixed
+// point, so the whole pyramid takes less than two bytes per pixel.
+//
 
 #ifndef SPINXFORM_IMAGE_H
 #define SPINXFORM_IMAGE_H
@@ -37,32 +46,61 @@ using namespace std;
 class Image
 {
    public:
-            float& operator()( int x, int y );
-      const float& operator()( int x, int y ) const;
-      // accesses float (x,y)
+      Image( void );
+
+      float operator()( int x, int y ) const;
+      // returns pixel (x,y) as a value in the range [0,1]
 
       float sample( float x, float y ) const;
       // samples image at (x,y) using bilinear filtering
 
+      float sample( float x, float y, float lod ) const;
+      // samples the average of the image over a square about 2^lod pixels
+      // wide centered at (x,y), using trilinear filtering of the mip pyramid
+
+      void sampleBatch( int level, int n, const float* x, const float* y, float* values ) const;
+      // samples mip level "level" at the n points (x[i],y[i]), given in
+      // level-0 pixel coordinates, using bilinear filtering
+
+      int levels( void ) const;
+      // returns the number of levels in the mip pyramid (including the image)
+
       int  width( void ) const;
       int height( void ) const;
       // returns image dimensions
 
-      void read( const char* filename );
+      bool read( const char* filename );
       // loads an image file in Truevision TGA format
-      // (must be uncompressed RGB image with 24 or 32 bits per float)
+      // (must be uncompressed grayscale image with 8 bits per pixel);
+      // returns false (after reporting the problem on cerr) if the file
+      // can't be read or is malformed, leaving the image empty
 
-      void reload( void );
-      // updates image from disk
+      bool reload( void );
+      // updates image from disk; returns false as read() does
 
    protected:
+      Image( const Image& );
+      Image& operator=( const Image& );
+      // pixels points into the image's own buffer, so images are not copyable
+
       void clamp( int& x, int& y ) const;
       // clamps coordinates to range [0,w-1] x [0,h-1]
 
+      void buildPyramid( void );
+      // builds the mip pyramid from the full-resolution pixels
+
+      float sampleLevel( int level, float x, float y ) const;
+      // samples mip level "level" at (x,y) in level-0 pixel coordinates
+      // using bilinear filtering
+
       string filename; // name of source file
-      vector<float> pixels; // interleaved RGBA float data in range [0-1]
+      const unsigned char* pixels; // 8-bit grayscale data (w*h values)
       int w; // width
       int h; // height
+
+      vector<unsigned char> copy; // level 0, followed by zero padding
+      vector< vector<unsigned short> > pyramid; // mip levels 1, 2, ... (16-bit)
+      vector<int> levelWidth, levelHeight; // dimensions of each mip level
 };
 
 #endif
@@ -20,31 +20,40 @@
 //
 //    Ax = b
 //
-// where A is a positive-definite matrix.
+// where A is a positive-definite matrix.  The template parameter T selects the
+// precision of both the system and the CUSP solve.
 
 #ifndef SPINXFORM_LINEAR_SOLVER_H
 #define SPINXFORM_LINEAR_SOLVER_H
 
 #include "QuaternionMatrix.h"
+#include "cusp_device.h"
 #include <vector>
 
+template <class T>
 class LinearSolver {
    public:
        
       // solves the linear system Ax = b where A is positive-semidefinite 
-      // with a conjugate gradient solver from CUSP library 
-      static void solve( QuaternionMatrix&        A,
-			 std::vector<Quaternion>& x,
-                         std::vector<Quaternion>& b,
-                         bool precondition = true   );
+      // with a conjugate gradient solver from CUSP library; if initialGuess
+      // is set, the iteration starts from the current value of x instead
+      // of zero; the solve is reported to the Profiler under "name";
+      // options select the backend, preconditioner and stopping criteria
+      static void solve( QuaternionMatrix<T>&        A,
+			 std::vector< Quaternion<T> >& x,
+                         std::vector< Quaternion<T> >& b,
+                         bool precondition = true,
+                         bool initialGuess = false,
+                         const char* name = "cg",
+                         const SolverOptions& options = SolverOptions() );
       
       // converts vector from quaternion- to real-valued entries
-      static void toReal( const std::vector<Quaternion>& uQuat,
-			                 std::vector<float>& uReal );
+      static void toReal( const std::vector< Quaternion<T> >& uQuat,
+			                 std::vector<T>& uReal );
       
       // converts vector from real- to quaternion-valued entries
-      static void toQuat( std::vector<float>& uReal,
-		                    std::vector<Quaternion>& uQuat );
+      static void toQuat( std::vector<T>& uReal,
+		                    std::vector< Quaternion<T> >& uQuat );
 };
 
 #endif
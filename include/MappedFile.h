@@ -0,0 +1,53 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MappedFile.h
+//
+// MappedFile is a read-only view of a file mapped into memory.  Standard usage
+// might look something like
+//
+//    MappedFile file;
+//    if( file.open( "mesh.obj" ))
+//    {
+//       const char* begin = file.data();
+//       const char* end   = file.data() + file.size();
+//       ...
+//    }
+//
+// The mapping is released when the object goes out of scope or close() is
+// called.  Empty files are reported as open with a null data pointer.
+//
+
+#ifndef SPINXFORM_MAPPEDFILE_H
+#define SPINXFORM_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+class MappedFile
+{
+   public:
+      MappedFile( void );
+      ~MappedFile( void );
+
+      bool open( const std::string& filename );
+      // maps the whole file read-only; returns false on failure
+
+      void close( void );
+      // releases the mapping
+
+      const char* data( void ) const;
+      // returns pointer to the first byte of the file
+
+      size_t size( void ) const;
+      // returns file size in bytes
+
+   protected:
+      MappedFile( const MappedFile& );
+      MappedFile& operator=( const MappedFile& );
+      // mappings are not copyable
+
+      char* start; // first mapped byte
+      size_t length; // number of mapped bytes
+};
+
+#endif
@@ -0,0 +1,72 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MemoryTracker.h
+//
+// MemoryTracker counts heap memory allocated through operator new, which
+// MemoryTracker.cpp replaces for the whole program (memory obtained from
+// malloc directly is not seen).  The size of each block is taken from
+// malloc_usable_size, so the counts include allocator rounding.  Nothing is
+// counted until enable() is called (Profiler::enable() does), so that runs
+// without a profile only pay for a flag test.  Standard usage might look
+// something like
+//
+//    MemoryTracker::enable();
+//    ...
+//    long long before = MemoryTracker::threadBytes();
+//    long long outerPeak = MemoryTracker::resetPeak();
+//    ...
+//    long long peak = MemoryTracker::peakBytes() - before;
+//    MemoryTracker::raisePeak( outerPeak );
+//
+// Each thread counts into its own slot.  currentBytes(), allocations() and
+// allocatedBytes() sum over all threads, so work running concurrently on
+// other threads shows up as well; the peak is kept per thread, so that
+// concurrent phases don't reset each other's, but it misses what other
+// threads (e.g., OpenMP workers) allocate for the caller.  Blocks allocated
+// before enable() and freed after it count negatively.  readStatus()
+// reports what the kernel sees, i.e., the resident set size including
+// everything that isn't on the heap.
+//
+
+#ifndef SPINXFORM_MEMORYTRACKER_H
+#define SPINXFORM_MEMORYTRACKER_H
+
+class MemoryTracker
+{
+   public:
+      static void enable( void );
+      // starts counting
+
+      static bool isEnabled( void );
+      // returns whether enable() has been called
+
+      static long long currentBytes( void );
+      // returns the number of bytes currently allocated by all threads
+
+      static long long threadBytes( void );
+      // returns the bytes allocated minus the bytes freed by the calling
+      // thread
+
+      static long long peakBytes( void );
+      // returns the largest value threadBytes() has had since the last
+      // call to resetPeak() on the calling thread
+
+      static unsigned long long allocations( void );
+      static unsigned long long allocatedBytes( void );
+      // return the number of allocations since enable() and the bytes
+      // handed out by them, over all threads
+
+      static long long resetPeak( void );
+      // restarts the calling thread's peak at its current level; returns
+      // the old peak
+
+      static void raisePeak( long long bytes );
+      // makes the calling thread's peak at least bytes (e.g., to restore
+      // an outer peak)
+
+      static bool readStatus( long long& residentKB, long long& peakResidentKB );
+      // reads VmRSS and VmHWM from /proc/self/status; returns false on
+      // failure
+};
+
+#endif
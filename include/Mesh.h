@@ -19,75 +19,220 @@
 // is computed by calling updateDeformation(), which puts the transformed
 // vertices in the list "newVertices."
 //
+// Reading an OBJ file also writes a binary cache next to it (see read()), so
+// that later runs on the same mesh skip parsing and operator setup.
+//
+// Mesh is templated on the scalar type T (float or double) used for the
+// geometry, the assembled operators and the linear solves; Meshf and Meshd
+// name the two instantiations that are built.
+//
 
 #ifndef SPINXFORM_MESH_H
 #define SPINXFORM_MESH_H
 
 #include <vector>
 #include <string>
+#include <memory>
 #include "Quaternion.h"
 #include "QuaternionMatrix.h"
+#include "cusp_device.h"
 #include "Image.h"
+#include "MappedFile.h"
+#include "BufferedFile.h"
 
 using namespace std;
 
+template <class T>
 class Face
 {
    public:
       int vertex[3]; // indices into vertex list
-      Vector uv[3]; // texture coordinates (for visualization only)
+      Vector<T> uv[3]; // texture coordinates (for visualization only)
 };
 
+template <class T>
 class Mesh
 {
    public:
-      void read( const string& filename );
-      // loads a triangle mesh in Wavefront OBJ format
+      Mesh( void );
+
+      bool read( const string& filename );
+      // loads a triangle mesh in Wavefront OBJ format; if useCache is set,
+      // the mesh is taken from filename.float.cache (or .double.cache) when
+      // that file matches the content hash of the OBJ, and the cache is
+      // (re)written otherwise; returns false (after reporting the problem on
+      // cerr) if the file can't be read or is malformed, in which case the
+      // mesh must be read again before it is used
+
+      void initialize( void );
+      // sets up a mesh whose vertices and faces were filled in directly
+      // (e.g., by MeshGenerator) rather than read from a file
 
       void write( const string& filename );
-      // saves a triangle mesh in Wavefront OBJ format
+      // saves the deformed mesh -- in binary little-endian PLY format if
+      // filename ends in ".ply", and in Wavefront OBJ format otherwise
 
-      void setCurvatureChange( const Image& image, const float scale );
+      int setCurvatureChange( const Image& image, const T scale );
       // sets rho values by interpreting "image" as a square image
       // in the range [0,1] x [0,1] and mapping values to the
       // surface via vertex texture coordinates -- grayscale
       // values in the  range [0,1] get mapped (linearly) to values
-      // in the range [-scale,scale]
-
-      void updateDeformation( void );
-      // computes a conformal deformation using the current rho
+      // in the range [-scale,scale]; returns the number of faces
+      // whose rho changed
+
+      void updateDeformation( bool warmStart = false );
+      // computes a conformal deformation using the current rho; if
+      // warmStart is set, the previous lambda and newVertices are
+      // used as initial guesses for the solvers
+
+      bool updateDeformationLocal( int rings );
+      // updates the deformation only within "rings" rings of the faces
+      // whose rho changed since the last solve, using the previous lambda
+      // and newVertices as fixed (Dirichlet) values just outside; falls
+      // back to a global solve (and returns false) if there is no previous
+      // solution, the edit is large, or the residual just outside the
+      // region exceeds localTolerance (see localVertices and
+      // localEigenResidual for what it measured)
+
+      void prepareOperators( void );
+      // builds the Laplacian and its real form (and, for the sell backend,
+      // its SELL form) up front; afterwards, copies of this mesh (which
+      // share the Laplacian) can compute deformations concurrently
 
       void resetDeformation( void );
       // restores surface to its original configuration
 
-      float area( int i );
+      T area( int i );
       // returns area of triangle i in the original mesh
 
-      vector<Face> faces;
+      vector< Face<T> > faces;
       // list of triangles as indices into vertex list
 
-      vector<Quaternion> vertices, newVertices;
+      vector< Quaternion<T> > vertices, newVertices;
       // original and deformed vertex coordinates
 
-      vector<float> rho;
+      vector<T> rho;
       // controls change in curvature (one value per face)
 
+      bool useCache;
+      // read and write the binary mesh cache (default: true)
+
+      bool cacheOperators;
+      // also store per-face geometry, the sparsity pattern and the
+      // Laplacian in the cache (default: true)
+
+      T localTolerance;
+      // largest relative residual accepted from a local update (default: 1e-2)
+
+      int localVertices;
+      // size of the region the last updateDeformationLocal() considered
+      // (0 if it had no previous solution or nothing changed)
+
+      T localEigenResidual, localPoissonResidual;
+      // relative residuals of the eigenvalue and Poisson problems on the
+      // ring just outside that region, as compared against localTolerance
+      // (-1 if the region wasn't solved locally)
+
+      T eigenTolerance;
+      // a warm-started update stops refining lambda once |E lambda - c lambda|
+      // is at most this fraction of |E lambda| (default: 5e-2, a little
+      // tighter than what a cold start reaches)
+
+      SolverOptions solverOptions;
+      // backend, preconditioner and stopping criteria of every CG solve
+      // (default: see SolverOptions)
+
+      int eigenIterations;
+      // inverse iterations of the global eigen solve (default: 3)
+
+      bool symmetricStorage;
+      // store only the upper triangle of E and L, which are Hermitian, and
+      // multiply by them with a symmetric SpMV when solving on the host or
+      // sell backend -- the device backend always stores both triangles
+      // (default: true; takes effect when the operators are next built
+      // from scratch, so set it and solverOptions.backend before read())
+
+      T innerToleranceFactor;
+      // CG tolerance of each inverse iteration relative to the current
+      // eigen-residual |E lambda - c lambda| / |E lambda|, within [1/100,
+      // 10] times solverOptions.tolerance (default: 0.1; 0 uses
+      // solverOptions.tolerance throughout)
+
    protected:
 
-      vector<Quaternion> lambda;
+      vector< Quaternion<T> > lambda;
       // local similarity transformation (one value per vertex)
 
-      vector<Quaternion> omega;
+      vector< Quaternion<T> > omega;
       // divergence of target edge vectors
 
-      QuaternionMatrix L; // Laplace matrix
-      QuaternionMatrix E; // matrix for eigenvalue problem
+      T solutionScale;
+      // factor by which normalizeSolution() shrank newVertices
 
+      shared_ptr< QuaternionMatrix<T> > L;
+      // Laplace matrix -- it depends only on the original geometry, so
+      // copies of a mesh share it (read() gives a mesh a new one)
+      QuaternionMatrix<T> E; // matrix for eigenvalue problem
+
+      T eigenvalue;
+      // estimate of the smallest eigenvalue of E for the current lambda
+
+      bool eigenvalueKnown;
+      // whether eigenvalue is valid (i.e., E has been solved since it
+      // was last rebuilt from scratch)
+
+      bool eigenvalueProblemBuilt;
+      // whether E holds the full assembly for assembledRho
+
+      vector<T> assembledRho;
+      // value of rho each face's contribution to E was computed with
+
+      int deltaUpdates;
+      // number of incremental updates of E since it was last rebuilt
+
+      bool laplacianBuilt;
+      // L depends only on the original vertices, so it is built once
+
+      vector<T> areas;
+      // area of each triangle in the original mesh
+
+      vector<T> cotans;
+      // cotangent of the angle at each triangle corner in the original mesh
+
+      vector<typename QuaternionMatrix<T>::EntryIndex> pattern;
+      // sparsity pattern shared by E and L, in storage order
+
+      bool readObj( const MappedFile& in, const string& filename );
+      bool readCache( const string& cacheName, unsigned long long hash, size_t sourceSize );
+      void writeCache( const string& cacheName, unsigned long long hash, size_t sourceSize );
+      void writeObj( BufferedFile& out );
+      void writePly( BufferedFile& out );
+
+      void clearOperators( void );
+      void allocateAttributes( void );
+      void buildGeometry( void );
       void buildEigenvalueProblem( void );
+      T updateEigenvalueProblem( int face );
       void buildPoissonProblem( void );
       void buildLaplacian( void );
+      bool halfStorage( void ) const;
       void buildOmega( void );
+      Quaternion<T> transformedEdge( int a, int b ) const;
+      Quaternion<T> omegaAt( int v ) const;
+
+      vector<int> vertexFaceStart, vertexFaces;
+      // faces around each vertex -- those of vertex v are
+      // vertexFaces[ vertexFaceStart[v] ... vertexFaceStart[v+1]-1 ]
+
+      vector<int> localIndex;
+      // scratch map from vertices to region indices (-1 outside)
+
+      void buildAdjacency( void );
+      void vertexNeighbors( int v, vector<int>& neighbors ) const;
       void normalizeSolution( void );
 };
 
+typedef Mesh<float>  Meshf;
+typedef Mesh<double> Meshd;
+
 #endif
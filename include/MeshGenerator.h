@@ -0,0 +1,62 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MeshGenerator.h
+//
+// MeshGenerator builds procedural meshes with texture coordinates directly
+// into a Mesh, so that scaling studies can sweep the mesh size without
+// shipping (or parsing) large OBJ files.  Standard usage might look
+// something like
+//
+//    Meshf mesh;
+//    MeshGenerator<float>::icosphere( mesh, 7 ); // 327,680 faces
+//    mesh.setCurvatureChange( image, 5. );
+//    mesh.updateDeformation();
+//
+// or, to get close to a given number of faces,
+//
+//    MeshGenerator<float>::generate( mesh, "torus", 1000000 );
+//
+// Output is deterministic.  Texture coordinates cover the square image once
+// (u around the axis, v from pole to pole or around the tube); faces that
+// straddle the seam get u values just above 1 rather than wrapping, so uv
+// triangles never flip.  All three shapes are closed manifolds with
+// outward-facing triangles.
+//
+
+#ifndef SPINXFORM_MESHGENERATOR_H
+#define SPINXFORM_MESHGENERATOR_H
+
+#include <string>
+#include "Mesh.h"
+
+using namespace std;
+
+template <class T>
+class MeshGenerator
+{
+   public:
+      static void uvSphere( Mesh<T>& mesh, int columns, int rows );
+      // unit latitude-longitude sphere with the given number of columns
+      // (around the axis) and rows (pole to pole); 2*columns*(rows-1) faces
+
+      static void icosphere( Mesh<T>& mesh, int subdivisions );
+      // unit sphere obtained by repeatedly splitting the faces of an
+      // icosahedron into four; 20*4^subdivisions faces
+
+      static void torus( Mesh<T>& mesh, int columns, int rows, T minorRadius );
+      // torus around the y axis with major radius 1, tube radius
+      // minorRadius, and the given number of columns (around the axis)
+      // and rows (around the tube); 2*columns*rows faces
+
+      static bool generate( Mesh<T>& mesh, const string& shape, int nFaces );
+      // builds "uvsphere", "icosphere" or "torus" at the resolution giving
+      // the face count closest to nFaces (for the icosphere, closest on a
+      // log scale); returns false if the shape is unknown
+
+      static bool writeObj( const Mesh<T>& mesh, const string& filename );
+      // saves the original (undeformed) mesh with its texture coordinates
+      // in Wavefront OBJ format, so it can be read back with Mesh::read();
+      // returns false on failure
+};
+
+#endif
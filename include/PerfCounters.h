@@ -0,0 +1,64 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- PerfCounters.h
+//
+// PerfCounters reads the CPU's hardware performance counters for the calling
+// thread through Linux perf_event_open.  Standard usage might look something
+// like
+//
+//    PerfCounters counters;
+//    unsigned long long before[PerfCounters::count], after[PerfCounters::count];
+//    if( counters.open() && counters.read( before ))
+//    {
+//       ...
+//       counters.read( after );
+//    }
+//
+// All counters are opened as one group, so they are scheduled together and
+// the values read at one instant belong to the same interval; if the kernel
+// has to multiplex them, the values are scaled up to the full interval.
+// Counting needs hardware support (most virtual machines have none) and a
+// low enough /proc/sys/kernel/perf_event_paranoid; open() fails otherwise.
+// Only the thread that called open() is counted.
+//
+
+#ifndef SPINXFORM_PERFCOUNTERS_H
+#define SPINXFORM_PERFCOUNTERS_H
+
+class PerfCounters
+{
+   public:
+      enum Counter
+      {
+         cycles,
+         instructions,
+         cacheMisses, // last-level cache misses
+         branchMisses,
+         count
+      };
+
+      PerfCounters( void );
+      ~PerfCounters( void );
+
+      bool open( void );
+      // starts counting on the calling thread; returns false if the
+      // counters are unavailable
+
+      bool read( unsigned long long values[count] ) const;
+      // stores the current counts; returns false on failure
+
+      static const char* name( int counter );
+      // returns the name of a counter as used in reports
+
+   protected:
+      PerfCounters( const PerfCounters& );
+      PerfCounters& operator=( const PerfCounters& );
+      // counters are not copyable
+
+      void close( void );
+      // stops counting
+
+      int fd[count]; // one descriptor per counter; fd[0] leads the group
+};
+
+#endif
@@ -0,0 +1,154 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- Profiler.h
+//
+// Profiler collects wall-clock timings of the phases of a run and writes them
+// as a JSON report.  Phases are marked with scoped timers, e.g.,
+//
+//    void Mesh<T> :: buildLaplacian( void )
+//    {
+//       ScopedTimer timer( "assemble laplacian" );
+//       ...
+//    }
+//
+// and linear solves additionally report their iteration counts and residuals
+// through Profiler::recordSolve().  Nothing is recorded until enable() (or
+// enableTrace()) is called, and a disabled timer costs one flag test.
+// Timings are inclusive (a phase that calls another contains its time) and
+// may come from any thread.
+//
+// The report has the form
+//
+//    {
+//       "phases": [ { "name": "read", "calls": 1, "total_ms": 12.5,
+//                     "min_ms": 12.5, "max_ms": 12.5 }, ... ],
+//       "solves": [ { "name": "poisson", "start_ms": 80.1, "ms": 30.2,
+//                     "iterations": 58, "residual": 2.6e-06,
+//                     "converged": true, "spmv_bytes": 1.5e+06,
+//                     "spmv_gb_per_s": 2.9 }, ... ]
+//    }
+//
+// with phases listed in the order they first finished and times measured from
+// when recording started.  spmv_bytes is the matrix and vector traffic of one
+// sparse matrix-vector product; spmv_gb_per_s multiplies it by the number of
+// iterations and divides by the whole solve time, so it is a lower bound on
+// the bandwidth the products achieved.
+//
+// With enableCounters(), phases also report hardware counters (cycles,
+// instructions, llc_misses, branch_misses and the derived ipc) taken from
+// PerfCounters on the thread that ran them.  Only that thread is counted:
+// the work of OpenMP workers inside a phase is missing from its counters,
+// and the report says so with "counter_scope": "calling thread".
+//
+// Every phase also reports its heap activity as counted by MemoryTracker:
+// the number and size of its allocations (alloc_count, alloc_bytes), the
+// largest amount it held beyond what was in use when it began (peak_bytes,
+// the maximum over calls) and what it left behind (net_bytes).  The counts
+// and net_bytes are process-wide, so phases running concurrently (e.g., in
+// batch mode) see each other's allocations; peak_bytes is taken on the
+// thread that ran the phase, so it stays per phase but leaves out what
+// OpenMP workers allocate.  A "memory" section gives the heap totals (with
+// heap_peak_bytes the peak of the thread writing the report) along with the
+// resident set size and its high-water mark (rss_kb, peak_rss_kb) from
+// /proc/self/status, which is the process-wide peak.
+//
+// Tracing (enableTrace()) additionally keeps every timed interval, tagged
+// with the thread it ran on, in a ring buffer allocated up front; CG solves
+// add one event per iteration.  Writers claim slots with a single atomic
+// increment, so tracing takes no locks, and once the buffer is full the
+// oldest events are overwritten.  writeTrace() dumps the buffer in the
+// Chrome trace-event format, which chrome://tracing and Perfetto
+// (ui.perfetto.dev) can open.
+//
+
+#ifndef SPINXFORM_PROFILER_H
+#define SPINXFORM_PROFILER_H
+
+#include <string>
+#include <cstddef>
+#include "PerfCounters.h"
+
+class PhaseMemory
+// heap activity during one call of a phase
+{
+   public:
+      unsigned long long allocations; // number of allocations
+      unsigned long long allocatedBytes; // bytes allocated
+      long long netBytes; // change in bytes in use
+      long long peakBytes; // most bytes in use beyond the starting level
+};
+
+class Profiler
+{
+   public:
+      static void enable( void );
+      // starts recording phase totals and solves
+
+      static bool enableCounters( void );
+      // also records hardware counters per phase (once enable() has been
+      // called); returns false if they are unavailable on this thread
+
+      static void enableTrace( size_t capacity );
+      // starts recording a timeline of up to capacity events
+
+      static bool enabled( void );
+      // returns whether timings are being recorded in any form
+
+      static bool tracing( void );
+      // returns whether a timeline is being recorded
+
+      static double now( void );
+      // returns seconds since recording started
+
+      static bool readCounters( unsigned long long values[PerfCounters::count] );
+      // stores the hardware counters of the calling thread; returns false
+      // if counters are off or unavailable
+
+      static void record( const char* name, double start, double duration,
+                          const unsigned long long* counters = NULL,
+                          const PhaseMemory* memory = NULL );
+      // adds one call of phase name that began at time start (in seconds),
+      // along with the change in hardware counters and the heap activity
+      // if given
+
+      static void trace( const char* name, double start, double duration,
+                         int iteration, double residual );
+      // adds one solver iteration to the timeline only
+
+      static void recordSolve( const char* name, double start, double duration,
+                               int iterations, double residual, bool converged,
+                               double spmvBytes );
+      // adds one linear solve, along with the outcome reported by the solver
+      // and the bytes moved by one of its matrix-vector products
+
+      static bool write( const std::string& filename );
+      // writes the JSON report to filename ("-" for standard output);
+      // returns false on failure
+
+      static bool writeTrace( const std::string& filename );
+      // writes the timeline as Chrome trace JSON to filename; returns
+      // false on failure
+};
+
+class ScopedTimer
+// records the time from construction to destruction as one call of a phase
+{
+   public:
+      ScopedTimer( const char* name );
+      ~ScopedTimer( void );
+
+   protected:
+      ScopedTimer( const ScopedTimer& );
+      ScopedTimer& operator=( const ScopedTimer& );
+      // timers are not copyable
+
+      const char* name; // phase being timed (NULL if profiling is off)
+      double start; // Profiler::now() at construction
+      bool counting; // whether counters holds the counts at construction
+      unsigned long long counters[PerfCounters::count];
+      PhaseMemory memory; // heap counts at construction
+      long long threadBytes; // heap held by this thread at construction
+      long long outerPeak; // heap peak of the enclosing phases
+};
+
+#endif
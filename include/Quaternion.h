@@ -24,6 +24,9 @@
 //
 // sets the imaginary part to v and the real part to zero.
 //
+// The component type T is either float or double (see Quaternionf and
+// Quaterniond below).
+//
 
 #ifndef SPINXFORM_QUATERNION_H
 #define SPINXFORM_QUATERNION_H
@@ -31,42 +34,45 @@
 #include "Vector.h"
 #include <ostream>
 
+template <class T>
 class Quaternion
 {
    public:
+      typedef T ValueType; // component type
+
       // CONSTRUCTORS ----------------------------------------------------------
-      Quaternion( void );                                      // initializes all components to zero
-      Quaternion( const Quaternion& q );                       // initializes from existing quaternion
-      Quaternion( float s, float vi, float vj, float vk ); // initializes with specified real (s) and imaginary (v) components
-      Quaternion( float s, const Vector& v );                 // initializes with specified real (s) and imaginary (v) components
-      Quaternion( float s );                                  // initializes purely real quaternion with specified real (s) component
-      Quaternion( const Vector& v );                           // initializes purely imaginary quaternion with specified imaginary (v) component
+      Quaternion( void );                                // initializes all components to zero
+      Quaternion( const Quaternion& q );                 // initializes from existing quaternion
+      Quaternion( T s, T vi, T vj, T vk );               // initializes with specified real (s) and imaginary (v) components
+      Quaternion( T s, const Vector<T>& v );             // initializes with specified real (s) and imaginary (v) components
+      Quaternion( T s );                                 // initializes purely real quaternion with specified real (s) component
+      Quaternion( const Vector<T>& v );                  // initializes purely imaginary quaternion with specified imaginary (v) component
       
       // ASSIGNMENT OPERATORS --------------------------------------------------
-      const Quaternion& operator=( float s ); // assigns a purely real quaternion with real value s
-      const Quaternion& operator=( const Vector& v ); // assigns a purely real quaternion with imaginary value v
+      const Quaternion& operator=( T s );                // assigns a purely real quaternion with real value s
+      const Quaternion& operator=( const Vector<T>& v ); // assigns a purely real quaternion with imaginary value v
 
       // ACCESSORS -------------------------------------------------------------
-            float& operator[]( int index );       // returns reference to the specified component (0-based indexing: r, i, j, k)
-      const float& operator[]( int index ) const; // returns const reference to the specified component (0-based indexing: r, i, j, k)
-      void toMatrix( float Q[4][4] ) const;       // builds 4x4 matrix Q representing (left) quaternion multiplication
-            float& re( void );                    // returns reference to float part
-      const float& re( void ) const;              // returns const reference to float part
-            Vector& im( void );                    // returns reference to imaginary part
-      const Vector& im( void ) const;              // returns const reference to imaginary part
+            T& operator[]( int index );              // returns reference to the specified component (0-based indexing: r, i, j, k)
+      const T& operator[]( int index ) const;        // returns const reference to the specified component (0-based indexing: r, i, j, k)
+      void toMatrix( T Q[4][4] ) const;              // builds 4x4 matrix Q representing (left) quaternion multiplication
+            T& re( void );                           // returns reference to real part
+      const T& re( void ) const;                     // returns const reference to real part
+            Vector<T>& im( void );                   // returns reference to imaginary part
+      const Vector<T>& im( void ) const;             // returns const reference to imaginary part
 
       // VECTOR SPACE OPERATIONS -----------------------------------------------
       Quaternion operator+( const Quaternion& q ) const; // addition
       Quaternion operator-( const Quaternion& q ) const; // subtraction
       Quaternion operator-( void ) const;                // negation
-      Quaternion operator*( float c ) const;            // scalar multiplication
-      Quaternion operator/( float c ) const;            // scalar division
+      Quaternion operator*( T c ) const;                 // scalar multiplication
+      Quaternion operator/( T c ) const;                 // scalar division
       void       operator+=( const Quaternion& q );      // addition / assignment
-      void       operator+=( float c );                 // addition / assignment of pure real
+      void       operator+=( T c );                      // addition / assignment of pure real
       void       operator-=( const Quaternion& q );      // subtraction / assignment
-      void       operator-=( float c );                 // subtraction / assignment of pure real
-      void       operator*=( float c );                 // scalar multiplication / assignment
-      void       operator/=( float c );                 // scalar division / assignment
+      void       operator-=( T c );                      // subtraction / assignment of pure real
+      void       operator*=( T c );                      // scalar multiplication / assignment
+      void       operator/=( T c );                      // scalar division / assignment
 
       // ALGEBRAIC OPERATIONS --------------------------------------------------
       Quaternion operator*( const Quaternion& q ) const; // Hamilton product
@@ -75,22 +81,31 @@ class Quaternion
       Quaternion inv( void ) const;                      // inverse
       
       // NORMS -----------------------------------------------------------------
-      float norm( void ) const;     // returns Euclidean length
-      float norm2( void ) const;    // returns Euclidean length squared
+      T norm( void ) const;          // returns Euclidean length
+      T norm2( void ) const;         // returns Euclidean length squared
       Quaternion unit( void ) const; // returns unit quaternion
       void normalize( void );        // divides by Euclidean length
 
    protected:
       // STORAGE ---------------------------------------------------------------
-      float s; // scalar (float) part
-      Vector v; // vector (imaginary) part
+      T s;         // scalar (real) part
+      Vector<T> v; // vector (imaginary) part
 };
 
 // VECTOR SPACE OPERATIONS -----------------------------------------------
-Quaternion operator*( float c, const Quaternion& q ); // scalar multiplication
+template <class T>
+Quaternion<T> operator*( typename Quaternion<T>::ValueType c, const Quaternion<T>& q ); // scalar multiplication
+
+// GEOMETRIC OPERATIONS --------------------------------------------------
+template <class T>
+Quaternion<T> slerp( const Quaternion<T>& q0, const Quaternion<T>& q1, T t ); // spherical-linear interpolation
 
 // I/O -------------------------------------------------------------------------
-std::ostream& operator<<( std::ostream& os, const Quaternion& q ); // prints components
+template <class T>
+std::ostream& operator<<( std::ostream& os, const Quaternion<T>& q ); // prints components
+
+typedef Quaternion<float>  Quaternionf;
+typedef Quaternion<double> Quaterniond;
 
 #endif
 
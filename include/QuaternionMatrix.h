@@ -6,7 +6,7 @@
 // http://users.cms.caltech.edu/~keenan/src/spinxform_commandline.zip
 // at http://users.cms.caltech.edu/~keenan/project_spinxform.html
 //
-// This version has been modified so that it returns a real matrix in CUSP's COO
+// This version has been modified so that it returns a real matrix in CUSP's CSR
 // format.
 //
 // =============================================================================
@@ -20,7 +20,24 @@
 //    A( i, j ) = Quaternion( 1., 2., 3., 4. );
 //
 // A QuaternionMatrix can be converted to a sparse matrix with real-valued
-// entries by calling toRealCooFormat().
+// entries by calling toRealCsrFormat().  The template parameter T selects the
+// precision of both the quaternion entries and the resulting real matrix, and
+// Index the type of its row offsets and column indices (32-bit by default,
+// which is what the solver takes).
+// The real matrix is cached; entries updated with add() are patched into the
+// cache, while any other modification causes a full rebuild.  Its
+// SELL-C-sigma form (see SellMatrix.h), which the sell backend multiplies
+// by, is cached too and rebuilt after any modification.
+//
+// Hermitian matrices (A(j,i) is the conjugate of A(i,j), e.g., E and L) can
+// be kept in symmetric storage, which holds only the entries with row <= col;
+// the real matrix then holds only its upper triangle too, which halves both
+// the memory and the bandwidth of a multiply:
+//
+//    QuaternionMatrix<float> A;
+//    A.setSymmetric( true );
+//    A.resize( n, n );
+//    for( ... ) if( A.stores( i, j )) A( i, j ) += ...;
 //
 
 #ifndef SPINXFORM_QUATERNIONMATRIX_H
@@ -30,9 +47,9 @@
 #include <vector>
 #include <iostream>
 #include "Quaternion.h"
-#include "sparse_matrix.h"
+#include "SellMatrix.h"
 
-#include <cusp/coo_matrix.h>
+#include <cusp/csr_matrix.h>
 #include <cusp/print.h>
 #include <cusp/io/matrix_market.h>
 
@@ -42,41 +59,85 @@
 #include <thrust/device_vector.h>
 #include <thrust/copy.h>
 
+template <class T, class Index = int>
 class QuaternionMatrix
 {
    public:
+      QuaternionMatrix( void );
+
       void resize( int m, int n );
       // allocates an mxn matrix of zeros
+
+      void setSymmetric( bool symmetric );
+      // selects symmetric storage of a Hermitian matrix, in which element
+      // (row,col) with row > col is not stored but implied as the conjugate
+      // of (col,row); clears the matrix
+
+      bool isSymmetric( void ) const;
+      // returns whether symmetric storage is used
+
+      bool stores( int row, int col ) const;
+      // returns whether element (row,col) is stored explicitly (always, unless
+      // storage is symmetric and row > col) -- assembly visits only these
       
       int size( int dim ) const;
       // returns the size of the dimension specified by scalar dim
 
-            Quaternion& operator()( int& row, int& col );
-      const Quaternion& operator()( int row, int col ) const;
+      Quaternion<T>& operator()( int& row, int& col );
+      Quaternion<T>  operator()( int row, int col ) const;
       // access element (row,col)
-      // note: uses 0-based indexing
+      // note: uses 0-based indexing; writes must go to stored elements
+
+      void add( int row, int col, const Quaternion<T>& q );
+      // adds q to element (row,col); in symmetric storage, adds to elements
+      // that aren't stored are ignored (the caller also adds to the element
+      // they mirror)
+
+      void multiply( const std::vector< Quaternion<T> >& x,
+                           std::vector< Quaternion<T> >& y ) const;
+      // computes y = Ax
+
+      typedef std::pair<int,int> EntryIndex; // NOTE: column THEN row! (makes it easier to build compressed format)
+
+      void getEntries( std::vector<EntryIndex>& indices,
+                       std::vector< Quaternion<T> >& values ) const;
+      // returns all stored entries in storage order (sorted by column, then row)
+
+      void setEntries( const std::vector<EntryIndex>& indices,
+                       const std::vector< Quaternion<T> >& values );
+      // replaces the matrix contents; indices must be in storage order, which
+      // makes the insertion linear rather than O(n log n) -- passing zeros for
+      // values preallocates a sparsity pattern
       
-      // define type of CUSP's COO matrix --------------------------------------
+      // define type of CUSP's CSR matrix --------------------------------------
       
       // which index type to use
-      typedef size_t IndexType;
+      typedef Index IndexType;
 
       // where to perform the computation
       typedef cusp::host_memory MemorySpace;
 
       // which floating point type to use
-      typedef float ValueType;
+      typedef T ValueType;
    
-      typedef cusp::coo_matrix<IndexType, ValueType, MemorySpace> coo_cusp; 
+      typedef cusp::csr_matrix<IndexType, ValueType, MemorySpace> csr_cusp; 
       // -----------------------------------------------------------------------
       
-      coo_cusp toRealCooFormat( void );
-      // returns real matrix in CUSP's COO format 
+      const csr_cusp& toRealCsrFormat( void );
+      // returns real matrix in CUSP's CSR format 
       // where each quaternion becomes a 4x4 block
+      // (only the upper triangle in symmetric storage)
+
+      const SellMatrix<T>& toSellFormat( void );
+      // returns the real matrix (see toRealCsrFormat()) in SELL-C-sigma
+      // format; the result is cached until the matrix is next modified
+
+      size_t realRebuilds( void ) const;
+      // returns the number of full conversions to real CSR format so far
+      // (calls that only patch entries changed through add() don't count)
       
    protected:
-      typedef std::pair<int,int> EntryIndex; // NOTE: column THEN row! (makes it easier to build compressed format)
-      typedef std::map<EntryIndex, Quaternion> EntryMap;
+      typedef std::map<EntryIndex, Quaternion<T> > EntryMap;
 
       EntryMap data;
       // non-zero entries
@@ -84,11 +145,39 @@ class QuaternionMatrix
       int m, n;
       // rows, columns
 
-      static Quaternion zero;
+      bool symmetric;
+      // whether only elements with row <= col are stored
+
+      static Quaternion<T> zero;
       // dummy value for const access of zeros
-      
-      SparseMatrixf A;
-      
+
+      void buildRealCsrFormat( void );
+      void patchRealCsrFormat( void );
+
+      bool storesReal( int i, int j, int u, int v ) const;
+      // returns whether the real matrix holds entry (u,v) of the 4x4 block
+      // of element (i,j)
+
+      csr_cusp real;
+      // cached real matrix (columns sorted within each row)
+
+      bool realValid;
+      // whether the cached real matrix is up to date (apart from "changed")
+
+      SellMatrix<T> sell;
+      // cached SELL-C-sigma form of the real matrix
+
+      bool sellValid;
+      // whether sell was built from the current real matrix
+
+      std::vector<EntryIndex> changed;
+      // entries modified through add() since the last conversion
+
+      size_t rebuilds;
+      // number of calls to buildRealCsrFormat()
 };
 
+typedef QuaternionMatrix<float>  QuaternionMatrixf;
+typedef QuaternionMatrix<double> QuaternionMatrixd;
+
 #endif
@@ -0,0 +1,83 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SellMatrix.h
+//
+// SellMatrix holds a real sparse matrix in SELL-C-sigma format (sliced
+// ELLPACK) for SpMV on the CPU.  Rows are sorted by length within windows of
+// sigma rows and cut into chunks of C rows; each chunk is stored column by
+// column and padded to its longest row, so that one SIMD instruction
+// processes the k-th entry of C rows at once.  Rows of the real forms of E
+// and L have nearly equal lengths (the valence of a vertex is about 6), so
+// little padding is needed.  Standard usage might look something like
+//
+//    SellMatrix<float> S;
+//    S.build( E.toRealCsrFormat(), E.isSymmetric() );
+//    S.multiply( &x[0], &y[0] ); // y = Ex
+//
+// C is the SIMD width of the kernel compiled in: 16 floats or 8 doubles with
+// AVX-512, 8 floats or 4 doubles with AVX2 (and a portable loop with the AVX2
+// layout otherwise).  Chunks are multiplied in parallel with OpenMP.
+//
+
+#ifndef SPINXFORM_SELLMATRIX_H
+#define SPINXFORM_SELLMATRIX_H
+
+#include <vector>
+#include <cusp/csr_matrix.h>
+
+using namespace std;
+
+template <class T>
+class SellMatrix
+{
+   public:
+      SellMatrix( void );
+
+      void build( const cusp::csr_matrix<int, T, cusp::host_memory>& A,
+                  bool symmetric = false, int sigma = 256 );
+      // converts A, or the symmetric matrix whose upper triangle A holds
+      // if symmetric is set, sorting rows by length within windows of sigma
+      // rows (rounded up to a multiple of C)
+
+      void multiply( const T* x, T* y ) const;
+      // computes y = Ax
+
+      int size( void ) const;
+      // returns the number of rows
+
+      size_t entries( void ) const;
+      // returns the number of nonzeros
+
+      size_t slots( void ) const;
+      // returns the number of stored entries, including padding
+
+      double bytes( void ) const;
+      // returns the matrix and vector bytes one multiply reads and writes
+
+      static int chunkHeight( void );
+      // returns C
+
+      static const char* kernel( void );
+      // returns the instruction set of the kernel ("avx512", "avx2" or
+      // "scalar")
+
+   protected:
+      int rows;
+      // number of rows (and columns)
+
+      size_t nonzeros;
+      // entries of the (full) matrix
+
+      vector<int> chunkStart;
+      // first slot of each chunk, plus one past the last; entry k of lane l
+      // of chunk c is slot chunkStart[c] + k*C + l
+
+      vector<int> columns;
+      vector<T> values;
+      // column and value of each slot (padding has value 0 and column 0)
+
+      vector<int> laneRow;
+      // original row of each lane (-1 for the lanes after the last row)
+};
+
+#endif
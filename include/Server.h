@@ -0,0 +1,106 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- Server.h
+//
+// Server keeps meshes resident between requests, so that repeated deformations
+// of the same surface skip process startup, parsing and operator setup.  It
+// listens on a Unix domain socket and reads one request per line, answering
+// each with one line that starts with "ok" or "error":
+//
+//    load <id> <mesh.obj>
+//       -> ok <vertices> <faces> <bytes per value> <result shm>
+//    deform <id> image <image.tga> <scale>
+//    deform <id> rho <rho shm> <scale>
+//       -> ok <result shm> <vertices> <milliseconds>
+//    unload <id>
+//    shutdown
+//
+// "load" makes the mesh in mesh.obj available under the name id and creates
+// a POSIX shared memory object that receives the deformed vertices (3 values
+// per vertex) after every "deform."  Values are floats, or doubles if the
+// server runs in double precision.  "deform ... rho" takes the change in
+// curvature from a shared memory object created by the client (one value per
+// face, multiplied by scale); "deform ... image" samples an image file as in
+// the command line tool, and keeps the image resident until it changes on
+// disk (up to maxImages of them, dropping the least recently used).  Files
+// that can't be read or are malformed get an "error" reply, and the server
+// keeps running.  Connections are served one at a time; a connection can
+// carry any number of requests.
+//
+
+#ifndef SPINXFORM_SERVER_H
+#define SPINXFORM_SERVER_H
+
+#include <string>
+#include <map>
+#include <memory>
+#include "Mesh.h"
+#include "Image.h"
+#include "SharedMemory.h"
+
+template <class T>
+class Server
+{
+   public:
+      Server( void );
+      ~Server( void );
+
+      bool listen( const std::string& socketPath );
+      // binds the socket (replacing a stale socket, but refusing to remove
+      // any other kind of file); returns false on failure
+
+      void run( void );
+      // serves connections until a shutdown request arrives
+
+      bool useCache;
+      // read and write the binary mesh cache (default: true)
+
+      static const size_t maxImages = 16;
+      // number of images kept resident
+
+   protected:
+      Server( const Server& );
+      Server& operator=( const Server& );
+      // servers are not copyable
+
+      void serve( int connection );
+      // answers requests on connection until the client hangs up
+
+      std::string handle( const std::string& request );
+      // carries out one request and returns the reply line
+
+      std::string load( const std::string& id, const std::string& meshFile );
+      std::string deform( const std::string& id, const std::string& source, const std::string& name, T scale );
+      std::string unload( const std::string& id );
+      // request handlers
+
+      const Image* image( const std::string& filename );
+      // returns the resident copy of an image, (re)loading it if it is new
+      // or has changed on disk; returns NULL if it can't be read
+
+      class Resident
+      {
+         public:
+            Mesh<T> mesh;
+            SharedMemory result; // deformed vertices for the client
+      };
+
+      class ResidentImage
+      {
+         public:
+            Image image;
+            long long modified; // modification time of the loaded file (ns)
+            unsigned long long used; // value of imageUses at the last request
+      };
+
+      std::map< std::string, std::shared_ptr<Resident> > meshes; // by id
+      std::map< std::string, std::shared_ptr<ResidentImage> > images; // by file name
+
+      int fd; // listening socket
+      std::string path; // socket file
+      bool stopping; // set by a shutdown request
+      unsigned int serial; // distinguishes result objects
+      unsigned long long imageUses; // number of image requests so far
+};
+
+#endif
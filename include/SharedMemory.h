@@ -0,0 +1,65 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SharedMemory.h
+//
+// SharedMemory is a POSIX shared memory object mapped into this process, used
+// to pass large arrays to and from other processes without copying them
+// through a socket.  Standard usage might look something like
+//
+//    SharedMemory result;
+//    if( result.create( "/spinxform.result", n*sizeof(float) ))
+//    {
+//       float* x = (float*) result.data();
+//       ...
+//    }
+//
+// An object made with create() is unlinked again when it is closed or goes
+// out of scope; an object made with open() is only unmapped.
+//
+
+#ifndef SPINXFORM_SHAREDMEMORY_H
+#define SPINXFORM_SHAREDMEMORY_H
+
+#include <string>
+#include <cstddef>
+
+class SharedMemory
+{
+   public:
+      SharedMemory( void );
+      ~SharedMemory( void );
+
+      bool create( const std::string& name, size_t size );
+      // creates (or replaces) the object name with the given size and maps
+      // it read-write; returns false on failure
+
+      bool open( const std::string& name );
+      // maps an existing object read-only; returns false on failure
+
+      void close( void );
+      // releases the mapping (and removes the object if it was created here)
+
+      char* data( void ) const;
+      // returns pointer to the first byte of the object
+
+      size_t size( void ) const;
+      // returns object size in bytes
+
+      const std::string& name( void ) const;
+      // returns the name of the object
+
+   protected:
+      SharedMemory( const SharedMemory& );
+      SharedMemory& operator=( const SharedMemory& );
+      // mappings are not copyable
+
+      bool map( int fd, size_t size, bool writable );
+      // maps size bytes of fd and closes it
+
+      char* start; // first mapped byte
+      size_t length; // number of mapped bytes
+      std::string objectName; // name as passed to create() or open()
+      bool owner; // whether close() should unlink the object
+};
+
+#endif
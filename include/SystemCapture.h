@@ -0,0 +1,99 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SystemCapture.h
+//
+// SystemCapture saves every linear system that LinearSolver hands to CG --
+// the real matrix (E for the eigenvalue problem, L for the Poisson problem),
+// the right-hand side, the initial guess and the solution CG returned -- so
+// that solver work can be tuned offline with tools/replay.cpp instead of
+// rerunning assembly.  Standard usage might look something like
+//
+//    SystemCapture::enable( "systems", false );
+//    mesh.updateDeformation(); // writes systems/0000-eigen_cg.sys, ...
+//
+//    CapturedSystem<float> system;
+//    if( system.read( "systems/0000-eigen_cg.sys" )) ...
+//
+// Each .sys file starts with a CapturedSystemHeader, followed by these
+// arrays:
+//
+//    int rowStart[rows+1]        first entry of each row (CSR)
+//    int columns[entries]        column of each entry, sorted within a row
+//    T   values[entries]
+//    T   rhs[rows], guess[rows], solution[rows]
+//
+// where T is float or double as recorded in the header.  Optionally, the
+// matrix and vectors are also written in Matrix Market format (.A.mtx,
+// .b.mtx, .x0.mtx, .x.mtx next to the .sys file).
+//
+
+#ifndef SPINXFORM_SYSTEMCAPTURE_H
+#define SPINXFORM_SYSTEMCAPTURE_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class CapturedSystemHeader
+// header of a captured system file
+{
+   public:
+      char magic[8];              // "SPXSYSTM"
+      unsigned int version;       // format version
+      unsigned int scalarSize;    // size in bytes of the stored scalar type
+      unsigned long long rows;    // number of rows (and columns)
+      unsigned long long entries; // number of stored entries
+      unsigned int initialGuess;  // whether the captured solve started from guess
+      int iterations;             // CG iterations of the captured solve
+      double residual;            // final residual norm of the captured solve
+      char name[64];              // name of the solve (e.g., "eigen cg")
+};
+
+template <class T>
+class CapturedSystem
+{
+   public:
+      CapturedSystem( void );
+
+      bool write( const string& filename ) const;
+      // saves the system in the binary format; returns false on failure
+
+      bool read( const string& filename );
+      // loads a system saved by write() (in either precision, converting
+      // to T); returns false if the file is missing or malformed
+
+      bool writeMatrixMarket( const string& prefix ) const;
+      // saves the matrix and vectors as prefix.A.mtx, prefix.b.mtx,
+      // prefix.x0.mtx and prefix.x.mtx; returns false on failure
+
+      string name;
+      bool initialGuess;
+      int iterations;
+      double residual;
+
+      vector<int> rowStart, columns;
+      vector<T> values;
+      vector<T> rhs, guess, solution;
+};
+
+class SystemCapture
+{
+   public:
+      static void enable( const string& directory, bool matrixMarket );
+      // starts capturing systems into directory (which must exist), also
+      // in Matrix Market format if matrixMarket is set
+
+      static bool enabled( void );
+      // returns whether systems are being captured
+
+      static bool matrixMarket( void );
+      // returns whether Matrix Market files are written too
+
+      static string nextPrefix( const string& name );
+      // returns the path, without extension, of the next capture of a solve
+      // called name, e.g., "systems/0003-poisson_cg"; safe to call from
+      // concurrent solves
+};
+
+#endif
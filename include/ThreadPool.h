@@ -0,0 +1,80 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- ThreadPool.h
+//
+// ThreadPool runs independent tasks on a fixed set of worker threads.
+// Standard usage might look something like
+//
+//    ThreadPool pool( 8 );
+//    for( int i = 0; i < nJobs; i++ )
+//    {
+//       pool.submit( [=]{ runJob( i ); } );
+//    }
+//    pool.wait();
+//
+// Each worker has its own queue: tasks submitted from outside the pool are
+// dealt round-robin, tasks submitted by a worker go to its own queue, and
+// a worker whose queue runs dry steals the oldest task from another queue.
+//
+
+#ifndef SPINXFORM_THREADPOOL_H
+#define SPINXFORM_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+   public:
+      ThreadPool( int nThreads = 0 );
+      // starts nThreads workers (0: one per hardware thread)
+
+      ~ThreadPool( void );
+      // finishes all submitted tasks and stops the workers
+
+      void submit( const std::function<void()>& task );
+      // schedules task to be run by some worker
+
+      void wait( void );
+      // blocks until every submitted task has finished
+
+      int size( void ) const;
+      // returns the number of workers
+
+   protected:
+      ThreadPool( const ThreadPool& );
+      ThreadPool& operator=( const ThreadPool& );
+      // pools are not copyable
+
+      class Queue
+      {
+         public:
+            std::mutex mutex;
+            std::deque< std::function<void()> > tasks;
+      };
+
+      void work( int index );
+      // main loop of worker index
+
+      bool take( int index, std::function<void()>& task );
+      // pops from the back of the worker's own queue or, failing that,
+      // steals from the front of another queue; returns false if all
+      // queues are empty
+
+      std::vector<std::thread> workers;
+      std::vector<Queue> queues; // one per worker
+
+      std::mutex mutex; // guards the counters below
+      std::condition_variable wake; // signaled when a task is queued
+      std::condition_variable idle; // signaled when pending drops to zero
+      size_t queued; // tasks sitting in some queue
+      size_t pending; // tasks submitted but not yet finished
+      size_t next; // queue receiving the next outside submission
+      bool stopping;
+};
+
+#endif
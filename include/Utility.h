@@ -16,6 +16,11 @@
 #define SPINXFORM_UTILITY_H
 
 #include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
 
 inline float sqr( float x )
 {
@@ -58,4 +63,242 @@ inline void swapShort( short& x )
        (( x & 0xFF00 ) >> 8 ) ;
 }
 
+inline unsigned long long hashBytes( const char* data, size_t n )
+// returns a 64-bit content hash of n bytes (FNV-1a applied to 8-byte words,
+// with an extra shift to fold the high bits back in); not cryptographic
+{
+   const unsigned long long prime = 1099511628211ULL;
+   unsigned long long h = 14695981039346656037ULL ^ n;
+
+   size_t i = 0;
+   for( ; i+8 <= n; i += 8 )
+   {
+      unsigned long long word;
+      memcpy( &word, data+i, 8 );
+      h = ( h ^ word ) * prime;
+      h ^= h >> 32;
+   }
+   for( ; i < n; i++ )
+   {
+      h = ( h ^ (unsigned char) data[i] ) * prime;
+   }
+
+   return h;
+}
+
+// TEXT PARSING ----------------------------------------------------------------
+// The routines below parse numbers straight out of a character buffer without
+// going through streams or the C locale.  Each takes the current position p
+// and the end of the buffer, and returns the position just past the parsed
+// token -- or p itself if nothing could be parsed.
+
+inline bool isBlank( char c )
+{
+   return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks( const char* p, const char* end )
+// advances p past spaces and tabs (but not past the end of the line)
+{
+   while( p != end && isBlank( *p ))
+   {
+      p++;
+   }
+   return p;
+}
+
+inline const char* skipLine( const char* p, const char* end )
+// advances p to the first character of the next line
+{
+   const char* q = (const char*) memchr( p, '\n', end-p );
+   return q == NULL ? end : q+1;
+}
+
+inline const char* parseInt( const char* p, const char* end, int& value )
+// parses an optionally signed decimal integer; values outside the range of
+// int are not parsed
+{
+   const char* q = p;
+   bool negative = false;
+   if( q != end && ( *q == '-' || *q == '+' ))
+   {
+      negative = ( *q == '-' );
+      q++;
+   }
+
+   const char* digits = q;
+   const long long limit = negative ? -(long long) INT_MIN : INT_MAX;
+   long long n = 0;
+   while( q != end && (unsigned) ( *q - '0' ) < 10 )
+   {
+      n = n*10 + ( *q - '0' );
+      if( n > limit )
+      {
+         return p;
+      }
+      q++;
+   }
+   if( q == digits )
+   {
+      return p;
+   }
+
+   value = (int) ( negative ? -n : n );
+   return q;
+}
+
+template <class T>
+inline const char* parseReal( const char* p, const char* end, T& value )
+// parses a decimal floating-point number such as -1.25e-3; if the mantissa
+// and the power of ten are both exact in T (up to 2^53 and 1e22 for double,
+// 2^24 and 1e10 for float), the number is converted with a single correctly
+// rounded multiplication or division in T (Clinger's fast path); anything
+// else (long mantissas, large exponents, inf, nan) falls back to strtod or
+// strtof, so the result is always the nearest value of T
+{
+   static const double powersOfTen[] =
+   {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+   };
+
+   const char* q = p;
+   bool negative = false;
+   if( q != end && ( *q == '-' || *q == '+' ))
+   {
+      negative = ( *q == '-' );
+      q++;
+   }
+
+   unsigned long long mantissa = 0;
+   int significant = 0;     // significant digits accumulated into mantissa
+   int exponent = 0;        // decimal exponent applied to mantissa
+   int digits = 0;          // all digits seen
+   bool truncated = false;  // more than 19 significant digits, or an
+                            // exponent too large for an int
+
+   // integer part
+   for( ; q != end && (unsigned) ( *q - '0' ) < 10; q++, digits++ )
+   {
+      if( significant == 19 )
+      {
+         truncated = true;
+         continue;
+      }
+      mantissa = mantissa*10 + ( *q - '0' );
+      if( mantissa != 0 ) significant++;
+   }
+
+   // fractional part
+   if( q != end && *q == '.' )
+   {
+      for( q++; q != end && (unsigned) ( *q - '0' ) < 10; q++, digits++ )
+      {
+         if( significant == 19 )
+         {
+            truncated = true;
+            continue;
+         }
+         mantissa = mantissa*10 + ( *q - '0' );
+         if( mantissa != 0 ) significant++;
+         exponent--;
+      }
+   }
+
+   // exponent part
+   if( q != end && ( *q == 'e' || *q == 'E' ))
+   {
+      int e = 0;
+      const char* r = parseInt( q+1, end, e );
+      const char* s = q+1;
+      if( s != end && ( *s == '-' || *s == '+' )) s++;
+      if( r != q+1 )
+      {
+         exponent = (int) std::max( -100000LL, std::min( 100000LL, (long long) exponent + e ));
+         q = r;
+      }
+      else if( s != end && (unsigned) ( *s - '0' ) < 10 )
+      {
+         truncated = true;
+      }
+   }
+
+   // rounding a double result to float again could be off by one unit in
+   // the last place, so floats are computed in float
+   const bool single = sizeof(T) == sizeof(float);
+   const unsigned long long exactMantissa = 1ULL << ( single ? 24 : 53 );
+   const int exactExponent = single ? 10 : 22;
+   if( digits == 0 || truncated || mantissa > exactMantissa ||
+       exponent < -exactExponent || exponent > exactExponent )
+   {
+      // slow path: copy the token and let the C library sort it out
+      char buffer[64];
+      size_t n = 0;
+      while( p+n != end && n < sizeof(buffer)-1 && !isBlank( p[n] ) && p[n] != '\n' && p[n] != '/' )
+      {
+         buffer[n] = p[n];
+         n++;
+      }
+      buffer[n] = '\0';
+
+      char* stop;
+      T x = single ? (T) strtof( buffer, &stop ) : (T) strtod( buffer, &stop );
+      if( stop == buffer )
+      {
+         return p;
+      }
+
+      value = x;
+      return p + ( stop - buffer );
+   }
+
+   // both operands are exact in T (1e10 and below are exact in float)
+   T x = (T) mantissa;
+   if( exponent < 0 ) x /= (T) powersOfTen[ -exponent ];
+   else               x *= (T) powersOfTen[  exponent ];
+
+   value = negative ? -x : x;
+   return q;
+}
+
+
+// TEXT FORMATTING -------------------------------------------------------------
+// The routines below write numbers into a character buffer without going
+// through streams or the C locale.  Each takes the position p to write to and
+// returns the position just past the last character written; the caller must
+// provide enough room (maxFormattedLength bytes per number is always enough).
+
+static const size_t maxFormattedLength = 32;
+
+inline char* formatInt( char* p, int value )
+// writes a decimal integer
+{
+   return std::to_chars( p, p + maxFormattedLength, value ).ptr;
+}
+
+template <class T>
+inline char* formatReal( char* p, T value )
+// writes the shortest decimal representation that reads back as exactly the
+// same value of type T
+{
+   return std::to_chars( p, p + maxFormattedLength, value ).ptr;
+}
+
+template <class T>
+inline char* storeLittleEndian( char* p, T value )
+// writes the bytes of value in little-endian order
+{
+   memcpy( p, &value, sizeof(T) );
+   if( bigEndian() )
+   {
+      for( size_t i = 0; i < sizeof(T)/2; i++ )
+      {
+         char c = p[i];
+         p[i] = p[sizeof(T)-1-i];
+         p[sizeof(T)-1-i] = c;
+      }
+   }
+   return p + sizeof(T);
+}
+
 #endif
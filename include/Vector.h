@@ -9,7 +9,9 @@
 // Keenan Crane
 // August 16, 2011
 //
-// Vector represents a three-dimensional point or vector.
+// Vector represents a three-dimensional point or vector.  The component type
+// T is either float or double; the shorthands Vectorf and Vectord name the two
+// instantiations that are built.
 //
 
 #ifndef SPINXFORM_VECTOR_H
@@ -17,48 +19,56 @@
 
 #include <ostream>
 
+template <class T>
 class Vector
 {
    public:
+      typedef T ValueType; // component type
+
       // CONSTRUCTORS ----------------------------------------------------------
       Vector( void );                        // initializes all components to zero
-      Vector( float x, float y, float z); // initializes with specified components
+      Vector( T x, T y, T z );               // initializes with specified components
       Vector( const Vector& v );             // initializes from existing vector
 
       // ACCESSORS -------------------------------------------------------------
-            float& operator[] ( int index );       // returns reference to the specified component (0-based indexing: x, y, z )
-      const float& operator[] ( int index ) const; // returns const reference to the specified component (0-based indexing: x, y, z )
+            T& operator[] ( int index );       // returns reference to the specified component (0-based indexing: x, y, z )
+      const T& operator[] ( int index ) const; // returns const reference to the specified component (0-based indexing: x, y, z )
 
       // VECTOR SPACE OPERATIONS -----------------------------------------------
       Vector operator+  ( const Vector& v ) const; // addition
       Vector operator-  ( const Vector& v ) const; // subtraction
       Vector operator-  ( void ) const;            // negation
-      Vector operator*  ( const float& c ) const; // scalar multiplication
-      Vector operator/  ( const float& c ) const; // scalar division
+      Vector operator*  ( const T& c ) const;      // scalar multiplication
+      Vector operator/  ( const T& c ) const;      // scalar division
       void   operator+= ( const Vector& v );       // addition / assignment
       void   operator-= ( const Vector& v );       // subtraction / assignment
-      void   operator*= ( const float& c );       // scalar multiplication / assignment
-      void   operator/= ( const float& c );       // scalar division / assignment
+      void   operator*= ( const T& c );            // scalar multiplication / assignment
+      void   operator/= ( const T& c );            // scalar division / assignment
 
       // ALGEBRAIC OPERATIONS --------------------------------------------------
-      float operator*  ( const Vector& v ) const; // dot product
+      T      operator*  ( const Vector& v ) const; // dot product
       Vector operator^  ( const Vector& v ) const; // cross product
       
       // NORMS -----------------------------------------------------------------
-      float norm( void ) const;  // returns Euclidean length
-      float norm2( void ) const; // returns Euclidean length squared
+      T norm( void ) const;       // returns Euclidean length
+      T norm2( void ) const;      // returns Euclidean length squared
       Vector unit( void ) const;  // returns unit vector
       void normalize( void );     // divides by Euclidean length
 
       // STORAGE ---------------------------------------------------------------
-      float x, y, z; // components
+      T x, y, z; // components
 };
 
 // VECTOR SPACE OPERATIONS -----------------------------------------------
-Vector operator*( const float& c, const Vector& v ); // scalar multiplication
+template <class T>
+Vector<T> operator*( const typename Vector<T>::ValueType& c, const Vector<T>& v ); // scalar multiplication
 
 // I/O -------------------------------------------------------------------------
-std::ostream& operator<<( std::ostream& os, const Vector& o ); // prints components
+template <class T>
+std::ostream& operator<<( std::ostream& os, const Vector<T>& o ); // prints components
+
+typedef Vector<float>  Vectorf;
+typedef Vector<double> Vectord;
 
 #endif
 
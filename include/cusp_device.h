@@ -9,12 +9,86 @@
 
 //#pragma once
 
-#include <cusp/coo_matrix.h>
+#include <cusp/csr_matrix.h>
+
+template <class T> class SellMatrix;
+
+// outcome of a solve, as reported by the CG monitor
+class SolverStatistics
+{
+   public:
+      int iterations;
+      double residual; // norm of the final residual
+      bool converged;
+      double start, seconds; // when CG started (Profiler::now()) and its duration
+      double spmvBytes; // matrix and vector bytes one SpMV reads and writes
+};
     
-// function prototype
-void solve_on_device(cusp::coo_matrix<int, float, cusp::host_memory>& coo_host, 
-                     cusp::array1d<float, cusp::host_memory>&         rhs_host,
-                     cusp::array1d<float, cusp::host_memory>&         result_host);
+// how to run a solve; the defaults are what the deformation pipeline uses
+class SolverOptions
+{
+   public:
+      enum Backend
+      {
+         device, // CUSP on the GPU
+         host,   // CUSP on the CPU (host_memory)
+         sell    // CUSP's CG on the CPU with the SIMD SpMV of SellMatrix
+      };
+
+      enum Preconditioner
+      {
+         identity,
+         diagonal,   // Jacobi
+         ainv,       // scaled Bridson approximate inverse
+         aggregation // smoothed aggregation AMG
+      };
+
+      enum Method
+      {
+         standard,  // cusp::krylov::cg
+         fused,     // Chronopoulos-Gear CG, one reduction per iteration
+         pipelined  // Ghysels-Vanroose CG, reduction fused with the update
+      };
+
+      SolverOptions( void )
+      : backend( device ),
+        preconditioner( identity ),
+        method( standard ),
+        tolerance( 1e-2 ),
+        maxIterations( 100 ),
+        compressIndices( false )
+      {}
+
+      Backend backend;
+      Preconditioner preconditioner;
+      Method method; // fused and pipelined apply to the host and sell
+                     // backends; the device backend always runs standard
+      double tolerance; // relative to the norm of the right-hand side
+      int maxIterations;
+      bool compressIndices; // store the matrix's column indices as 16-bit
+                            // differences within each row where they fit
+};
+    
+// function prototypes (instantiated for float and double in cusp_device.cu)
+
+// solves csr_host * result_host = rhs_host with CG, starting from result_host;
+// if symmetric is set, csr_host holds only the upper triangle of a symmetric
+// matrix (see QuaternionMatrix::setSymmetric()) and CG applies both halves;
+// the sell backend multiplies by sell, csr_host in SELL-C-sigma format (see
+// QuaternionMatrix::toSellFormat()), if given, instead of converting csr_host
+template <class ValueType>
+SolverStatistics solve_on_device(const cusp::csr_matrix<int, ValueType, cusp::host_memory>& csr_host, 
+                     cusp::array1d<ValueType, cusp::host_memory>&         rhs_host,
+                     cusp::array1d<ValueType, cusp::host_memory>&         result_host,
+                     const SolverOptions& options = SolverOptions(),
+                     bool symmetric = false,
+                     const SellMatrix<ValueType>* sell = 0);
+
+// fills full with the symmetric matrix whose upper triangle is upper (both
+// with columns sorted within each row)
+template <class ValueType>
+void expand_symmetric(const cusp::csr_matrix<int, ValueType, cusp::host_memory>& upper,
+                            cusp::csr_matrix<int, ValueType, cusp::host_memory>& full);
 
 
 #endif	/* CUSP_DEVICE_H */
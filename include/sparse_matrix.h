@@ -9,6 +9,8 @@
 //    - Routines have been added for saving the sparse matrix in CUSP's COO format
 //    - Fixed version of SparseMatrix and routines related to a different solver 
 //      have been trimmed
+//    - Column indices have the type IndexType (32-bit by default, as in
+//      QuaternionMatrix) rather than size_t
 
 
 #ifndef SPARSE_MATRIX_H
@@ -23,13 +25,13 @@
 //============================================================================
 // Dynamic compressed sparse row matrix.
 
-template<class T>
+template<class T, class IndexType = int>
 struct SparseMatrix
 {
    size_t n; // dimension
    
    // for each row (with non-zero values), a list of all column indices (sorted)                          
-   std::vector< std::vector<size_t> > index;
+   std::vector< std::vector<IndexType> > index;
    std::vector< std::vector<T> >      value; // values corresponding to index
    
    explicit SparseMatrix(size_t n_=0, size_t expected_nonzeros_per_row=7)
@@ -63,7 +65,7 @@ struct SparseMatrix
       value.resize(n);
    }
 
-   T operator()(size_t i, size_t j) const
+   T operator()(size_t i, IndexType j) const
    {
       for(size_t k=0; k<index[i].size(); ++k){
          if(index[i][k]==j) return value[i][k];
@@ -72,7 +74,7 @@ struct SparseMatrix
       return 0;
    }
    
-   void set_element(size_t i, size_t j, T new_value)
+   void set_element(size_t i, IndexType j, T new_value)
    {
       size_t k=0;
       for(; k<index[i].size(); ++k){
@@ -89,7 +91,7 @@ struct SparseMatrix
       value[i].push_back(new_value);
    }
 
-   void add_to_element(size_t i, size_t j, T increment_value)
+   void add_to_element(size_t i, IndexType j, T increment_value)
    {
       size_t k=0;
       for(; k<index[i].size(); ++k){
@@ -107,7 +109,7 @@ struct SparseMatrix
    }
 
    // assumes indices is already sorted (handy for cusp::coo conversion)
-   void add_sparse_row(size_t i, const std::vector<size_t> &indices, const std::vector<T> &values)
+   void add_sparse_row(size_t i, const std::vector<IndexType> &indices, const std::vector<T> &values)
    {
       size_t j=0, k=0;
       while(j<indices.size() && k<index[i].size()){
@@ -133,9 +135,9 @@ struct SparseMatrix
    void symmetric_remove_row_and_column(size_t i)
    {
       for(size_t a=0; a<index[i].size(); ++a){
-         size_t j=index[i][a]; // 
+         IndexType j=index[i][a]; // 
          for(size_t b=0; b<index[j].size(); ++b){
-            if(index[j][b]==i){
+            if(index[j][b]==(IndexType)i){
                erase(index[j], b);
                erase(value[j], b);
                break;
@@ -190,7 +192,7 @@ struct SparseMatrix
    
    // store column indices in a 2D vector (each column index corresponds 
    // to the row indices computed in the coo_format_rows)
-   std::vector< std::vector<size_t> > coo_format_columns( std::vector<int>& column_indices ) {
+   std::vector< std::vector<IndexType> > coo_format_columns( std::vector<int>& column_indices ) {
         
       ///*  
       // compute size of each row (num of nnz elements) and then the one with max size
@@ -206,11 +208,11 @@ struct SparseMatrix
       max_elements_per_row = *std::max_element( row_size.begin(), row_size.end() );
       //*/
        
-      std::vector< std::vector<size_t> > myvec( n, std::vector<size_t>( max_elements_per_row ) );   
+      std::vector< std::vector<IndexType> > myvec( n, std::vector<IndexType>( max_elements_per_row ) );   
       
       for( size_t i = 0; i < n; ++i ){
          
-         std::vector<size_t> row;
+         std::vector<IndexType> row;
          for( size_t j = 0; j < index[i].size(); ++j ){
              
             row.push_back( index[i][j] );
@@ -224,7 +226,7 @@ struct SparseMatrix
    
    // COO values -------------------------------------------------------------
 
-   std::vector< std::vector<float> > coo_format_values( std::vector<float>& values ) {
+   std::vector< std::vector<T> > coo_format_values( std::vector<T>& values ) {
          
       ///*  
       // compute size of each row (num of nnz elements) and then the one with max size 
@@ -239,11 +241,11 @@ struct SparseMatrix
       max_elements_per_row = *std::max_element( row_size.begin(), row_size.end() );
       //*/ 
        
-      std::vector< std::vector< float > > myvec( n, std::vector<float>( max_elements_per_row ) );
+      std::vector< std::vector< T > > myvec( n, std::vector<T>( max_elements_per_row ) );
          
       for( size_t i = 0; i < n; ++i ){
 
-         std::vector< float > row; 
+         std::vector< T > row; 
          for( size_t j=0; j<value[i].size(); ++j ){
              
             row.push_back( value[i][j] );
@@ -257,7 +259,8 @@ struct SparseMatrix
     
 };    
     
-typedef SparseMatrix<float> SparseMatrixf;
+typedef SparseMatrix<float>  SparseMatrixf;
+typedef SparseMatrix<double> SparseMatrixd;
 
 #endif
 
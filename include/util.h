@@ -12,6 +12,7 @@
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <climits>
 
 #ifndef M_PI
 const double M_PI = 3.1415926535897932384626433832795;
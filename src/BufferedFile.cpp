@@ -0,0 +1,102 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- BufferedFile.cpp
+//
+
+#include "BufferedFile.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+BufferedFile :: BufferedFile( size_t capacity )
+: fd( -1 ),
+  failed( false ),
+  buffer( capacity ),
+  used( 0 )
+{}
+
+BufferedFile :: ~BufferedFile( void )
+{
+   close();
+}
+
+bool BufferedFile :: open( const std::string& filename )
+// creates (or truncates) the file; returns false on failure
+{
+   close();
+
+   fd = ::open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+   failed = ( fd < 0 );
+   used = 0;
+
+   return !failed;
+}
+
+bool BufferedFile :: close( void )
+// flushes the buffer and closes the file; returns false if any write failed
+{
+   if( fd < 0 )
+   {
+      return !failed;
+   }
+
+   flush();
+   if( ::close( fd ) != 0 )
+   {
+      failed = true;
+   }
+   fd = -1;
+
+   return !failed;
+}
+
+char* BufferedFile :: reserve( size_t n )
+// returns a pointer to at least n writable bytes at the end of the buffer
+{
+   if( used + n > buffer.size() )
+   {
+      flush();
+      if( n > buffer.size() )
+      {
+         buffer.resize( n );
+      }
+   }
+
+   return &buffer[0] + used;
+}
+
+void BufferedFile :: commit( char* end )
+// marks the bytes up to end (obtained from reserve()) as written
+{
+   used = end - &buffer[0];
+}
+
+void BufferedFile :: write( const void* data, size_t n )
+// appends n raw bytes
+{
+   char* p = reserve( n );
+   memcpy( p, data, n );
+   commit( p + n );
+}
+
+void BufferedFile :: flush( void )
+// passes the buffered bytes to the operating system
+{
+   const char* p = &buffer[0];
+   size_t remaining = used;
+   used = 0;
+
+   while( remaining > 0 && fd >= 0 && !failed )
+   {
+      ssize_t written = ::write( fd, p, remaining );
+      if( written < 0 )
+      {
+         if( errno == EINTR ) continue;
+         failed = true;
+         break;
+      }
+      p += written;
+      remaining -= written;
+   }
+}
@@ -13,33 +13,131 @@
 #include "EigenSolver.h"
 #include "LinearSolver.h"
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
-void EigenSolver :: solve( QuaternionMatrix& A,
-                           vector<Quaternion>& x )
+template <class T>
+T EigenSolver<T> :: solve( QuaternionMatrix<T>& A,
+                           vector< Quaternion<T> >& x,
+                           bool warmStart,
+                           T tolerance,
+                           int iterations,
+                           const SolverOptions& options,
+                           T innerFactor )
 // solves the eigenvalue problem Ax = cx for the
 // eigenvector x with the smallest eigenvalue c
 {
-   // set the initial guess to the identity
-   vector<Quaternion> b( x.size(), 1. );
+   // set the initial guess to the identity (or to the previous eigenvector)
+   vector< Quaternion<T> > b( x.size(), 1. );
+   if( warmStart )
+   {
+      b = x;
+   }
+
+   // the CG tolerance only depends on the eigen-residual if innerFactor
+   // times the largest possible residual (1) is above the lower clamp
+   bool adaptive = innerFactor > options.tolerance / 100;
 
    // perform a fixed number of inverse power iterations
-   const int nIter = 3;
-   for( int i = 0; i != nIter; i++ )
+   SolverOptions inner( options );
+   for( int i = 0; i < iterations; i++ )
    {
       normalize( b );
-      LinearSolver::solve( A, x, b, false );
+
+      // the Rayleigh quotient costs a multiply with A, so it is computed
+      // only where it is used -- not for the first iterate of a cold
+      // start, whose residual is taken to be the upper bound 1
+      T c = 0., residual = 1., cosine = 0.;
+      if( warmStart || ( adaptive && i > 0 ))
+      {
+         c = rayleighQuotient( A, b, &residual, &cosine );
+      }
+
+      if( warmStart && residual <= tolerance )
+      {
+         break;
+      }
+
+      if( innerFactor > 0. )
+      {
+         inner.tolerance = innerTolerance( residual, innerFactor, options );
+      }
+
+      // b/c would solve Ab = b if b were an eigenvector, but is useless
+      // (or not even finite) if c is negligible next to |Ab|; CG then
+      // starts from zero, as on a cold start
+      bool guess = warmStart && cosine > numeric_limits<T>::epsilon();
+      if( guess )
+      {
+         for( size_t k = 0; k != x.size(); k++ )
+         {
+            x[k] = b[k] / c;
+         }
+      }
+
+      LinearSolver<T>::solve( A, x, b, false, guess, "eigen cg", inner );
       b = x;
    }
 
-   // normalize the final solution
+   x = b;
    normalize( x );
+
+   return rayleighQuotient( A, x );
+}
+
+template <class T>
+T EigenSolver<T> :: rayleighQuotient( const QuaternionMatrix<T>& A,
+                                      const vector< Quaternion<T> >& x,
+                                      T* residual,
+                                      T* cosine )
+// returns (x'*A*x)/(x'*x), treating x as a real vector; also stores the
+// relative residual |Ax-cx|/|Ax| in *residual and the cosine of the
+// angle between x and Ax in *cosine if they are given
+{
+   vector< Quaternion<T> > Ax;
+   A.multiply( x, Ax );
+
+   T xAx = 0., xx = 0.;
+   for( size_t i = 0; i != x.size(); i++ )
+   {
+      xAx += x[i].re()*Ax[i].re() + x[i].im()*Ax[i].im();
+      xx  += x[i].norm2();
+   }
+   T c = xAx / xx;
+
+   if( residual != NULL || cosine != NULL )
+   {
+      T rr = 0., AxAx = 0.;
+      for( size_t i = 0; i != x.size(); i++ )
+      {
+         rr   += ( Ax[i] - c*x[i] ).norm2();
+         AxAx += Ax[i].norm2();
+      }
+      if( residual != NULL ) *residual = sqrt( rr / AxAx );
+      if( cosine != NULL ) *cosine = xAx / sqrt( xx * AxAx );
+   }
+
+   return c;
+}
+
+template <class T>
+T EigenSolver<T> :: innerTolerance( T residual, T innerFactor, const SolverOptions& options )
+// returns the CG tolerance for an inverse iteration whose current relative
+// eigen-residual is residual: innerFactor times the residual, kept within
+// a factor of 100 below and 10 above the nominal options.tolerance so
+// that neither a poor start nor a converged one makes CG useless or
+// endless
+{
+   T nominal = options.tolerance;
+   return max( nominal / 100, min( nominal * 10, innerFactor * residual ));
 }
 
-void EigenSolver :: normalize( vector<Quaternion>& x )
+template <class T>
+void EigenSolver<T> :: normalize( vector< Quaternion<T> >& x )
 // rescales x to have unit length
 {
    // compute length
-   float norm = 0.;
+   T norm = 0.;
    for( size_t i = 0; i != x.size(); i++ )
    {
       norm += x[i].norm2();
@@ -53,3 +151,5 @@ void EigenSolver :: normalize( vector<Quaternion>& x )
    }
 }
 
+template class EigenSolver<float>;
+template class EigenSolver<double>;
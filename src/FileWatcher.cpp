@@ -0,0 +1,129 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- FileWatcher.cpp
+//
+
+#include "FileWatcher.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+
+FileWatcher :: FileWatcher( void )
+{
+   fd = inotify_init1( IN_CLOEXEC );
+}
+
+FileWatcher :: ~FileWatcher( void )
+{
+   if( fd >= 0 )
+   {
+      close( fd );
+   }
+}
+
+bool FileWatcher :: add( const string& filename )
+// starts watching filename; returns false on failure
+{
+   if( fd < 0 )
+   {
+      return false;
+   }
+
+   Entry entry;
+   string directory;
+   size_t slash = filename.rfind( '/' );
+   if( slash == string::npos )
+   {
+      directory = ".";
+      entry.name = filename;
+   }
+   else
+   {
+      directory = slash == 0 ? "/" : filename.substr( 0, slash );
+      entry.name = filename.substr( slash+1 );
+   }
+   entry.path = filename;
+
+   // editors either rewrite a file in place (close after write) or write a
+   // temporary file and rename it over the original (moved to)
+   entry.directory = inotify_add_watch( fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+   if( entry.directory < 0 )
+   {
+      return false;
+   }
+
+   entries.push_back( entry );
+   return true;
+}
+
+vector<string> FileWatcher :: wait( int settleMilliseconds )
+// blocks until at least one watched file has been rewritten and returns
+// the names of all changed files
+{
+   vector<string> changed;
+   if( fd < 0 || entries.empty() )
+   {
+      return changed;
+   }
+
+   while( changed.empty() )
+   {
+      read( -1, changed );
+   }
+
+   while( read( settleMilliseconds, changed ) )
+   {
+      // keep collecting until the burst of events settles
+   }
+
+   return changed;
+}
+
+bool FileWatcher :: read( int timeoutMilliseconds, vector<string>& changed )
+// waits up to timeoutMilliseconds (-1 for no limit) for events and appends
+// changed files; returns false on timeout
+{
+   struct pollfd p;
+   p.fd = fd;
+   p.events = POLLIN;
+   p.revents = 0;
+
+   int ready = poll( &p, 1, timeoutMilliseconds );
+   if( ready <= 0 )
+   {
+      return ready < 0 && errno == EINTR;
+   }
+
+   // events are variable-length records; align the buffer for the header
+   char buffer[ 64*1024 ] __attribute__(( aligned( __alignof__( struct inotify_event ))));
+   ssize_t length = ::read( fd, buffer, sizeof(buffer) );
+   if( length <= 0 )
+   {
+      return false;
+   }
+
+   for( char* q = buffer; q < buffer + length; )
+   {
+      const struct inotify_event* event = (const struct inotify_event*) q;
+      q += sizeof(struct inotify_event) + event->len;
+
+      if( event->len == 0 ) continue;
+      string name( event->name );
+
+      for( size_t i = 0; i < entries.size(); i++ )
+      {
+         if( entries[i].directory == event->wd &&
+             entries[i].name == name &&
+             find( changed.begin(), changed.end(), entries[i].path ) == changed.end() )
+         {
+            changed.push_back( entries[i].path );
+         }
+      }
+   }
+
+   return true;
+}
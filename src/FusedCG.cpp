@@ -0,0 +1,98 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- FusedCG.cpp
+//
+
+#include "FusedCG.h"
+
+template <class T>
+void FusedCG<T> :: dots( int size, const T* r, const T* u, const T* w,
+                         double& gamma, double& delta, double& rr )
+// computes gamma = <r,u>, delta = <w,u> and rr = <r,r> in one sweep
+{
+   double g = 0., d = 0., e = 0.;
+
+   #pragma omp parallel for reduction(+:g,d,e)
+   for( int i = 0; i < size; i++ )
+   {
+      g += (double) r[i] * u[i];
+      d += (double) w[i] * u[i];
+      e += (double) r[i] * r[i];
+   }
+
+   gamma = g;
+   delta = d;
+   rr = e;
+}
+
+template <class T>
+void FusedCG<T> :: update( int size, T alpha, T beta, const T* u, const T* w,
+                           T* p, T* s, T* x, T* r )
+// p = u + beta p, s = w + beta s, x += alpha p, r -= alpha s
+{
+   #pragma omp parallel for
+   for( int i = 0; i < size; i++ )
+   {
+      // u[i] is read before r[i] is written, so u may be r
+      p[i] = u[i] + beta * p[i];
+      s[i] = w[i] + beta * s[i];
+      x[i] += alpha * p[i];
+      r[i] -= alpha * s[i];
+   }
+}
+
+template <class T>
+void FusedCG<T> :: pipelinedUpdate( int size, T alpha, T beta,
+                                    const T* n, const T* m,
+                                    T* z, T* q, T* s, T* p, T* x, T* r, T* u, T* w,
+                                    bool preconditioned,
+                                    double& gamma, double& delta, double& rr )
+// Ghysels-Vanroose update followed by the next iteration's inner products
+{
+   double g = 0., d = 0., e = 0.;
+
+   if( preconditioned )
+   {
+      #pragma omp parallel for reduction(+:g,d,e)
+      for( int i = 0; i < size; i++ )
+      {
+         z[i] = n[i] + beta * z[i];
+         q[i] = m[i] + beta * q[i];
+         s[i] = w[i] + beta * s[i];
+         p[i] = u[i] + beta * p[i];
+         x[i] += alpha * p[i];
+         r[i] -= alpha * s[i];
+         u[i] -= alpha * q[i];
+         w[i] -= alpha * z[i];
+
+         g += (double) r[i] * u[i];
+         d += (double) w[i] * u[i];
+         e += (double) r[i] * r[i];
+      }
+   }
+   else
+   {
+      // u = r, m = w and q = s
+      #pragma omp parallel for reduction(+:d,e)
+      for( int i = 0; i < size; i++ )
+      {
+         z[i] = n[i] + beta * z[i];
+         s[i] = w[i] + beta * s[i];
+         p[i] = r[i] + beta * p[i];
+         x[i] += alpha * p[i];
+         r[i] -= alpha * s[i];
+         w[i] -= alpha * z[i];
+
+         d += (double) w[i] * r[i];
+         e += (double) r[i] * r[i];
+      }
+      g = e;
+   }
+
+   gamma = g;
+   delta = d;
+   rr = e;
+}
+
+template class FusedCG<float>;
+template class FusedCG<double>;
@@ -14,19 +14,29 @@
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include "Image.h"
+#include "MappedFile.h"
 #include "Utility.h"
 
-float& Image :: operator()( int x, int y )
-// accesses pixel (x,y)
-{
-   return pixels[ x + y*w ];
-}
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// number of zero bytes (or 16-bit values) kept after the last pixel of each
+// mip level, so that the vectorized sampler can fetch pixels with 32-bit gathers
+static const int pixelPadding = 4;
+
+Image :: Image( void )
+: pixels( NULL ),
+  w( 0 ),
+  h( 0 )
+{}
 
-const float& Image :: operator()( int x, int y ) const
-// accesses pixel (x,y)
+float Image :: operator()( int x, int y ) const
+// returns pixel (x,y) as a value in the range [0,1]
 {
-   return pixels[ x + y*w ];
+   return (float) pixels[ x + y*w ] * ( 1.f / 255.f );
 }
 
 float Image :: sample( float x, float y ) const
@@ -49,6 +59,143 @@ float Image :: sample( float x, float y ) const
           ay * ( bx * I(x0,y1) + ax * I(x1,y1) ) ;
 }
 
+float Image :: sample( float x, float y, float lod ) const
+// samples the average of the image over a square about 2^lod pixels
+// wide centered at (x,y), using trilinear filtering of the mip pyramid
+{
+   int top = levels() - 1;
+   if( !( lod > 0. )) return sample( x, y );
+   if( lod >= (float) top ) return sampleLevel( top, x, y );
+
+   int level = (int) floor( lod );
+   float t = lod - (float) level;
+
+   return (1.-t) * sampleLevel( level,   x, y ) +
+              t  * sampleLevel( level+1, x, y ) ;
+}
+
+float Image :: sampleLevel( int level, float x, float y ) const
+// samples mip level "level" at (x,y) in level-0 pixel coordinates
+// using bilinear filtering
+{
+   float value;
+   sampleBatch( level, 1, &x, &y, &value );
+   return value;
+}
+
+template <class P>
+static void bilinearBatch( const P* pixels, int lw, int lh, int level,
+                           int n, const float* x, const float* y, float* values )
+// samples one mip level with pixel type P (8-bit or 16-bit) at n points given
+// in level-0 pixel coordinates, using bilinear filtering
+{
+   // texel j of level l covers pixels [ j*2^l, (j+1)*2^l ) of level 0
+   const float scale = 1.f / (float) ( 1 << level );
+   const float offset = .5f * (float) ( (1 << level) - 1 );
+   const float toUnit = 1.f / (float) ( (1 << 8*sizeof(P)) - 1 );
+
+   int i = 0;
+
+#ifdef __AVX2__
+   // eight points at a time: coordinates are clamped to just outside the
+   // image before conversion to int, so that the integer clamping below
+   // reproduces the scalar path exactly; each gather fetches 32 bits and
+   // masks off all but the addressed pixel
+   const __m256 vScale  = _mm256_set1_ps( scale );
+   const __m256 vOffset = _mm256_set1_ps( offset );
+   const __m256 vLow    = _mm256_set1_ps( -1.f );
+   const __m256 vHighX  = _mm256_set1_ps( (float) lw );
+   const __m256 vHighY  = _mm256_set1_ps( (float) lh );
+   const __m256 vUnit   = _mm256_set1_ps( toUnit );
+   const __m256 vOne    = _mm256_set1_ps( 1.f );
+   const __m256i vZero  = _mm256_setzero_si256();
+   const __m256i vOneI  = _mm256_set1_epi32( 1 );
+   const __m256i vMaxX  = _mm256_set1_epi32( lw-1 );
+   const __m256i vMaxY  = _mm256_set1_epi32( lh-1 );
+   const __m256i vWidth = _mm256_set1_epi32( lw );
+   const __m256i vMask  = _mm256_set1_epi32( (1 << 8*sizeof(P)) - 1 );
+   const int* base = (const int*) pixels;
+
+   for( ; i+8 <= n; i += 8 )
+   {
+      __m256 u = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( x+i ), vOffset ), vScale );
+      __m256 v = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( y+i ), vOffset ), vScale );
+      u = _mm256_min_ps( _mm256_max_ps( u, vLow ), vHighX );
+      v = _mm256_min_ps( _mm256_max_ps( v, vLow ), vHighY );
+
+      __m256 fu = _mm256_floor_ps( u );
+      __m256 fv = _mm256_floor_ps( v );
+      __m256 au = _mm256_sub_ps( u, fu );
+      __m256 av = _mm256_sub_ps( v, fv );
+
+      __m256i iu = _mm256_cvttps_epi32( fu );
+      __m256i iv = _mm256_cvttps_epi32( fv );
+      __m256i x0 = _mm256_min_epi32( _mm256_max_epi32( iu, vZero ), vMaxX );
+      __m256i x1 = _mm256_min_epi32( _mm256_max_epi32( _mm256_add_epi32( iu, vOneI ), vZero ), vMaxX );
+      __m256i y0 = _mm256_mullo_epi32( _mm256_min_epi32( _mm256_max_epi32( iv, vZero ), vMaxY ), vWidth );
+      __m256i y1 = _mm256_mullo_epi32( _mm256_min_epi32( _mm256_max_epi32( _mm256_add_epi32( iv, vOneI ), vZero ), vMaxY ), vWidth );
+
+      __m256 p00 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_i32gather_epi32( base, _mm256_add_epi32( x0, y0 ), sizeof(P) ), vMask ));
+      __m256 p10 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_i32gather_epi32( base, _mm256_add_epi32( x1, y0 ), sizeof(P) ), vMask ));
+      __m256 p01 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_i32gather_epi32( base, _mm256_add_epi32( x0, y1 ), sizeof(P) ), vMask ));
+      __m256 p11 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_i32gather_epi32( base, _mm256_add_epi32( x1, y1 ), sizeof(P) ), vMask ));
+
+      __m256 bu = _mm256_sub_ps( vOne, au );
+      __m256 bv = _mm256_sub_ps( vOne, av );
+      __m256 top    = _mm256_add_ps( _mm256_mul_ps( bu, p00 ), _mm256_mul_ps( au, p10 ));
+      __m256 bottom = _mm256_add_ps( _mm256_mul_ps( bu, p01 ), _mm256_mul_ps( au, p11 ));
+      __m256 value  = _mm256_add_ps( _mm256_mul_ps( bv, top ), _mm256_mul_ps( av, bottom ));
+
+      _mm256_storeu_ps( values+i, _mm256_mul_ps( value, vUnit ));
+   }
+#endif
+
+   for( ; i < n; i++ )
+   {
+      float u = ( x[i] - offset ) * scale;
+      float v = ( y[i] - offset ) * scale;
+      u = min( max( u, -1.f ), (float) lw );
+      v = min( max( v, -1.f ), (float) lh );
+
+      float fu = floor( u );
+      float fv = floor( v );
+      float au = u - fu;
+      float av = v - fv;
+
+      int iu = (int) fu;
+      int iv = (int) fv;
+      int x0 = min( max( iu,   0 ), lw-1 );
+      int x1 = min( max( iu+1, 0 ), lw-1 );
+      int y0 = min( max( iv,   0 ), lh-1 ) * lw;
+      int y1 = min( max( iv+1, 0 ), lh-1 ) * lw;
+
+      float top    = (1.f-au) * (float) pixels[x0+y0] + au * (float) pixels[x1+y0];
+      float bottom = (1.f-au) * (float) pixels[x0+y1] + au * (float) pixels[x1+y1];
+
+      values[i] = ( (1.f-av) * top + av * bottom ) * toUnit;
+   }
+}
+
+void Image :: sampleBatch( int level, int n, const float* x, const float* y, float* values ) const
+// samples mip level "level" at the n points (x[i],y[i]), given in
+// level-0 pixel coordinates, using bilinear filtering
+{
+   if( level == 0 )
+   {
+      bilinearBatch( pixels, w, h, 0, n, x, y, values );
+   }
+   else
+   {
+      bilinearBatch( &pyramid[level-1][0], levelWidth[level], levelHeight[level], level, n, x, y, values );
+   }
+}
+
+int Image :: levels( void ) const
+// returns the number of levels in the mip pyramid (including the image)
+{
+   return (int) levelWidth.size();
+}
+
 int Image :: width( void ) const
 // returns image width
 {
@@ -79,33 +226,50 @@ class TGAHeader
       char  imageSpecification;
 };
 
-void Image :: read( const char* _filename )
+bool Image :: read( const char* _filename )
 // loads an image file in Truevision TGA format
-// (must be uncompressed RGB image with 24 or 32 bits per pixel)
+// (must be uncompressed grayscale image with 8 bits per pixel)
 {
    filename = string( _filename );
-   ifstream in( filename.c_str(), ios_base::binary );
 
-   if( !in.is_open() )
+   // an image that fails to load is left empty
+   w = h = 0;
+   pixels = NULL;
+   copy.clear();
+   pyramid.clear();
+   levelWidth.clear();
+   levelHeight.clear();
+
+   MappedFile file;
+   if( !file.open( filename ))
    {
       cerr << "Error: could not open file " << filename << " for input!" << endl;
-      exit( 1 );
+      return false;
+   }
+
+   const char* data = file.data();
+   size_t size = file.size();
+   const size_t headerSize = 18;
+   if( size < headerSize )
+   {
+      cerr << "Error: " << filename << " is not a TGA file." << endl;
+      return false;
    }
 
    // read header
    TGAHeader header;
-   in.read( (char*) &(header.idFieldSize),        1 );
-   in.read( (char*) &(header.colorMapType),       1 );
-   in.read( (char*) &(header.dataTypeCode),       1 );
-   in.read( (char*) &(header.colorMapOrigin),     2 );
-   in.read( (char*) &(header.colorMapLength),     2 );
-   in.read( (char*) &(header.colorMapEntrySize),  1 );
-   in.read( (char*) &(header.xOrigin),            2 );
-   in.read( (char*) &(header.yOrigin),            2 );
-   in.read( (char*) &(header.width),              2 );
-   in.read( (char*) &(header.height),             2 );
-   in.read( (char*) &(header.bitsPerPixel),       1 );
-   in.read( (char*) &(header.imageSpecification), 1 );
+   memcpy( &(header.idFieldSize),        data+0,  1 );
+   memcpy( &(header.colorMapType),       data+1,  1 );
+   memcpy( &(header.dataTypeCode),       data+2,  1 );
+   memcpy( &(header.colorMapOrigin),     data+3,  2 );
+   memcpy( &(header.colorMapLength),     data+5,  2 );
+   memcpy( &(header.colorMapEntrySize),  data+7,  1 );
+   memcpy( &(header.xOrigin),            data+8,  2 );
+   memcpy( &(header.yOrigin),            data+10, 2 );
+   memcpy( &(header.width),              data+12, 2 );
+   memcpy( &(header.height),             data+14, 2 );
+   memcpy( &(header.bitsPerPixel),       data+16, 1 );
+   memcpy( &(header.imageSpecification), data+17, 1 );
    if( bigEndian() )
    {
       swapShort( header.colorMapOrigin );
@@ -116,47 +280,104 @@ void Image :: read( const char* _filename )
       swapShort( header.height );
    }
 
-   w = header.width;
-   h = header.height;
-
    // validate data type
    const char uncompressedGrayscale = 3;
    if( header.dataTypeCode != uncompressedGrayscale ||
        header.bitsPerPixel != 8 )
    {
       cerr << "Error: input must be uncompressed grayscale image with 8 bits per pixel." << endl;
-      exit( 1 );
+      return false;
    }
 
-   // read identification field (unused)
-   vector<char> idField( header.idFieldSize );
-   in.read( &idField[0], header.idFieldSize );
-
-   // read color map data (unused)
+   // skip identification field and color map data (unused)
+   size_t offset = headerSize + (unsigned char) header.idFieldSize;
    if( header.colorMapType == 1 )
    {
       int bytesPerEntry = header.colorMapEntrySize / 8;
-      int colorMapSize = header.colorMapLength * bytesPerEntry;
-      vector<char> colorMapData( colorMapSize );
-      in.read( &colorMapData[0], colorMapSize );
+      offset += (unsigned short) header.colorMapLength * bytesPerEntry;
+   }
+
+   size_t nPixels = (size_t) (unsigned short) header.width * (size_t) (unsigned short) header.height;
+   if( offset + nPixels > size )
+   {
+      cerr << "Error: " << filename << " is truncated." << endl;
+      return false;
+   }
+   if( nPixels == 0 )
+   {
+      cerr << "Error: " << filename << " has no pixels." << endl;
+      return false;
    }
 
-   // read pixel data
-   vector<unsigned char> pixelData( w*h );
-   in.read( (char*) &pixelData[0], w*h );
+   w = (unsigned short) header.width;
+   h = (unsigned short) header.height;
 
-   // convert pixel data
-   pixels.resize( w*h );
-   for( int i = 0; i != w*h; ++i )
+   // copy the pixels out of the mapping, which is private but not a
+   // snapshot -- if the file is rewritten while it is mapped (e.g., by an
+   // editor saving over it), pages read later would come from the new file
+   // or, if it was truncated, fault; the copy also gets explicit zero
+   // padding for the padded reads of the vectorized sampler
+   copy.assign( nPixels + pixelPadding, 0 );
+   memcpy( &copy[0], data + offset, nPixels );
+   pixels = &copy[0];
+   file.close();
+
+   buildPyramid();
+   return true;
+}
+
+void Image :: buildPyramid( void )
+// builds the mip pyramid from the full-resolution pixels -- each level
+// averages 2x2 blocks of the level below (odd sizes repeat the last
+// row/column); coarser levels are stored as 16-bit fixed point so that
+// rounding errors don't accumulate across levels
+{
+   pyramid.clear();
+   levelWidth.assign( 1, w );
+   levelHeight.assign( 1, h );
+
+   int bw = w;
+   int bh = h;
+   while( bw > 1 || bh > 1 )
    {
-      pixels[i] = (float) pixelData[i] / 255.;
+      int lw = ( bw + 1 ) / 2;
+      int lh = ( bh + 1 ) / 2;
+      pyramid.push_back( vector<unsigned short>( lw*lh + pixelPadding, 0 ));
+      unsigned short* level = &pyramid.back()[0];
+      const unsigned short* B = pyramid.size() > 1 ? &pyramid[ pyramid.size()-2 ][0] : NULL;
+
+      #pragma omp parallel for
+      for( int y = 0; y < lh; y++ )
+      for( int x = 0; x < lw; x++ )
+      {
+         int x0 = 2*x, x1 = min( 2*x+1, bw-1 );
+         int y0 = 2*y, y1 = min( 2*y+1, bh-1 );
+
+         if( B == NULL )
+         {
+            // 8-bit value v is 257*v in 16-bit fixed point
+            level[ x + y*lw ] = ( 257 * ( pixels[x0+y0*bw] + pixels[x1+y0*bw] +
+                                          pixels[x0+y1*bw] + pixels[x1+y1*bw] ) + 2 ) / 4;
+         }
+         else
+         {
+            level[ x + y*lw ] = ( B[x0+y0*bw] + B[x1+y0*bw] +
+                                  B[x0+y1*bw] + B[x1+y1*bw] + 2 ) / 4;
+         }
+      }
+
+      levelWidth.push_back( lw );
+      levelHeight.push_back( lh );
+
+      bw = lw;
+      bh = lh;
    }
 }
 
-void Image :: reload( void )
+bool Image :: reload( void )
 // updates image from disk
 {
-   read( filename.c_str() );
+   return read( filename.c_str() );
 }
 
 void Image :: clamp( int& x, int& y ) const
@@ -18,6 +18,8 @@
 //
 
 #include "LinearSolver.h"
+#include "Profiler.h"
+#include "SystemCapture.h"
 #include <iostream>
 #include <cassert>
 
@@ -29,67 +31,141 @@
 
 using namespace std;
 
-void LinearSolver :: solve( QuaternionMatrix&   A,
-                            vector<Quaternion>& x,
-                            vector<Quaternion>& b,
-                            bool precondition     ) {
+template <class T>
+static void captureSystem( const cusp::csr_matrix<int, T, cusp::host_memory>& C,
+                           const cusp::array1d<T, cusp::host_memory>& rhs,
+                           const cusp::array1d<T, cusp::host_memory>& result,
+                           const SolverStatistics& stats,
+                           bool initialGuess,
+                           const char* name,
+                           CapturedSystem<T>& system )
+// saves a solved system (whose guess is already filled in) for replay
+{
+   ScopedTimer timer( "capture" );
+
+   system.rowStart.assign( C.row_offsets.begin(), C.row_offsets.end() );
+   system.columns.assign( C.column_indices.begin(), C.column_indices.end() );
+   system.values.assign( C.values.begin(), C.values.end() );
+   system.rhs.assign( rhs.begin(), rhs.end() );
+   system.solution.assign( result.begin(), result.end() );
+
+   system.name = name;
+   system.initialGuess = initialGuess;
+   system.iterations = stats.iterations;
+   system.residual = stats.residual;
+
+   string prefix = SystemCapture::nextPrefix( name );
+   if( !system.write( prefix + ".sys" ) ||
+       ( SystemCapture::matrixMarket() && !system.writeMatrixMarket( prefix )))
+   {
+      cerr << "Error: couldn't capture system to " << prefix << "!" << endl;
+   }
+}
+
+template <class T>
+void LinearSolver<T> :: solve( QuaternionMatrix<T>&   A,
+                               vector< Quaternion<T> >& x,
+                               vector< Quaternion<T> >& b,
+                               bool precondition,
+                               bool initialGuess,
+                               const char* name,
+                               const SolverOptions& options ) {
 // solves the linear system Ax = b where A is positive-semidefinite with a 
 // conjugate gradient solver from CUSP library       
       
-   typedef cusp::coo_matrix<int, float, cusp::host_memory> coo_cusp;
-        
-   // initialize C (C holds the matrix of reals in COO format) 
-   coo_cusp C(0,0,0);
+   typedef typename QuaternionMatrix<T>::csr_cusp csr_cusp;
         
-   C = A.toRealCooFormat();
-   size_t row_indices_size = C.row_indices.size();
+   // C holds the matrix of reals in CSR format; its 32-bit indices are
+   // what the solver takes, so the cached matrix is used without a copy
+   // (as is the cached SELL form the sell backend multiplies by)
+   const csr_cusp* real;
+   const SellMatrix<T>* sell = 0;
+   {
+      ScopedTimer timer( "convert" );
+      real = &A.toRealCsrFormat();
+      if( options.backend == SolverOptions::sell )
+      {
+         sell = &A.toSellFormat();
+      }
+   }
+   const csr_cusp& C = *real;
+   size_t num_rows = C.num_rows;
       
    //cusp::print(C);
-   //std::cout << "row_indices_size " << row_indices_size << "\n";
-   
-   // sanity check (cusp::coo format needs to be sorted by row/col)
-   //std::cout << "is C sorted_by_row? " << C.is_sorted_by_row() << "\n";// TRUE
+   //std::cout << "num_rows " << num_rows << "\n";
    
    // allocate space for result, rhs
-   // result/rhs are sparse -> they contain as many rows as the num of rows in C
-   // C * result = rhs -> dimensions of vectors should match the size of C elements 
-   // rhs[n*4] till rhs[row_indices_size -1] = 0 (cannot get rid of this) 
-   vector<float> result( row_indices_size );
-   vector<float> rhs(    row_indices_size ); 
+   // C * result = rhs -> one real entry per row of C (four per quaternion)
+   vector<T> result( num_rows );
+   vector<T> rhs(    num_rows ); 
        
    // convert right-hand side(b) to real values (rhs)
-   LinearSolver::toReal( b, rhs );
+   LinearSolver<T>::toReal( b, rhs );
+
+   // start from the caller's estimate (e.g., the previous solution)
+   if( initialGuess )
+   {
+      LinearSolver<T>::toReal( x, result );
+   }
    
    //std::cout << "rhs.size() " << rhs.size() << "\n";
    
    // allocate array1d (CUSP's format for a dense matrix) on the host for rhs
-   cusp::array1d<float, cusp::host_memory> rhs_host = rhs;
+   cusp::array1d<T, cusp::host_memory> rhs_host = rhs;
    //cusp::io::write_matrix_market_file(rhs_host, "rhs_host.mtx");
    //cusp::print(rhs_host);
    
    // sanity check (make sure rhs_host and rhs have the same size)
-   thrust::host_vector<float> rhs_host_thrust( rhs_host.begin(), rhs_host.end() );
+   thrust::host_vector<T> rhs_host_thrust( rhs_host.begin(), rhs_host.end() );
    assert( rhs_host_thrust.size() == rhs.size() );
 
    // allocate array1d on the host for result
-   cusp::array1d<float, cusp::host_memory> result_host = result;
+   cusp::array1d<T, cusp::host_memory> result_host = result;
    //cusp::io::write_matrix_market_file( result_host, "result_host_before_cu.mtx" );
    
    // sanity check (make sure the sizes of result_host and result are the same)
-   thrust::host_vector<float> result_host_thrust( result_host.begin(), 
-                                                  result_host.end()   );
+   thrust::host_vector<T> result_host_thrust( result_host.begin(), 
+                                              result_host.end()   );
    assert( result_host_thrust.size() == result_host.size() );
    
+   // keep what CG starts from if the system is to be captured
+   CapturedSystem<T> captured;
+   bool capture = SystemCapture::enabled();
+   if( capture )
+   {
+      captured.guess.assign( result_host.begin(), result_host.end() );
+   }
+
    // calls cusp_device.cu and solves linear system on the device  
-   solve_on_device( C, rhs_host, result_host );
+   SolverStatistics stats = solve_on_device( C, rhs_host, result_host, options, A.isSymmetric(), sell );
+   if( capture )
+   {
+      // captured systems always hold the full matrix
+      if( A.isSymmetric() )
+      {
+         csr_cusp full;
+         expand_symmetric( C, full );
+         captureSystem( full, rhs_host, result_host, stats, initialGuess, name, captured );
+      }
+      else
+      {
+         captureSystem( C, rhs_host, result_host, stats, initialGuess, name, captured );
+      }
+   }
+   if( Profiler::enabled() )
+   {
+      Profiler::recordSolve( name, stats.start, stats.seconds,
+                             stats.iterations, stats.residual, stats.converged,
+                             stats.spmvBytes );
+   }
    //cusp::io::write_matrix_market_file(result_host, "result_host_after_cu_no_views.mtx");
    
    //convert solution back to quaternions
-   thrust::host_vector<float> thrust_result_to_quat( result_host.begin(), 
-                                                     result_host.end()   );
+   thrust::host_vector<T> thrust_result_to_quat( result_host.begin(), 
+                                                 result_host.end()   );
    
-   //vector<float> result_in_std_format( row_indices_size ); // same with below
-   vector<float> result_in_std_format( thrust_result_to_quat.size() );
+   //vector<T> result_in_std_format( num_rows ); // same with below
+   vector<T> result_in_std_format( thrust_result_to_quat.size() );
       
    thrust::copy( thrust_result_to_quat.begin(), thrust_result_to_quat.end(), 
                  result_in_std_format.begin() );
@@ -99,8 +175,9 @@ void LinearSolver :: solve( QuaternionMatrix&   A,
 					
 }
 
-void LinearSolver :: toReal( const vector<Quaternion>& uQuat,
-                             vector<float>& uReal )
+template <class T>
+void LinearSolver<T> :: toReal( const vector< Quaternion<T> >& uQuat,
+                                vector<T>& uReal )
 // converts vector from quaternion- to real-valued entries
 {
    for( size_t i = 0; i != uQuat.size(); i++ )
@@ -112,16 +189,20 @@ void LinearSolver :: toReal( const vector<Quaternion>& uQuat,
    }
 }
 
-//void LinearSolver :: toQuat( const vector<float>& uReal,
-void LinearSolver :: toQuat( vector<float>& uReal,
-                             vector<Quaternion>& uQuat )
+//void LinearSolver :: toQuat( const vector<T>& uReal,
+template <class T>
+void LinearSolver<T> :: toQuat( vector<T>& uReal,
+                                vector< Quaternion<T> >& uQuat )
 // converts vector from real- to quaternion-valued entries
 {
    for( size_t i = 0; i != uQuat.size(); i++ )
    {
-      uQuat[i] = Quaternion( uReal[i*4+0],   // real
-                             uReal[i*4+1],   // i
-                             uReal[i*4+2],   // j
-                             uReal[i*4+3] ); // k
+      uQuat[i] = Quaternion<T>( uReal[i*4+0],   // real
+                                uReal[i*4+1],   // i
+                                uReal[i*4+2],   // j
+                                uReal[i*4+3] ); // k
    }
-}
\ No newline at end of file
+}
+
+template class LinearSolver<float>;
+template class LinearSolver<double>;
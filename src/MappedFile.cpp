@@ -0,0 +1,85 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MappedFile.cpp
+//
+
+#include "MappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile :: MappedFile( void )
+: start( NULL ),
+  length( 0 )
+{}
+
+MappedFile :: ~MappedFile( void )
+{
+   close();
+}
+
+bool MappedFile :: open( const std::string& filename )
+// maps the whole file read-only; returns false on failure
+{
+   close();
+
+   int fd = ::open( filename.c_str(), O_RDONLY );
+   if( fd < 0 )
+   {
+      return false;
+   }
+
+   struct stat info;
+   if( fstat( fd, &info ) != 0 )
+   {
+      ::close( fd );
+      return false;
+   }
+
+   length = info.st_size;
+   if( length == 0 )
+   {
+      ::close( fd );
+      return true;
+   }
+
+   void* p = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+   ::close( fd ); // the mapping keeps its own reference to the file
+
+   if( p == MAP_FAILED )
+   {
+      length = 0;
+      return false;
+   }
+
+   // the whole file is about to be read, so start paging it in now
+   madvise( p, length, MADV_WILLNEED );
+
+   start = (char*) p;
+   return true;
+}
+
+void MappedFile :: close( void )
+// releases the mapping
+{
+   if( start != NULL )
+   {
+      munmap( start, length );
+   }
+
+   start = NULL;
+   length = 0;
+}
+
+const char* MappedFile :: data( void ) const
+// returns pointer to the first byte of the file
+{
+   return start;
+}
+
+size_t MappedFile :: size( void ) const
+// returns file size in bytes
+{
+   return length;
+}
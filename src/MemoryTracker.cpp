@@ -0,0 +1,259 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MemoryTracker.cpp
+//
+// Replaces the global operator new and delete with versions that count what
+// they hand out.  Until enable() is called, each call costs one relaxed flag
+// test on top of malloc or free; after that, a malloc_usable_size and a few
+// relaxed atomic updates on a cache line of the calling thread's own.
+//
+
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+
+using namespace std;
+
+static atomic<bool> enabled( false );
+
+// counts of one thread (or, beyond maxSlots threads, of several), each on
+// its own cache line so that threads don't contend; totals are sums over
+// all slots.  The counters are still atomic because slots may be shared,
+// and because the blocks a thread frees need not be its own.
+class alignas(64) Slot
+{
+   public:
+      atomic<long long> current;         // bytes allocated minus bytes freed
+      atomic<long long> peak;            // largest value of current since resetPeak()
+      atomic<unsigned long long> count;  // allocations
+      atomic<unsigned long long> total;  // bytes allocated
+};
+
+static const int maxSlots = 128;
+static Slot slots[maxSlots];
+static atomic<int> usedSlots( 0 );
+static thread_local int threadSlot = -1; // constant-initialized, so safe in operator new
+
+static Slot& ownSlot( void )
+// returns the calling thread's slot, assigning one on first use
+{
+   if( threadSlot < 0 )
+   {
+      threadSlot = usedSlots.fetch_add( 1, memory_order_relaxed ) % maxSlots;
+   }
+   return slots[threadSlot];
+}
+
+static int slotCount( void )
+// returns the number of slots in use
+{
+   return min( maxSlots, usedSlots.load( memory_order_relaxed ));
+}
+
+static void* track( void* p )
+// counts a new block
+{
+   if( p != NULL && enabled.load( memory_order_relaxed ))
+   {
+      Slot& s( ownSlot() );
+      long long size = malloc_usable_size( p );
+      long long now = s.current.fetch_add( size, memory_order_relaxed ) + size;
+      s.count.fetch_add( 1, memory_order_relaxed );
+      s.total.fetch_add( size, memory_order_relaxed );
+
+      long long old = s.peak.load( memory_order_relaxed );
+      while( now > old && !s.peak.compare_exchange_weak( old, now, memory_order_relaxed ))
+      {}
+   }
+   return p;
+}
+
+static void untrack( void* p )
+// uncounts a block that is about to be freed
+{
+   if( p != NULL && enabled.load( memory_order_relaxed ))
+   {
+      ownSlot().current.fetch_sub( malloc_usable_size( p ), memory_order_relaxed );
+   }
+}
+
+static void* allocate( size_t size, size_t alignment )
+// allocates like operator new, throwing bad_alloc on failure
+{
+   if( size == 0 )
+   {
+      size = 1;
+   }
+
+   while( true )
+   {
+      void* p = NULL;
+      if( alignment <= alignof(max_align_t) )
+      {
+         p = malloc( size );
+      }
+      else if( posix_memalign( &p, alignment, size ) != 0 )
+      {
+         p = NULL;
+      }
+
+      if( p != NULL )
+      {
+         return track( p );
+      }
+
+      new_handler handler = get_new_handler();
+      if( handler == NULL )
+      {
+         throw bad_alloc();
+      }
+      handler();
+   }
+}
+
+static void release( void* p )
+// uncounts and frees a block
+{
+   untrack( p );
+   free( p );
+}
+
+void* operator new( size_t size ) { return allocate( size, 0 ); }
+void* operator new[]( size_t size ) { return allocate( size, 0 ); }
+void* operator new( size_t size, align_val_t a ) { return allocate( size, (size_t) a ); }
+void* operator new[]( size_t size, align_val_t a ) { return allocate( size, (size_t) a ); }
+
+void* operator new( size_t size, const nothrow_t& ) noexcept
+{
+   try { return allocate( size, 0 ); } catch( ... ) { return NULL; }
+}
+
+void* operator new[]( size_t size, const nothrow_t& ) noexcept
+{
+   try { return allocate( size, 0 ); } catch( ... ) { return NULL; }
+}
+
+void* operator new( size_t size, align_val_t a, const nothrow_t& ) noexcept
+{
+   try { return allocate( size, (size_t) a ); } catch( ... ) { return NULL; }
+}
+
+void* operator new[]( size_t size, align_val_t a, const nothrow_t& ) noexcept
+{
+   try { return allocate( size, (size_t) a ); } catch( ... ) { return NULL; }
+}
+
+void operator delete( void* p ) noexcept { release( p ); }
+void operator delete[]( void* p ) noexcept { release( p ); }
+void operator delete( void* p, size_t ) noexcept { release( p ); }
+void operator delete[]( void* p, size_t ) noexcept { release( p ); }
+void operator delete( void* p, align_val_t ) noexcept { release( p ); }
+void operator delete[]( void* p, align_val_t ) noexcept { release( p ); }
+void operator delete( void* p, size_t, align_val_t ) noexcept { release( p ); }
+void operator delete[]( void* p, size_t, align_val_t ) noexcept { release( p ); }
+void operator delete( void* p, const nothrow_t& ) noexcept { release( p ); }
+void operator delete[]( void* p, const nothrow_t& ) noexcept { release( p ); }
+void operator delete( void* p, align_val_t, const nothrow_t& ) noexcept { release( p ); }
+void operator delete[]( void* p, align_val_t, const nothrow_t& ) noexcept { release( p ); }
+
+void MemoryTracker :: enable( void )
+// starts counting
+{
+   enabled.store( true, memory_order_relaxed );
+}
+
+bool MemoryTracker :: isEnabled( void )
+// returns whether enable() has been called
+{
+   return enabled.load( memory_order_relaxed );
+}
+
+long long MemoryTracker :: currentBytes( void )
+// returns the number of bytes currently allocated by all threads
+{
+   long long sum = 0;
+   for( int i = 0; i < slotCount(); i++ )
+   {
+      sum += slots[i].current.load( memory_order_relaxed );
+   }
+   return sum;
+}
+
+long long MemoryTracker :: threadBytes( void )
+// returns the bytes allocated minus the bytes freed by the calling thread
+{
+   return ownSlot().current.load( memory_order_relaxed );
+}
+
+long long MemoryTracker :: peakBytes( void )
+// returns the largest value threadBytes() has had since the last call to
+// resetPeak()
+{
+   return ownSlot().peak.load( memory_order_relaxed );
+}
+
+unsigned long long MemoryTracker :: allocations( void )
+// returns the number of allocations by all threads
+{
+   unsigned long long sum = 0;
+   for( int i = 0; i < slotCount(); i++ )
+   {
+      sum += slots[i].count.load( memory_order_relaxed );
+   }
+   return sum;
+}
+
+unsigned long long MemoryTracker :: allocatedBytes( void )
+// returns the bytes allocated by all threads
+{
+   unsigned long long sum = 0;
+   for( int i = 0; i < slotCount(); i++ )
+   {
+      sum += slots[i].total.load( memory_order_relaxed );
+   }
+   return sum;
+}
+
+long long MemoryTracker :: resetPeak( void )
+// restarts the calling thread's peak at its current level; returns the
+// old peak
+{
+   Slot& s( ownSlot() );
+   return s.peak.exchange( s.current.load( memory_order_relaxed ), memory_order_relaxed );
+}
+
+void MemoryTracker :: raisePeak( long long bytes )
+// makes the calling thread's peak at least bytes (e.g., to restore an
+// outer peak)
+{
+   Slot& s( ownSlot() );
+   long long old = s.peak.load( memory_order_relaxed );
+   while( bytes > old && !s.peak.compare_exchange_weak( old, bytes, memory_order_relaxed ))
+   {}
+}
+
+bool MemoryTracker :: readStatus( long long& residentKB, long long& peakResidentKB )
+// reads VmRSS and VmHWM from /proc/self/status; returns false on failure
+{
+   FILE* in = fopen( "/proc/self/status", "r" );
+   if( in == NULL )
+   {
+      return false;
+   }
+
+   int found = 0;
+   char line[256];
+   while( fgets( line, sizeof(line), in ))
+   {
+      if( strncmp( line, "VmRSS:", 6 ) == 0 ) { residentKB = atoll( line+6 ); found++; }
+      if( strncmp( line, "VmHWM:", 6 ) == 0 ) { peakResidentKB = atoll( line+6 ); found++; }
+   }
+
+   fclose( in );
+   return found == 2;
+}
@@ -11,34 +11,383 @@
 //
 
 #include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <cmath>
 #include <ctime>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Mesh.h"
+#include "Profiler.h"
 #include "LinearSolver.h"
 #include "EigenSolver.h"
+#include "MappedFile.h"
+#include "BufferedFile.h"
 #include "Utility.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <iostream>
 
-void Mesh :: updateDeformation( void )
+template <class T>
+Mesh<T> :: Mesh( void )
+: useCache( true ),
+  cacheOperators( true ),
+  localTolerance( 1e-2 ),
+  localVertices( 0 ),
+  localEigenResidual( -1. ),
+  localPoissonResidual( -1. ),
+  eigenTolerance( 5e-2 ),
+  eigenIterations( 3 ),
+  symmetricStorage( true ),
+  innerToleranceFactor( .1 ),
+  solutionScale( 1. ),
+  L( new QuaternionMatrix<T>() ),
+  eigenvalue( 0. ),
+  eigenvalueKnown( false ),
+  eigenvalueProblemBuilt( false ),
+  deltaUpdates( 0 ),
+  laplacianBuilt( false )
+{}
+
+template <class T>
+bool Mesh<T> :: halfStorage( void ) const
+// returns whether E and L are stored as upper triangles -- only for the
+// host and sell backends: on the device, the symmetric SpMV scatters every
+// off-diagonal entry with an atomic add, which makes float results vary
+// from run to run and has not been timed against CUSP's CSR SpMV
+{
+   return symmetricStorage && solverOptions.backend != SolverOptions::device;
+}
+
+template <class T>
+void Mesh<T> :: prepareOperators( void )
+// builds the Laplacian and its real form up front
+{
+   buildLaplacian();
+   L->toRealCsrFormat();
+   if( solverOptions.backend == SolverOptions::sell )
+   {
+      L->toSellFormat();
+   }
+}
+
+template <class T>
+void Mesh<T> :: updateDeformation( bool warmStart )
 {
-   int t0 = clock();
+   ScopedTimer timer( "update deformation" );
 
    // solve eigenvalue problem for local similarity transformation lambda
    buildEigenvalueProblem();
-   EigenSolver::solve( E, lambda ); // E(4002 x 4002)
+   {
+      ScopedTimer eigenTimer( "eigen solve" );
+      eigenvalue = EigenSolver<T>::solve( E, lambda, warmStart, eigenTolerance,
+                                             eigenIterations, solverOptions,
+                                             innerToleranceFactor ); // E(4002 x 4002)
+   }
+   eigenvalueKnown = true;
+
+   // solve Poisson problem for new vertex positions, starting from the
+   // previous solution (undoing the rescaling in normalizeSolution)
+   buildPoissonProblem();
+   if( warmStart )
+   {
+      for( size_t i = 0; i < newVertices.size(); i++ )
+      {
+         newVertices[i] *= solutionScale;
+      }
+   }
+   LinearSolver<T>::solve( *L, newVertices, omega, true, warmStart, "poisson cg", solverOptions );
+   normalizeSolution();
+}
+
+template <class T>
+bool Mesh<T> :: updateDeformationLocal( int rings )
+// updates the deformation only within "rings" rings of the faces whose rho
+// changed since the last solve, holding lambda and newVertices fixed just
+// outside; falls back to (and returns false after) a global solve if there
+// is no previous solution, the edit is large, or the residual just outside
+// the region exceeds localTolerance
+{
+   ScopedTimer timer( "local update" );
+   int nV = vertices.size();
+   localVertices = 0;
+   localEigenResidual = localPoissonResidual = -1.;
+
+   // boundary values come from the previous solution
+   if( !eigenvalueKnown )
+   {
+      updateDeformation( false );
+      return false;
+   }
+
+   buildAdjacency();
+   if( (int) localIndex.size() != nV )
+   {
+      localIndex.assign( nV, -1 );
+   }
+
+   // seed the region with the vertices of faces whose rho changed
+   vector<int> region;
+   for( size_t k = 0; k < faces.size(); k++ )
+   {
+      if( rho[k] == assembledRho[k] ) continue;
+
+      for( int j = 0; j < 3; j++ )
+      {
+         int v = faces[k].vertex[j];
+         if( localIndex[v] < 0 )
+         {
+            localIndex[v] = region.size();
+            region.push_back( v );
+         }
+      }
+   }
+
+   if( region.empty() )
+   {
+      return true;
+   }
+
+   // grow the region ring by ring; [front,end) holds the outermost ring
+   size_t front = 0;
+   for( int r = 0; r < rings; r++ )
+   {
+      size_t end = region.size();
+      for( size_t n = front; n < end; n++ )
+      {
+         int v = region[n];
+         for( int f = vertexFaceStart[v]; f < vertexFaceStart[v+1]; f++ )
+         for( int j = 0; j < 3; j++ )
+         {
+            int w = faces[ vertexFaces[f] ].vertex[j];
+            if( localIndex[w] < 0 )
+            {
+               localIndex[w] = region.size();
+               region.push_back( w );
+            }
+         }
+      }
+      front = end;
+   }
+   int nI = region.size();
+   localVertices = nI;
+
+   // vertices just outside the region keep their values
+   vector<int> boundary;
+   for( int n = front; n < nI; n++ )
+   {
+      int v = region[n];
+      for( int f = vertexFaceStart[v]; f < vertexFaceStart[v+1]; f++ )
+      for( int j = 0; j < 3; j++ )
+      {
+         int w = faces[ vertexFaces[f] ].vertex[j];
+         if( localIndex[w] < 0 )
+         {
+            localIndex[w] = nI + boundary.size();
+            boundary.push_back( w );
+         }
+      }
+   }
+
+   // E is updated incrementally, which keeps the eigenvalue estimate; a
+   // full rebuild (large edit) means a global solve is cheaper anyway
+   buildEigenvalueProblem();
+   bool local = eigenvalueKnown && nI <= nV/4;
+
+   T eigenResidual = 0., eigenScale = 0.;
+   T poissonResidual = 0., poissonScale = 0.;
+   if( local )
+   {
+      buildPoissonProblem();
+      const QuaternionMatrix<T>& Ec( E );
+      const QuaternionMatrix<T>& Lc( *L );
+      vector<int> neighbors;
+
+      // solve (E-cI) lambda = 0 for the interior values, where c is the
+      // current eigenvalue estimate and boundary values move to the right
+      QuaternionMatrix<T> A;
+      A.resize( nI, nI );
+      vector< Quaternion<T> > x( nI ), b( nI );
+      for( int li = 0; li < nI; li++ )
+      {
+         int i = region[li];
+         x[li] = lambda[i];
+         b[li] = 0.;
+
+         vertexNeighbors( i, neighbors );
+         for( size_t n = 0; n < neighbors.size(); n++ )
+         {
+            int j = neighbors[n];
+            int lj = localIndex[j];
+            if( lj < nI ) A( li, lj ) += Ec( i, j );
+            else          b[li] -= Ec( i, j ) * lambda[j];
+         }
+         A( li, li ) -= eigenvalue;
+      }
+      LinearSolver<T>::solve( A, x, b, false, true, "local eigen cg", solverOptions );
+      for( int li = 0; li < nI; li++ )
+      {
+         lambda[ region[li] ] = x[li];
+      }
+
+      // solve L x = omega for the interior positions in unnormalized
+      // coordinates, again with boundary values moved to the right
+      for( int i = 0; i < nV; i++ )
+      {
+         newVertices[i] *= solutionScale;
+      }
+      A.resize( nI, nI );
+      for( int li = 0; li < nI; li++ )
+      {
+         int i = region[li];
+         x[li] = newVertices[i];
+         b[li] = omegaAt( i );
+
+         vertexNeighbors( i, neighbors );
+         for( size_t n = 0; n < neighbors.size(); n++ )
+         {
+            int j = neighbors[n];
+            int lj = localIndex[j];
+            if( lj < nI ) A( li, lj ) += Lc( i, j );
+            else          b[li] -= Lc( i, j ) * newVertices[j];
+         }
+      }
+      LinearSolver<T>::solve( A, x, b, true, true, "local poisson cg", solverOptions );
+      for( int li = 0; li < nI; li++ )
+      {
+         newVertices[ region[li] ] = x[li];
+      }
 
-   // solve Poisson problem for new vertex positions
-  buildPoissonProblem();
-  LinearSolver::solve( L, newVertices, omega );
-  normalizeSolution();
+      // measure how well both equations hold on the ring just outside the
+      // region, relative to the size of their diagonal terms
+      for( size_t n = 0; n < boundary.size(); n++ )
+      {
+         int i = boundary[n];
+         Quaternion<T> Ex( 0., 0., 0., 0. ), Lx( 0., 0., 0., 0. );
+
+         vertexNeighbors( i, neighbors );
+         for( size_t k = 0; k < neighbors.size(); k++ )
+         {
+            int j = neighbors[k];
+            Ex += Ec( i, j ) * lambda[j];
+            Lx += Lc( i, j ) * newVertices[j];
+         }
+
+         eigenResidual   += ( Ex - eigenvalue*lambda[i] ).norm2();
+         eigenScale      += ( Ec( i, i ) * lambda[i] ).norm2();
+         poissonResidual += ( Lx - omegaAt( i )).norm2();
+         poissonScale    += ( Lc( i, i ) * newVertices[i] ).norm2();
+      }
+
+      normalizeSolution();
+   }
+
+   // clear the marks for the next call
+   for( int n = 0; n < nI; n++ ) localIndex[ region[n] ] = -1;
+   for( size_t n = 0; n < boundary.size(); n++ ) localIndex[ boundary[n] ] = -1;
 
-   int t1 = clock();
-   cout << "time: " << (t1-t0)/(float) CLOCKS_PER_SEC << "s" << endl;
+   if( local )
+   {
+      eigenResidual = sqrt( eigenResidual / eigenScale );
+      poissonResidual = sqrt( poissonResidual / poissonScale );
+      local = eigenResidual <= localTolerance && poissonResidual <= localTolerance;
+      localEigenResidual = eigenResidual;
+      localPoissonResidual = poissonResidual;
+   }
+
+   if( !local )
+   {
+      updateDeformation( true );
+      return false;
+   }
+
+   return true;
 }
 
-void Mesh :: resetDeformation( void )
+template <class T>
+void Mesh<T> :: buildAdjacency( void )
+// lists the faces around each vertex (compressed, indexed by vertexFaceStart)
+{
+   int nV = vertices.size();
+   if( (int) vertexFaceStart.size() == nV+1 )
+   {
+      return;
+   }
+
+   vertexFaceStart.assign( nV+1, 0 );
+   for( size_t k = 0; k < faces.size(); k++ )
+   for( int j = 0; j < 3; j++ )
+   {
+      vertexFaceStart[ faces[k].vertex[j]+1 ]++;
+   }
+   for( int v = 0; v < nV; v++ )
+   {
+      vertexFaceStart[v+1] += vertexFaceStart[v];
+   }
+
+   vertexFaces.resize( vertexFaceStart[nV] );
+   vector<int> next( vertexFaceStart.begin(), vertexFaceStart.end()-1 );
+   for( size_t k = 0; k < faces.size(); k++ )
+   for( int j = 0; j < 3; j++ )
+   {
+      vertexFaces[ next[ faces[k].vertex[j] ]++ ] = k;
+   }
+}
+
+template <class T>
+void Mesh<T> :: vertexNeighbors( int v, vector<int>& neighbors ) const
+// lists v and the vertices sharing a face with it
+{
+   neighbors.clear();
+   for( int f = vertexFaceStart[v]; f < vertexFaceStart[v+1]; f++ )
+   for( int j = 0; j < 3; j++ )
+   {
+      int w = faces[ vertexFaces[f] ].vertex[j];
+      if( find( neighbors.begin(), neighbors.end(), w ) == neighbors.end() )
+      {
+         neighbors.push_back( w );
+      }
+   }
+}
+
+template <class T>
+Quaternion<T> Mesh<T> :: omegaAt( int v ) const
+// computes entry v of omega (as in buildOmega) from the faces around v
+{
+   Quaternion<T> w( 0., 0., 0., 0. );
+
+   for( int f = vertexFaceStart[v]; f < vertexFaceStart[v+1]; f++ )
+   {
+      int i = vertexFaces[f];
+      for( int j = 0; j < 3; j++ )
+      {
+         int a = faces[i].vertex[ (j+1) % 3 ];
+         int b = faces[i].vertex[ (j+2) % 3 ];
+         if( a > b )
+         {
+            swap( a, b );
+         }
+         if( a != v && b != v ) continue;
+
+         T cotAlpha = cotans[ 3*i+j ];
+         Quaternion<T> eTilde = transformedEdge( a, b );
+         if( a == v ) w -= cotAlpha * eTilde / 2.;
+         else         w += cotAlpha * eTilde / 2.;
+      }
+   }
+
+   return w;
+}
+
+template <class T>
+void Mesh<T> :: resetDeformation( void )
 {
    // copy original mesh vertices to current mesh
    for( size_t i = 0; i < vertices.size(); i++ )
@@ -49,56 +398,210 @@ void Mesh :: resetDeformation( void )
    normalizeSolution();
 }
 
-void Mesh :: setCurvatureChange( const Image& image, const float scale )
+template <class T>
+int Mesh<T> :: setCurvatureChange( const Image& image, const T scale )
 // sets rho values by interpreting "image" as a square image
 // in the range [0,1] x [0,1] and mapping values to the
 // surface via vertex texture coordinates -- grayscale
 // values in the  range [0,1] get mapped (linearly) to values
 // in the range [-scale,scale]
 {
-   float w = (float) image.width();
-   float h = (float) image.height();
+   ScopedTimer timer( "set rho" );
 
-   for( size_t i = 0; i < faces.size(); i++ )
+   T w = (T) image.width();
+   T h = (T) image.height();
+
+   // rather than sampling a few points (which aliases whenever a face
+   // covers many pixels), look up the image average over each face's
+   // footprint in the mip pyramid: the footprint is approximated by a
+   // square with the same pixel area as the face's uv triangle, centered
+   // at its uv centroid
+   int nFaces = (int) faces.size();
+   int top = image.levels() - 1;
+   vector<float> x( nFaces ), y( nFaces ), t( nFaces );
+   vector<int> level( nFaces );
+
+   #pragma omp parallel for
+   for( int i = 0; i < nFaces; i++ )
    {
-      // get handle to current value of rho
-      rho[i] = 0.;
+      Vector<T> p0( faces[i].uv[0].x*w, faces[i].uv[0].y*h, 0. );
+      Vector<T> p1( faces[i].uv[1].x*w, faces[i].uv[1].y*h, 0. );
+      Vector<T> p2( faces[i].uv[2].x*w, faces[i].uv[2].y*h, 0. );
+      Vector<T> c = ( p0 + p1 + p2 ) / 3.;
 
-      // compute average value over the face
-      for( int j = 0; j < 3; j++ )
+      T pixelArea = .5 * fabs( (( p1-p0 ) ^ ( p2-p0 )).z );
+      T lod = pixelArea > 1. ? .5 * log2( pixelArea ) : 0.;
+      if( lod > (T) top ) lod = (T) top;
+
+      x[i] = (float) c.x;
+      y[i] = (float) c.y;
+      level[i] = min( (int) floor( lod ), max( top-1, 0 ));
+      t[i] = (float) ( lod - (T) level[i] );
+   }
+
+   // group faces by mip level so that each level is sampled with a few
+   // large calls to the vectorized batch sampler
+   vector<int> begin( top+2, 0 );
+   for( int i = 0; i < nFaces; i++ ) begin[ level[i]+1 ]++;
+   for( int l = 0; l <= top; l++ ) begin[l+1] += begin[l];
+
+   vector<int> order( nFaces );
+   vector<float> sx( nFaces ), sy( nFaces );
+   vector<int> next( begin.begin(), begin.end()-1 );
+   for( int i = 0; i < nFaces; i++ )
+   {
+      int k = next[ level[i] ]++;
+      order[k] = i;
+      sx[k] = x[i];
+      sy[k] = y[i];
+   }
+
+   vector<float> lower( nFaces ), upper( nFaces, 0.f );
+   const int blockSize = 4096;
+   for( int l = 0; l <= top; l++ )
+   {
+      #pragma omp parallel for schedule(dynamic)
+      for( int k0 = begin[l]; k0 < begin[l+1]; k0 += blockSize )
       {
-         Vector uv = faces[i].uv[j];
-         rho[i] += image.sample( uv.x*w, uv.y*h ) / 3.;
+         ScopedTimer timer( "sample rho block" );
+         int n = min( blockSize, begin[l+1] - k0 );
+         image.sampleBatch( l, n, &sx[k0], &sy[k0], &lower[k0] );
+         if( l < top )
+         {
+            image.sampleBatch( l+1, n, &sx[k0], &sy[k0], &upper[k0] );
+         }
       }
+   }
+
+   vector<char> changed( nFaces );
+
+   #pragma omp parallel for
+   for( int k = 0; k < nFaces; k++ )
+   {
+      int i = order[k];
+
+      // blend the two nearest levels
+      T value = (1.-t[i]) * lower[k] + t[i] * upper[k];
 
       // map value to range [-scale,scale]
-      rho[i] = (2.*(rho[i]-.5)) * scale;
+      value = (2.*(value-.5)) * scale;
+
+      changed[i] = ( value != rho[i] );
+      rho[i] = value;
    }
+
+   int nChanged = 0;
+   for( int i = 0; i < nFaces; i++ )
+   {
+      nChanged += changed[i];
+   }
+
+   return nChanged;
 }
 
-float Mesh :: area( int i )
+template <class T>
+T Mesh<T> :: area( int i )
 // returns area of triangle i in the original mesh
 {
-   Vector& p1 = vertices[ faces[i].vertex[0] ].im();
-   Vector& p2 = vertices[ faces[i].vertex[1] ].im();
-   Vector& p3 = vertices[ faces[i].vertex[2] ].im();
+   Vector<T>& p1 = vertices[ faces[i].vertex[0] ].im();
+   Vector<T>& p2 = vertices[ faces[i].vertex[1] ].im();
+   Vector<T>& p3 = vertices[ faces[i].vertex[2] ].im();
 
    return .5 * (( p2-p1 ) ^ ( p3-p1 )).norm();
 }
 
-void Mesh :: buildEigenvalueProblem( void )
+template <class T>
+void Mesh<T> :: buildGeometry( void )
+// precomputes triangle areas and corner cotangents of the original mesh
 {
+   ScopedTimer timer( "build geometry" );
+
+   areas.resize( faces.size() );
+   cotans.resize( 3*faces.size() );
+
+   #pragma omp parallel for
+   for( int i = 0; i < (int) faces.size(); i++ )
+   {
+      areas[i] = area( i );
+
+      // visit each triangle corner
+      for( int j = 0; j < 3; j++ )
+      {
+         Vector<T> f0 = vertices[ faces[i].vertex[ (j+0) % 3 ]].im();
+         Vector<T> f1 = vertices[ faces[i].vertex[ (j+1) % 3 ]].im();
+         Vector<T> f2 = vertices[ faces[i].vertex[ (j+2) % 3 ]].im();
+
+         // compute cotangent of the angle at the current vertex
+         // (equal to cosine over sine, which equals the dot
+         // product over the norm of the cross product)
+         Vector<T> u1 = f1 - f0;
+         Vector<T> u2 = f2 - f0;
+         cotans[ 3*i+j ] = (u1*u2)/(u1^u2).norm();
+      }
+   }
+}
+
+template <class T>
+void Mesh<T> :: buildEigenvalueProblem( void )
+{
+   ScopedTimer timer( "assemble eigenvalue problem" );
+
+   // E depends on rho only through per-face terms, so if E has been built
+   // before and only a few faces changed, update just their contributions
+   if( eigenvalueProblemBuilt )
+   {
+      vector<int> dirty;
+      for( size_t k = 0; k < faces.size(); k++ )
+      {
+         if( rho[k] != assembledRho[k] ) dirty.push_back( k );
+      }
+
+      // large edits are cheaper to rebuild, and an occasional rebuild
+      // keeps round-off from accumulating over many increments
+      const int maxDeltaUpdates = 100;
+      if( dirty.size() <= faces.size()/8 && deltaUpdates < maxDeltaUpdates )
+      {
+         T change = 0.;
+         for( size_t d = 0; d < dirty.size(); d++ )
+         {
+            change += updateEigenvalueProblem( dirty[d] );
+         }
+         if( !dirty.empty() )
+         {
+            deltaUpdates++;
+         }
+
+         // the Rayleigh quotient is stationary at an eigenvector, so to
+         // first order the eigenvalue moves by lambda'*dE*lambda/lambda'*lambda
+         T norm2 = 0.;
+         for( size_t i = 0; i < lambda.size(); i++ )
+         {
+            norm2 += lambda[i].norm2();
+         }
+         eigenvalue += change / norm2;
+         return;
+      }
+   }
+
    // allocate a sparse |V|x|V| matrix
    int nV = vertices.size();
+   E.setSymmetric( halfStorage() );
    E.resize( nV, nV );
 
+   // E has the same sparsity pattern as L; preallocating it means the
+   // increments below never have to insert into the tree
+   if( !pattern.empty() && L->isSymmetric() == halfStorage() )
+   {
+      E.setEntries( pattern, vector< Quaternion<T> >( pattern.size() ));
+   }
+
    // visit each face
    for( size_t k = 0; k < faces.size(); k++ )
    {
-      float A = area(k);
-      float a = -1. / (4.*A);
-      float b = rho[k] / 6.;
-      float c = A*rho[k]*rho[k] / 9.;
+      T A = areas[k];
+      T a = -1. / (4.*A);
+      T b = rho[k] / 6.;
+      T c = A*rho[k]*rho[k] / 9.;
 
       // get vertex indices
       int I[3] =
@@ -109,35 +612,100 @@ void Mesh :: buildEigenvalueProblem( void )
       };
 
       // compute edges across from each vertex
-      Quaternion e[3];
+      Quaternion<T> e[3];
       for( int i = 0; i < 3; i++ )
       {
          e[i] = vertices[ I[ (i+2) % 3 ]] -
                 vertices[ I[ (i+1) % 3 ]] ;
       }
 
-      // increment matrix entry for each ordered pair of vertices
+      // increment matrix entry for each ordered pair of vertices (E is
+      // Hermitian, so in symmetric storage only the upper triangle)
       for( int i = 0; i < 3; i++ )
       for( int j = 0; j < 3; j++ )
       {
-         E(I[i],I[j]) += a*e[i]*e[j] + b*(e[j]-e[i]) + c;
+         if( E.stores( I[i], I[j] ))
+         {
+            E(I[i],I[j]) += a*e[i]*e[j] + b*(e[j]-e[i]) + c;
+         }
       }
    }
   // std::cout << "first dim of Quatern matrix: " << E.size(1) << "second dim of Quatern matrix: " << E.size(2) << "\n";
+
+   assembledRho = rho;
+   eigenvalueProblemBuilt = true;
+   eigenvalueKnown = false;
+   deltaUpdates = 0;
+}
+
+template <class T>
+T Mesh<T> :: updateEigenvalueProblem( int k )
+// replaces the contribution of face k to E, built with assembledRho[k],
+// by the one for the current rho[k] -- the geometric term a*e[i]*e[j]
+// doesn't depend on rho and cancels, leaving only the rho terms; returns
+// lambda'*dE*lambda for the change dE
+{
+   T A = areas[k];
+   T db = ( rho[k] - assembledRho[k] ) / 6.;
+   T dc = A*( rho[k]*rho[k] - assembledRho[k]*assembledRho[k] ) / 9.;
+
+   // get vertex indices
+   int I[3] =
+   {
+      faces[k].vertex[0],
+      faces[k].vertex[1],
+      faces[k].vertex[2]
+   };
+
+   // compute edges across from each vertex
+   Quaternion<T> e[3];
+   for( int i = 0; i < 3; i++ )
+   {
+      e[i] = vertices[ I[ (i+2) % 3 ]] -
+             vertices[ I[ (i+1) % 3 ]] ;
+   }
+
+   // update matrix entry for each ordered pair of vertices (add() skips
+   // the lower triangle in symmetric storage, but dE still counts there)
+   T change = 0.;
+   for( int i = 0; i < 3; i++ )
+   for( int j = 0; j < 3; j++ )
+   {
+      Quaternion<T> dE = db*(e[j]-e[i]) + dc;
+      Quaternion<T> dELambda = dE * lambda[ I[j] ];
+      E.add( I[i], I[j], dE );
+
+      change += lambda[ I[i] ].re() * dELambda.re() +
+                lambda[ I[i] ].im() * dELambda.im();
+   }
+
+   assembledRho[k] = rho[k];
+   return change;
 }
 
-void Mesh :: buildPoissonProblem( void )
+template <class T>
+void Mesh<T> :: buildPoissonProblem( void )
 {
    buildLaplacian();
    buildOmega();
 }
 
-void Mesh :: buildLaplacian( void )
+template <class T>
+void Mesh<T> :: buildLaplacian( void )
 // builds the cotan-Laplace operator
 {
+   // L depends only on the original geometry
+   if( laplacianBuilt )
+   {
+      return;
+   }
+
+   ScopedTimer timer( "assemble laplacian" );
+
    // allocate a sparse |V|x|V| matrix
    int nV = vertices.size();
-   L.resize( nV, nV );
+   L->setSymmetric( halfStorage() );
+   L->resize( nV, nV );
 
    // visit each face
    for( size_t i = 0; i < faces.size(); i++ )
@@ -146,33 +714,45 @@ void Mesh :: buildLaplacian( void )
       for( int j = 0; j < 3; j++ )
       {
          // get vertex indices
-         int k0 = faces[i].vertex[ (j+0) % 3 ];
          int k1 = faces[i].vertex[ (j+1) % 3 ];
          int k2 = faces[i].vertex[ (j+2) % 3 ];
 
-         // get vertex positions
-         Vector f0 = vertices[k0].im();
-         Vector f1 = vertices[k1].im();
-         Vector f2 = vertices[k2].im();
-
-         // compute cotangent of the angle at the current vertex
-         // (equal to cosine over sine, which equals the dot
-         // product over the norm of the cross product)
-         Vector u1 = f1 - f0;
-         Vector u2 = f2 - f0;
-         float cotAlpha = (u1*u2)/(u1^u2).norm();
+         // get cotangent of the angle at the current vertex
+         T cotAlpha = cotans[ 3*i+j ];
 
          // add contribution of this cotangent to the matrix
-         L( k1, k2 ) -= cotAlpha / 2.;
-         L( k2, k1 ) -= cotAlpha / 2.;
-         L( k1, k1 ) += cotAlpha / 2.;
-         L( k2, k2 ) += cotAlpha / 2.;
+         if( L->stores( k1, k2 )) (*L)( k1, k2 ) -= cotAlpha / 2.;
+         if( L->stores( k2, k1 )) (*L)( k2, k1 ) -= cotAlpha / 2.;
+         (*L)( k1, k1 ) += cotAlpha / 2.;
+         (*L)( k2, k2 ) += cotAlpha / 2.;
       }
    }
+
+   // remember the sparsity pattern for assembling E
+   vector< Quaternion<T> > values;
+   L->getEntries( pattern, values );
+
+   laplacianBuilt = true;
+}
+
+template <class T>
+Quaternion<T> Mesh<T> :: transformedEdge( int a, int b ) const
+// returns edge vector from vertex a to vertex b transformed by lambda
+{
+   Quaternion<T> lambda1 = lambda[a];
+   Quaternion<T> lambda2 = lambda[b];
+   Quaternion<T> e = vertices[b] - vertices[a];
+   return (1./3.) * (~lambda1) * e * lambda1 +
+          (1./6.) * (~lambda1) * e * lambda2 +
+          (1./6.) * (~lambda2) * e * lambda1 +
+          (1./3.) * (~lambda2) * e * lambda2 ;
 }
 
-void Mesh :: buildOmega( void )
+template <class T>
+void Mesh<T> :: buildOmega( void )
 {
+   ScopedTimer timer( "assemble omega" );
+
    // clear omega
    for( size_t i = 0; i < omega.size(); i++ )
    {
@@ -190,11 +770,6 @@ void Mesh :: buildOmega( void )
       // visit each edge
       for( int j = 0; j < 3; j++ )
       {
-         // get vertices
-         Quaternion f0 = vertices[ v[ (j+0) % 3 ]];
-         Quaternion f1 = vertices[ v[ (j+1) % 3 ]];
-         Quaternion f2 = vertices[ v[ (j+2) % 3 ]];
-
          // determine orientation of this edge
          int a = v[ (j+1) % 3 ];
          int b = v[ (j+2) % 3 ];
@@ -204,18 +779,10 @@ void Mesh :: buildOmega( void )
          }
 
          // compute transformed edge vector
-         Quaternion lambda1 = lambda[a];
-         Quaternion lambda2 = lambda[b];
-         Quaternion e = vertices[b] - vertices[a];
-         Quaternion eTilde = (1./3.) * (~lambda1) * e * lambda1 +
-                             (1./6.) * (~lambda1) * e * lambda2 +
-                             (1./6.) * (~lambda2) * e * lambda1 +
-                             (1./3.) * (~lambda2) * e * lambda2 ;
-
-         // compute cotangent of the angle opposite the current edge
-         Vector u1 = ( f1 - f0 ).im();
-         Vector u2 = ( f2 - f0 ).im();
-         float cotAlpha = (u1*u2)/(u1^u2).norm();
+         Quaternion<T> eTilde = transformedEdge( a, b );
+
+         // get cotangent of the angle opposite the current edge
+         T cotAlpha = cotans[ 3*i+j ];
 
          // add contribution of this edge to the divergence at its vertices
          omega[a] -= cotAlpha * eTilde / 2.;
@@ -226,13 +793,16 @@ void Mesh :: buildOmega( void )
    removeMean( omega );
 }
 
-void Mesh :: normalizeSolution( void )
+template <class T>
+void Mesh<T> :: normalizeSolution( void )
 {
+   ScopedTimer timer( "normalize" );
+
    // center vertices around the origin
    removeMean( newVertices );
 
    // find the vertex with the largest norm
-   float r = 0.;
+   T r = 0.;
    for( size_t i = 0; i < vertices.size(); i++ )
    {
       r = max( r, newVertices[i].norm2() );
@@ -244,96 +814,593 @@ void Mesh :: normalizeSolution( void )
    {
       newVertices[i] /= r;
    }
+   solutionScale = r;
 }
 
 // FILE I/O --------------------------------------------------------------------
 
-void Mesh :: read( const string& filename )
+template <class T>
+class ObjChunk
+// records parsed from one contiguous piece of an OBJ file
+{
+   public:
+      vector< Quaternion<T> > vertices; // "v" records
+      vector< Vector<T> > uv; // "vt" records
+      vector<int> corners; // "f" records as (vertex, uv) index pairs, three per face
+      vector<size_t> relative; // entries of corners holding chunk-relative (negative) indices
+};
+
+static const int noIndex = INT_MIN;
+// marks a face corner without texture coordinates
+
+template <class T>
+static void parseObjChunk( const char* p, const char* end, ObjChunk<T>& chunk )
+// parses all complete lines in [p,end); only the first three corners of
+// each face are used, and normals and all other records are ignored
+{
+   while( p != end )
+   {
+      p = skipBlanks( p, end );
+
+      if( end-p > 1 && p[0] == 'v' && isBlank( p[1] )) // vertex
+      {
+         T x = 0., y = 0., z = 0.;
+
+         p = parseReal( skipBlanks( p+2, end ), end, x );
+         p = parseReal( skipBlanks( p,   end ), end, y );
+         p = parseReal( skipBlanks( p,   end ), end, z );
+
+         chunk.vertices.push_back( Quaternion<T>( 0., x, y, z ));
+      }
+      else if( end-p > 2 && p[0] == 'v' && p[1] == 't' && isBlank( p[2] )) // texture coordinate
+      {
+         T u = 0., v = 0.;
+
+         p = parseReal( skipBlanks( p+3, end ), end, u );
+         p = parseReal( skipBlanks( p,   end ), end, v );
+
+         chunk.uv.push_back( Vector<T>( u, v, 0. ));
+      }
+      else if( end-p > 1 && p[0] == 'f' && isBlank( p[1] )) // face
+      {
+         int I[6];
+         int i;
+
+         // iterate over corners (v, v/vt, v/vt/vn or v//vn)
+         p += 2;
+         for( i = 0; i < 3; i++ )
+         {
+            const char* q = skipBlanks( p, end );
+            p = parseInt( q, end, I[2*i+0] );
+            if( p == q ) break;
+
+            I[2*i+1] = noIndex;
+            if( p != end && *p == '/' )
+            {
+               p = parseInt( p+1, end, I[2*i+1] );
+               while( p != end && !isBlank( *p ) && *p != '\n' ) p++; // skip normal index
+            }
+         }
+
+         if( i == 3 )
+         {
+            // convert to 0-based indices; negative indices count back from
+            // the most recent record and get the chunk offset added later
+            int nV = chunk.vertices.size();
+            int nT = chunk.uv.size();
+            for( int j = 0; j < 6; j++ )
+            {
+               if( I[j] == noIndex ) continue;
+
+               if( I[j] < 0 )
+               {
+                  I[j] += ( j%2 == 0 ? nV : nT );
+                  chunk.relative.push_back( chunk.corners.size() + j );
+               }
+               else
+               {
+                  I[j] -= 1;
+               }
+            }
+            chunk.corners.insert( chunk.corners.end(), I, I+6 );
+         }
+      }
+
+      p = skipLine( p, end );
+   }
+}
+
+template <class T>
+bool Mesh<T> :: read( const string& filename )
 // loads a triangle mesh in Wavefront OBJ format
 {
-   // open mesh file
-   ifstream in( filename.c_str() );
-   if( !in.is_open() )
+   ScopedTimer timer( "read" );
+
+   // map mesh file into memory
+   MappedFile in;
+   if( !in.open( filename ))
    {
       cerr << "Error: couldn't open file ";
       cerr << filename;
       cerr << " for input!" << endl;
-      exit( 1 );
+      return false;
    }
 
-   // temporary list of vertex coordinates
-   vector<Vector> uv;
+   clearOperators();
 
-   // parse mesh file
-   string s;
-   while( getline( in, s ))
+   // take the mesh from the binary cache if it was built from this exact
+   // file, otherwise parse the OBJ and (re)write the cache
+   unsigned long long hash = 0;
+   string cacheName = filename + ( sizeof(T) == sizeof(float) ? ".float.cache" : ".double.cache" );
+   if( useCache )
    {
-      stringstream line( s );
-      string token;
+      hash = hashBytes( in.data(), in.size() );
+   }
 
-      line >> token;
+   if( !useCache || !readCache( cacheName, hash, in.size() ))
+   {
+      if( !readObj( in, filename ))
+      {
+         return false;
+      }
+      buildGeometry();
 
-      if( token == "v" ) // vertex
+      if( useCache )
       {
-         float x, y, z;
+         if( cacheOperators )
+         {
+            buildLaplacian();
+         }
+         writeCache( cacheName, hash, in.size() );
+      }
+   }
 
-         line >> x >> y >> z;
+   allocateAttributes();
+   return true;
+}
 
-         vertices.push_back( Quaternion( 0., x, y, z ));
-         newVertices.push_back( Quaternion( 0., x, y, z ));
-      }
-      if( token == "vt" ) // texture coordinate
+template <class T>
+void Mesh<T> :: initialize( void )
+// sets up a mesh whose vertices and faces were filled in directly
+{
+   ScopedTimer timer( "initialize" );
+
+   clearOperators();
+   buildGeometry();
+   allocateAttributes();
+}
+
+template <class T>
+void Mesh<T> :: clearOperators( void )
+// forgets everything derived from a previous geometry
+{
+   // copies of this mesh may still be using the old Laplacian
+   L.reset( new QuaternionMatrix<T>() );
+   laplacianBuilt = false;
+   pattern.clear();
+}
+
+template <class T>
+void Mesh<T> :: allocateAttributes( void )
+// allocates space for mesh attributes and resets the deformation
+{
+   newVertices = vertices;
+   lambda.resize( vertices.size() );
+   omega.resize( vertices.size() );
+   rho.assign( faces.size(), 0. );
+   solutionScale = 1.;
+   eigenvalueProblemBuilt = false;
+   eigenvalueKnown = false;
+   vertexFaceStart.clear();
+   vertexFaces.clear();
+   localIndex.clear();
+   normalizeSolution();
+}
+
+template <class T>
+bool Mesh<T> :: readObj( const MappedFile& in, const string& filename )
+// parses the mapped contents of an OBJ file into vertices and faces;
+// returns false if the file is malformed
+{
+   const char* begin = in.data();
+   const char* end = in.data() + in.size();
+
+   // split the file into chunks of whole lines, enough of them to
+   // keep every thread busy but no smaller than a megabyte
+   const size_t minChunkSize = 1 << 20;
+   int nThreads = 1;
+#ifdef _OPENMP
+   nThreads = omp_get_max_threads();
+#endif
+   size_t nChunks = max( (size_t) 1, min( in.size() / minChunkSize, (size_t) 4*nThreads ));
+
+   vector<const char*> chunkBegin( nChunks+1, end );
+   chunkBegin[0] = begin;
+   for( size_t c = 1; c < nChunks; c++ )
+   {
+      const char* p = max( chunkBegin[c-1], begin + c*(in.size()/nChunks) );
+      if( p != begin && p[-1] != '\n' )
       {
-         float u, v;
+         p = skipLine( p, end );
+      }
+      chunkBegin[c] = p;
+   }
+
+   // parse chunks independently
+   vector< ObjChunk<T> > chunks( nChunks );
+   #pragma omp parallel for schedule(dynamic)
+   for( int c = 0; c < (int) nChunks; c++ )
+   {
+      ScopedTimer timer( "parse obj chunk" );
+      parseObjChunk( chunkBegin[c], chunkBegin[c+1], chunks[c] );
+   }
+
+   // offsets of each chunk's records in the stitched lists
+   vector<size_t> vOffset( nChunks+1, 0 );
+   vector<size_t> tOffset( nChunks+1, 0 );
+   vector<size_t> fOffset( nChunks+1, 0 );
+   for( size_t c = 0; c < nChunks; c++ )
+   {
+      vOffset[c+1] = vOffset[c] + chunks[c].vertices.size();
+      tOffset[c+1] = tOffset[c] + chunks[c].uv.size();
+      fOffset[c+1] = fOffset[c] + chunks[c].corners.size() / 6;
+   }
 
-         line >> u >> v;
+   // stitch vertices and texture coordinates in file order
+   vector< Vector<T> > uv( tOffset[nChunks] );
+   vertices.resize( vOffset[nChunks] );
+   faces.resize( fOffset[nChunks] );
 
-         uv.push_back( Vector( u, v, 0. ));
+   #pragma omp parallel for schedule(dynamic)
+   for( int c = 0; c < (int) nChunks; c++ )
+   {
+      copy( chunks[c].vertices.begin(), chunks[c].vertices.end(), vertices.begin() + vOffset[c] );
+      copy( chunks[c].uv.begin(), chunks[c].uv.end(), uv.begin() + tOffset[c] );
+   }
+
+   // resolve face indices
+   int nV = vertices.size();
+   int nT = uv.size();
+   bool valid = true;
+
+   #pragma omp parallel for schedule(dynamic) reduction(&&:valid)
+   for( int c = 0; c < (int) nChunks; c++ )
+   {
+      vector<int>& corners( chunks[c].corners );
+      for( size_t k = 0; k < chunks[c].relative.size(); k++ )
+      {
+         size_t j = chunks[c].relative[k];
+         corners[j] += ( j%2 == 0 ? vOffset[c] : tOffset[c] );
       }
-      else if( token == "f" ) // face
+
+      for( size_t k = 0; k < corners.size() / 6; k++ )
       {
-         Face triangle;
+         Face<T>& triangle( faces[ fOffset[c] + k ] );
 
-         // iterate over vertices
          for( int i = 0; i < 3; i++ )
          {
-            line >> s;
-            stringstream item( s );
-
-            int I[3] = { -1, -1, -1 };
+            int v = corners[ 6*k + 2*i + 0 ];
+            int t = corners[ 6*k + 2*i + 1 ];
 
-            // iterate over v, vt, and vn indices
-            for( int j = 0; getline( item, s, '/' ) && j < 3; j++ )
+            if( v < 0 || v >= nV )
             {
-               stringstream index( s );
-               index >> I[j];
+               valid = false;
+               v = 0;
             }
+            triangle.vertex[i] = v;
 
-            triangle.vertex[i] = I[0]-1;
-
-            if( I[1] != -1 )
+            if( t != noIndex )
             {
-               triangle.uv[i] = uv[ I[1]-1 ];
+               if( t < 0 || t >= nT )
+               {
+                  valid = false;
+                  continue;
+               }
+               triangle.uv[i] = uv[t];
             }
          }
+      }
+   }
+
+   if( !valid )
+   {
+      cerr << "Error: file " << filename << " references a vertex or texture coordinate that does not exist!" << endl;
+      return false;
+   }
+
+   if( faces.empty() )
+   {
+      cerr << "Error: file " << filename << " has no faces!" << endl;
+      return false;
+   }
+
+   return true;
+}
+
+// BINARY CACHE ----------------------------------------------------------------
+//
+// The cache stores a parsed mesh as flat arrays so that read() can skip the
+// OBJ parser.  It starts with a MeshCacheHeader, followed by these sections,
+// each starting at a multiple of 64 bytes:
+//
+//    T   positions[3*nVertices]   x, y, z of each vertex
+//    int indices[3*nFaces]        vertex indices of each triangle
+//    T   uv[6*nFaces]             u, v of each triangle corner
+//
+// and, if nEntries is nonzero, the geometry-only operators:
+//
+//    T   areas[nFaces]            triangle areas
+//    T   cotans[3*nFaces]         corner cotangents
+//    int pattern[2*nEntries]      (column, row) of each Laplacian entry
+//    T   laplacian[nEntries]      Laplacian values in pattern order
+//
+// where the pattern covers only the upper triangle if the header says
+// "symmetric" (see Mesh::symmetricStorage).
+//
+// The cache is only used if its format, precision, and the size and content
+// hash of the OBJ file it was built from all match.
 
-         faces.push_back( triangle );
+class MeshCacheHeader
+// header of the binary mesh cache
+{
+   public:
+      char magic[8];                  // "SPXCACHE"
+      unsigned int version;           // format version
+      unsigned int scalarSize;        // size in bytes of the stored scalar type
+      unsigned long long sourceHash;  // content hash of the OBJ file
+      unsigned long long sourceSize;  // size of the OBJ file in bytes
+      unsigned long long nVertices;   // number of vertices
+      unsigned long long nFaces;      // number of triangles
+      unsigned long long nEntries;    // number of Laplacian entries (0 if not stored)
+      unsigned int symmetric;         // whether the entries are the upper triangle only
+};
+
+static const char cacheMagic[8] = { 'S', 'P', 'X', 'C', 'A', 'C', 'H', 'E' };
+static const unsigned int cacheVersion = 2;
+static const size_t cacheAlignment = 64;
+
+static size_t cacheSectionSize( size_t bytes )
+// rounds a section size up to the cache alignment
+{
+   return ( bytes + cacheAlignment-1 ) / cacheAlignment * cacheAlignment;
+}
+
+template <class S>
+static void writeCacheSection( ostream& out, const S* data, size_t count )
+// writes an array followed by padding up to the cache alignment
+{
+   static const char padding[cacheAlignment] = { 0 };
+   size_t bytes = count*sizeof(S);
+
+   out.write( (const char*) data, bytes );
+   out.write( padding, cacheSectionSize( bytes ) - bytes );
+}
+
+template <class T>
+bool Mesh<T> :: readCache( const string& cacheName, unsigned long long hash, size_t sourceSize )
+// loads the mesh from a binary cache; returns false if there is no valid
+// cache for the given source file
+{
+   MappedFile in;
+   if( !in.open( cacheName ) || in.size() < sizeof(MeshCacheHeader) )
+   {
+      return false;
+   }
+
+   MeshCacheHeader header;
+   memcpy( &header, in.data(), sizeof(MeshCacheHeader) );
+
+   if( memcmp( header.magic, cacheMagic, sizeof(cacheMagic) ) != 0 ||
+       header.version != cacheVersion ||
+       header.scalarSize != sizeof(T) ||
+       header.sourceHash != hash ||
+       header.sourceSize != sourceSize )
+   {
+      return false;
+   }
+
+   size_t nV = header.nVertices;
+   size_t nF = header.nFaces;
+   size_t nE = header.nEntries;
+   size_t expectedSize = cacheSectionSize( sizeof(MeshCacheHeader) ) +
+                         cacheSectionSize( 3*nV*sizeof(T) ) +
+                         cacheSectionSize( 3*nF*sizeof(int) ) +
+                         cacheSectionSize( 6*nF*sizeof(T) );
+   if( nE != 0 )
+   {
+      expectedSize += cacheSectionSize( nF*sizeof(T) ) +
+                      cacheSectionSize( 3*nF*sizeof(T) ) +
+                      cacheSectionSize( 2*nE*sizeof(int) ) +
+                      cacheSectionSize( nE*sizeof(T) );
+   }
+   if( in.size() != expectedSize )
+   {
+      return false;
+   }
+
+   // sections are aligned, so they can be read in place
+   const char* p = in.data() + cacheSectionSize( sizeof(MeshCacheHeader) );
+
+   const T* positions = (const T*) p;   p += cacheSectionSize( 3*nV*sizeof(T) );
+   const int* indices = (const int*) p; p += cacheSectionSize( 3*nF*sizeof(int) );
+   const T* uv = (const T*) p;          p += cacheSectionSize( 6*nF*sizeof(T) );
+
+   // a damaged cache with the right size must not send us out of bounds;
+   // the caller parses the OBJ instead
+   if( nF == 0 )
+   {
+      return false;
+   }
+   for( size_t k = 0; k < 3*nF; k++ )
+   {
+      if( indices[k] < 0 || (size_t) indices[k] >= nV ) return false;
+   }
+
+   vertices.resize( nV );
+   for( size_t i = 0; i < nV; i++ )
+   {
+      vertices[i] = Quaternion<T>( 0., positions[3*i+0], positions[3*i+1], positions[3*i+2] );
+   }
+
+   faces.resize( nF );
+   for( size_t i = 0; i < nF; i++ )
+   {
+      for( int j = 0; j < 3; j++ )
+      {
+         faces[i].vertex[j] = indices[3*i+j];
+         faces[i].uv[j] = Vector<T>( uv[6*i+2*j+0], uv[6*i+2*j+1], 0. );
       }
    }
 
-   // allocate space for mesh attributes
-   lambda.resize( vertices.size() );
-   omega.resize( vertices.size() );
-   rho.resize( faces.size() );
-   normalizeSolution();
+   // operators stored in a different mode are rebuilt
+   if( nE == 0 || ( header.symmetric != 0 ) != halfStorage() )
+   {
+      buildGeometry();
+      return true;
+   }
+
+   const T* cachedAreas = (const T*) p;  p += cacheSectionSize( nF*sizeof(T) );
+   const T* cachedCotans = (const T*) p; p += cacheSectionSize( 3*nF*sizeof(T) );
+   const int* entries = (const int*) p;  p += cacheSectionSize( 2*nE*sizeof(int) );
+   const T* laplacian = (const T*) p;
+
+   // setEntries() needs valid (column, row) pairs in strictly increasing
+   // storage order
+   for( size_t k = 0; k < nE; k++ )
+   {
+      int col = entries[2*k+0], row = entries[2*k+1];
+      if( col < 0 || (size_t) col >= nV || row < 0 || (size_t) row >= nV ||
+          ( halfStorage() && row > col ) ||
+          ( k > 0 && make_pair( col, row ) <= make_pair( entries[2*k-2], entries[2*k-1] )))
+      {
+         buildGeometry();
+         return true;
+      }
+   }
+
+   areas.assign( cachedAreas, cachedAreas + nF );
+   cotans.assign( cachedCotans, cachedCotans + 3*nF );
+
+   pattern.resize( nE );
+   vector< Quaternion<T> > values( nE );
+   for( size_t k = 0; k < nE; k++ )
+   {
+      pattern[k] = typename QuaternionMatrix<T>::EntryIndex( entries[2*k+0], entries[2*k+1] );
+      values[k] = laplacian[k];
+   }
+
+   L->setSymmetric( halfStorage() );
+   L->resize( nV, nV );
+   L->setEntries( pattern, values );
+   laplacianBuilt = true;
+
+   return true;
 }
 
-void Mesh :: write( const string& filename )
-// saves a triangle mesh in Wavefront OBJ format
+template <class T>
+void Mesh<T> :: writeCache( const string& cacheName, unsigned long long hash, size_t sourceSize )
+// writes the mesh (and, if built, the geometry-only operators) to a binary
+// cache; the file is written under a unique temporary name and renamed into
+// place, so that concurrent readers never see a partial cache and concurrent
+// writers (e.g., farm processes reading the same OBJ) never share a file
 {
-   ofstream out( filename.c_str() );
+   vector<char> tempTemplate( cacheName.begin(), cacheName.end() );
+   const char suffix[] = ".XXXXXX";
+   tempTemplate.insert( tempTemplate.end(), suffix, suffix + sizeof(suffix) );
+   int fd = mkstemp( &tempTemplate[0] );
+   if( fd < 0 )
+   {
+      return; // e.g., read-only directory -- just run without a cache
+   }
+   fchmod( fd, 0644 ); // mkstemp() makes the file private
+   close( fd );
 
+   string tempName( &tempTemplate[0] );
+   ofstream out( tempName.c_str(), ios_base::binary | ios_base::trunc );
    if( !out.is_open() )
+   {
+      remove( tempName.c_str() );
+      return;
+   }
+
+   size_t nV = vertices.size();
+   size_t nF = faces.size();
+   size_t nE = laplacianBuilt ? pattern.size() : 0;
+
+   MeshCacheHeader header;
+   memset( &header, 0, sizeof(MeshCacheHeader) );
+   memcpy( header.magic, cacheMagic, sizeof(cacheMagic) );
+   header.version = cacheVersion;
+   header.scalarSize = sizeof(T);
+   header.sourceHash = hash;
+   header.sourceSize = sourceSize;
+   header.nVertices = nV;
+   header.nFaces = nF;
+   header.nEntries = nE;
+   header.symmetric = L->isSymmetric();
+   writeCacheSection( out, &header, 1 );
+
+   vector<T> positions( 3*nV );
+   for( size_t i = 0; i < nV; i++ )
+   {
+      positions[3*i+0] = vertices[i].im().x;
+      positions[3*i+1] = vertices[i].im().y;
+      positions[3*i+2] = vertices[i].im().z;
+   }
+   writeCacheSection( out, &positions[0], positions.size() );
+
+   vector<int> indices( 3*nF );
+   vector<T> uv( 6*nF );
+   for( size_t i = 0; i < nF; i++ )
+   {
+      for( int j = 0; j < 3; j++ )
+      {
+         indices[3*i+j] = faces[i].vertex[j];
+         uv[6*i+2*j+0] = faces[i].uv[j].x;
+         uv[6*i+2*j+1] = faces[i].uv[j].y;
+      }
+   }
+   writeCacheSection( out, &indices[0], indices.size() );
+   writeCacheSection( out, &uv[0], uv.size() );
+
+   if( nE != 0 )
+   {
+      vector< typename QuaternionMatrix<T>::EntryIndex > entryIndices;
+      vector< Quaternion<T> > values;
+      L->getEntries( entryIndices, values );
+
+      vector<int> entries( 2*nE );
+      vector<T> laplacian( nE );
+      for( size_t k = 0; k < nE; k++ )
+      {
+         entries[2*k+0] = entryIndices[k].first;
+         entries[2*k+1] = entryIndices[k].second;
+         laplacian[k] = values[k].re();
+      }
+
+      writeCacheSection( out, &areas[0], areas.size() );
+      writeCacheSection( out, &cotans[0], cotans.size() );
+      writeCacheSection( out, &entries[0], entries.size() );
+      writeCacheSection( out, &laplacian[0], laplacian.size() );
+   }
+
+   out.close();
+   if( !out.good() || rename( tempName.c_str(), cacheName.c_str() ) != 0 )
+   {
+      remove( tempName.c_str() );
+   }
+}
+
+template <class T>
+void Mesh<T> :: write( const string& filename )
+// saves a triangle mesh in binary PLY format if filename ends in ".ply",
+// and in Wavefront OBJ format otherwise
+{
+   ScopedTimer timer( "write" );
+
+   BufferedFile out;
+
+   if( !out.open( filename ))
    {
       cerr << "Error: couldn't open file ";
       cerr << filename;
@@ -341,17 +1408,90 @@ void Mesh :: write( const string& filename )
       return;
    }
 
+   size_t n = filename.size();
+   if( n >= 4 && filename.compare( n-4, 4, ".ply" ) == 0 )
+   {
+      writePly( out );
+   }
+   else
+   {
+      writeObj( out );
+   }
+
+   if( !out.close() )
+   {
+      cerr << "Error: couldn't write file ";
+      cerr << filename << endl;
+   }
+}
+
+template <class T>
+void Mesh<T> :: writeObj( BufferedFile& out )
+// writes the deformed mesh as Wavefront OBJ text
+{
+   const size_t maxLineLength = 2 + 3*( maxFormattedLength + 1 );
+
+   for( size_t i = 0; i < vertices.size(); i++ )
+   {
+      char* p = out.reserve( maxLineLength );
+      *p++ = 'v';
+      *p++ = ' '; p = formatReal( p, newVertices[i].im().x );
+      *p++ = ' '; p = formatReal( p, newVertices[i].im().y );
+      *p++ = ' '; p = formatReal( p, newVertices[i].im().z );
+      *p++ = '\n';
+      out.commit( p );
+   }
+
+   for( size_t i = 0; i < faces.size(); i++ )
+   {
+      char* p = out.reserve( maxLineLength );
+      *p++ = 'f';
+      *p++ = ' '; p = formatInt( p, 1+faces[i].vertex[0] );
+      *p++ = ' '; p = formatInt( p, 1+faces[i].vertex[1] );
+      *p++ = ' '; p = formatInt( p, 1+faces[i].vertex[2] );
+      *p++ = '\n';
+      out.commit( p );
+   }
+}
+
+template <class T>
+void Mesh<T> :: writePly( BufferedFile& out )
+// writes the deformed mesh as binary little-endian PLY; vertex coordinates
+// are stored as "float" or "double" to match T, and each face as a list of
+// three int indices
+{
+   ostringstream header;
+   header << "ply\n"
+          << "format binary_little_endian 1.0\n"
+          << "element vertex " << vertices.size() << "\n"
+          << "property " << ( sizeof(T) == sizeof(double) ? "double" : "float" ) << " x\n"
+          << "property " << ( sizeof(T) == sizeof(double) ? "double" : "float" ) << " y\n"
+          << "property " << ( sizeof(T) == sizeof(double) ? "double" : "float" ) << " z\n"
+          << "element face " << faces.size() << "\n"
+          << "property list uchar int vertex_indices\n"
+          << "end_header\n";
+   string text = header.str();
+   out.write( text.data(), text.size() );
+
    for( size_t i = 0; i < vertices.size(); i++ )
    {
-      out << "v " << newVertices[i].im().x << " "
-                  << newVertices[i].im().y << " "
-                  << newVertices[i].im().z << endl;
+      char* p = out.reserve( 3*sizeof(T) );
+      p = storeLittleEndian( p, newVertices[i].im().x );
+      p = storeLittleEndian( p, newVertices[i].im().y );
+      p = storeLittleEndian( p, newVertices[i].im().z );
+      out.commit( p );
    }
 
    for( size_t i = 0; i < faces.size(); i++ )
    {
-      out << "f " << 1+faces[i].vertex[0] << " "
-                  << 1+faces[i].vertex[1] << " "
-                  << 1+faces[i].vertex[2] << endl;
+      char* p = out.reserve( 1 + 3*sizeof(int) );
+      *p++ = 3;
+      p = storeLittleEndian( p, faces[i].vertex[0] );
+      p = storeLittleEndian( p, faces[i].vertex[1] );
+      p = storeLittleEndian( p, faces[i].vertex[2] );
+      out.commit( p );
    }
 }
+
+template class Mesh<float>;
+template class Mesh<double>;
@@ -0,0 +1,393 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- MeshGenerator.cpp
+//
+
+#include <cmath>
+#include <unordered_map>
+#include "MeshGenerator.h"
+#include "BufferedFile.h"
+#include "Profiler.h"
+#include "Utility.h"
+
+template <class T>
+static Vector<T> sphereUv( const Vector<T>& p )
+// texture coordinates of a point on the unit sphere, matching uvSphere():
+// u = longitude / 2pi in [0,1), v = 1 at the north pole (y = 1)
+{
+   T u = atan2( -p.z, p.x ) / ( 2.*M_PI );
+   if( u < 0. ) u += 1.;
+   T v = 1. - acos( max( (T) -1., min( (T) 1., p.y ))) / M_PI;
+   return Vector<T>( u, v, 0. );
+}
+
+template <class T>
+static void fixSeam( Face<T>& face, const Vector<T> p[3] )
+// makes the u values of a face continuous: corners at a pole (where u is
+// undefined) take the mean of the others, and if the face straddles the
+// seam at u = 0, the small values are moved past 1
+{
+   const T poleTolerance = 1e-12;
+   bool pole[3];
+   T uMin = 1., uMax = 0.;
+   for( int j = 0; j < 3; j++ )
+   {
+      pole[j] = p[j].x*p[j].x + p[j].z*p[j].z < poleTolerance;
+      if( !pole[j] )
+      {
+         uMin = min( uMin, face.uv[j].x );
+         uMax = max( uMax, face.uv[j].x );
+      }
+   }
+
+   T uSum = 0.;
+   int nSum = 0;
+   for( int j = 0; j < 3; j++ )
+   {
+      if( pole[j] ) continue;
+      if( uMax - uMin > .5 && face.uv[j].x < .5 )
+      {
+         face.uv[j].x += 1.;
+      }
+      uSum += face.uv[j].x;
+      nSum++;
+   }
+
+   for( int j = 0; j < 3; j++ )
+   {
+      if( pole[j] && nSum > 0 )
+      {
+         face.uv[j].x = uSum / nSum;
+      }
+   }
+}
+
+template <class T>
+void MeshGenerator<T> :: uvSphere( Mesh<T>& mesh, int columns, int rows )
+// unit latitude-longitude sphere; 2*columns*(rows-1) faces
+{
+   ScopedTimer timer( "generate" );
+
+   int nu = max( 3, columns );
+   int nv = max( 2, rows );
+
+   // vertices: north pole, nv-1 rings of nu, south pole
+   mesh.vertices.clear();
+   mesh.vertices.reserve( 2 + (nv-1)*nu );
+   for( int j = 0; j <= nv; j++ )
+   {
+      int n = ( j == 0 || j == nv ) ? 1 : nu;
+      for( int i = 0; i < n; i++ )
+      {
+         T theta = M_PI * j / nv;
+         T phi = 2. * M_PI * i / nu;
+         mesh.vertices.push_back( Quaternion<T>( 0., sin( theta ) * cos( phi ),
+                                                     cos( theta ),
+                                                    -sin( theta ) * sin( phi )));
+      }
+   }
+
+   int south = 1 + (nv-1)*nu;
+   mesh.faces.clear();
+   mesh.faces.reserve( 2*nu*(nv-1) );
+   for( int j = 0; j < nv; j++ )
+   {
+      for( int i = 0; i < nu; i++ )
+      {
+         // corners (column, row) of the two triangles of quad (i,j); the
+         // pole rows have only one
+         int corners[2][3][2] =
+         {
+            { { i, j }, { i, j+1 }, { i+1, j+1 } },
+            { { i, j }, { i+1, j+1 }, { i+1, j } }
+         };
+
+         for( int t = 0; t < 2; t++ )
+         {
+            if( t == 0 && j == nv-1 ) continue;
+            if( t == 1 && j == 0 ) continue;
+
+            Face<T> face;
+            for( int c = 0; c < 3; c++ )
+            {
+               int ci = corners[t][c][0], cj = corners[t][c][1];
+               face.vertex[c] = cj == 0 ? 0 : cj == nv ? south : 1 + (cj-1)*nu + ci%nu;
+               face.uv[c] = Vector<T>( (T) ci / nu, 1. - (T) cj / nv, 0. );
+            }
+            mesh.faces.push_back( face );
+         }
+      }
+   }
+
+   mesh.initialize();
+}
+
+template <class T>
+void MeshGenerator<T> :: icosphere( Mesh<T>& mesh, int subdivisions )
+// unit sphere from a subdivided icosahedron; 20*4^subdivisions faces
+{
+   ScopedTimer timer( "generate" );
+
+   const T t = ( 1. + sqrt( 5. )) / 2.;
+   const T icosahedronVertices[12][3] =
+   {
+      { -1.,  t,  0. }, {  1.,  t,  0. }, { -1., -t,  0. }, {  1., -t,  0. },
+      {  0., -1.,  t }, {  0.,  1.,  t }, {  0., -1., -t }, {  0.,  1., -t },
+      {  t,  0., -1. }, {  t,  0.,  1. }, { -t,  0., -1. }, { -t,  0.,  1. }
+   };
+   const int icosahedronFaces[20][3] =
+   {
+      { 0, 11,  5 }, { 0,  5,  1 }, {  0,  1,  7 }, {  0,  7, 10 }, { 0, 10, 11 },
+      { 1,  5,  9 }, { 5, 11,  4 }, { 11, 10,  2 }, { 10,  7,  6 }, { 7,  1,  8 },
+      { 3,  9,  4 }, { 3,  4,  2 }, {  3,  2,  6 }, {  3,  6,  8 }, { 3,  8,  9 },
+      { 4,  9,  5 }, { 2,  4, 11 }, {  6,  2, 10 }, {  8,  6,  7 }, { 9,  8,  1 }
+   };
+
+   vector< Vector<T> > positions;
+   for( int i = 0; i < 12; i++ )
+   {
+      Vector<T> p( icosahedronVertices[i][0], icosahedronVertices[i][1], icosahedronVertices[i][2] );
+      positions.push_back( p / p.norm() );
+   }
+
+   vector<int> triangles;
+   for( int i = 0; i < 20; i++ )
+   {
+      triangles.insert( triangles.end(), icosahedronFaces[i], icosahedronFaces[i]+3 );
+   }
+
+   // split every triangle into four, sharing the new vertex on each edge
+   // between the two triangles that contain it
+   for( int level = 0; level < max( 0, subdivisions ); level++ )
+   {
+      size_t nF = triangles.size() / 3;
+      unordered_map<unsigned long long,int> midpoints;
+      midpoints.reserve( 3*nF/2 );
+
+      vector<int> split;
+      split.reserve( 4*triangles.size() );
+      for( size_t f = 0; f < nF; f++ )
+      {
+         int a[3], m[3];
+         for( int j = 0; j < 3; j++ )
+         {
+            a[j] = triangles[3*f+j];
+         }
+
+         for( int j = 0; j < 3; j++ )
+         {
+            int v0 = a[j], v1 = a[(j+1)%3];
+            unsigned long long key = (unsigned long long) min( v0, v1 ) << 32 | (unsigned) max( v0, v1 );
+            auto inserted = midpoints.insert( make_pair( key, (int) positions.size() ));
+            if( inserted.second )
+            {
+               Vector<T> p = positions[v0] + positions[v1];
+               positions.push_back( p / p.norm() );
+            }
+            m[j] = inserted.first->second;
+         }
+
+         const int children[12] = { a[0], m[0], m[2],
+                                    a[1], m[1], m[0],
+                                    a[2], m[2], m[1],
+                                    m[0], m[1], m[2] };
+         split.insert( split.end(), children, children+12 );
+      }
+      triangles.swap( split );
+   }
+
+   mesh.vertices.resize( positions.size() );
+   for( size_t i = 0; i < positions.size(); i++ )
+   {
+      mesh.vertices[i] = Quaternion<T>( 0., positions[i] );
+   }
+
+   int nF = triangles.size() / 3;
+   mesh.faces.resize( nF );
+
+   #pragma omp parallel for
+   for( int f = 0; f < nF; f++ )
+   {
+      Face<T>& face( mesh.faces[f] );
+      Vector<T> p[3];
+      for( int j = 0; j < 3; j++ )
+      {
+         face.vertex[j] = triangles[3*f+j];
+         p[j] = positions[ face.vertex[j] ];
+         face.uv[j] = sphereUv( p[j] );
+      }
+      fixSeam( face, p );
+   }
+
+   mesh.initialize();
+}
+
+template <class T>
+void MeshGenerator<T> :: torus( Mesh<T>& mesh, int columns, int rows, T minorRadius )
+// torus around the y axis with major radius 1; 2*columns*rows faces
+{
+   ScopedTimer timer( "generate" );
+
+   int nu = max( 3, columns );
+   int nv = max( 3, rows );
+
+   mesh.vertices.resize( nu*nv );
+   for( int i = 0; i < nu; i++ )
+   {
+      for( int j = 0; j < nv; j++ )
+      {
+         T phi = 2. * M_PI * i / nu;
+         T psi = 2. * M_PI * j / nv;
+         T r = 1. + minorRadius * cos( psi );
+         mesh.vertices[ i*nv + j ] = Quaternion<T>( 0., r * cos( phi ),
+                                                        minorRadius * sin( psi ),
+                                                       -r * sin( phi ));
+      }
+   }
+
+   // texture coordinates live on an (nu+1) x (nv+1) grid, so the last
+   // column and row of faces reach u = 1 and v = 1 instead of wrapping
+   mesh.faces.resize( 2*nu*nv );
+   for( int i = 0; i < nu; i++ )
+   {
+      for( int j = 0; j < nv; j++ )
+      {
+         int corners[2][3][2] =
+         {
+            { { i, j }, { i+1, j }, { i+1, j+1 } },
+            { { i, j }, { i+1, j+1 }, { i, j+1 } }
+         };
+
+         for( int t = 0; t < 2; t++ )
+         {
+            Face<T>& face( mesh.faces[ 2*( i*nv + j ) + t ] );
+            for( int c = 0; c < 3; c++ )
+            {
+               int ci = corners[t][c][0], cj = corners[t][c][1];
+               face.vertex[c] = ( ci % nu )*nv + cj % nv;
+               face.uv[c] = Vector<T>( (T) ci / nu, (T) cj / nv, 0. );
+            }
+         }
+      }
+   }
+
+   mesh.initialize();
+}
+
+template <class T>
+bool MeshGenerator<T> :: generate( Mesh<T>& mesh, const string& shape, int nFaces )
+// builds a shape at the resolution giving about nFaces faces
+{
+   nFaces = max( nFaces, 1 );
+
+   if( shape == "uvsphere" )
+   {
+      // 2*nu*(nv-1) faces with nu = 2*nv, which keeps the quads near the
+      // equator square
+      int rows = max( 2, (int) lround( .5 + sqrt( .25 + nFaces/4. )));
+      uvSphere( mesh, 2*rows, rows );
+   }
+   else if( shape == "icosphere" )
+   {
+      int subdivisions = max( 0, (int) lround( log( nFaces/20. ) / log( 4. )));
+      icosphere( mesh, subdivisions );
+   }
+   else if( shape == "torus" )
+   {
+      // 2*nu*nv faces with nu = 2*nv, matching the radii 1 and 1/2
+      int rows = max( 3, (int) lround( sqrt( nFaces/4. )));
+      torus( mesh, 2*rows, rows, .5 );
+   }
+   else
+   {
+      return false;
+   }
+
+   return true;
+}
+
+template <class T>
+bool MeshGenerator<T> :: writeObj( const Mesh<T>& mesh, const string& filename )
+// saves the original mesh with texture coordinates in Wavefront OBJ format
+{
+   BufferedFile out;
+   if( !out.open( filename ))
+   {
+      return false;
+   }
+
+   const size_t maxLineLength = 3 + 3*( maxFormattedLength + 1 ) + 6;
+   int nV = mesh.vertices.size();
+   int nF = mesh.faces.size();
+
+   for( int i = 0; i < nV; i++ )
+   {
+      const Vector<T>& p( mesh.vertices[i].im() );
+      char* c = out.reserve( maxLineLength );
+      *c++ = 'v';
+      *c++ = ' '; c = formatReal( c, p.x );
+      *c++ = ' '; c = formatReal( c, p.y );
+      *c++ = ' '; c = formatReal( c, p.z );
+      *c++ = '\n';
+      out.commit( c );
+   }
+
+   // corners of a vertex usually agree on their texture coordinates, so
+   // each distinct (vertex, uv) pair is written once: the pairs of vertex
+   // v form a list starting at first[v] and linked through next
+   vector<int> first( nV, -1 ), next;
+   vector< Vector<T> > uv;
+   vector<int> corners( 3*nF );
+   for( int f = 0; f < nF; f++ )
+   {
+      for( int j = 0; j < 3; j++ )
+      {
+         int v = mesh.faces[f].vertex[j];
+         const Vector<T>& t( mesh.faces[f].uv[j] );
+
+         int k = first[v], last = -1;
+         while( k != -1 && ( uv[k].x != t.x || uv[k].y != t.y ))
+         {
+            last = k;
+            k = next[k];
+         }
+         if( k == -1 )
+         {
+            k = uv.size();
+            uv.push_back( t );
+            next.push_back( -1 );
+            if( last == -1 ) first[v] = k;
+            else next[last] = k;
+         }
+         corners[3*f+j] = k;
+      }
+   }
+
+   for( size_t k = 0; k < uv.size(); k++ )
+   {
+      char* c = out.reserve( maxLineLength );
+      *c++ = 'v'; *c++ = 't';
+      *c++ = ' '; c = formatReal( c, uv[k].x );
+      *c++ = ' '; c = formatReal( c, uv[k].y );
+      *c++ = '\n';
+      out.commit( c );
+   }
+
+   for( int f = 0; f < nF; f++ )
+   {
+      char* c = out.reserve( maxLineLength + 3*( maxFormattedLength + 1 ));
+      *c++ = 'f';
+      for( int j = 0; j < 3; j++ )
+      {
+         *c++ = ' '; c = formatInt( c, 1 + mesh.faces[f].vertex[j] );
+         *c++ = '/'; c = formatInt( c, 1 + corners[3*f+j] );
+      }
+      *c++ = '\n';
+      out.commit( c );
+   }
+
+   return out.close();
+}
+
+template class MeshGenerator<float>;
+template class MeshGenerator<double>;
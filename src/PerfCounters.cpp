@@ -0,0 +1,127 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- PerfCounters.cpp
+//
+
+#include "PerfCounters.h"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const unsigned long long events[PerfCounters::count] =
+// hardware events counted, in the order of PerfCounters::Counter
+{
+   PERF_COUNT_HW_CPU_CYCLES,
+   PERF_COUNT_HW_INSTRUCTIONS,
+   PERF_COUNT_HW_CACHE_MISSES,
+   PERF_COUNT_HW_BRANCH_MISSES
+};
+
+PerfCounters :: PerfCounters( void )
+{
+   for( int i = 0; i < count; i++ )
+   {
+      fd[i] = -1;
+   }
+}
+
+PerfCounters :: ~PerfCounters( void )
+{
+   close();
+}
+
+bool PerfCounters :: open( void )
+// starts counting on the calling thread; returns false if the counters are
+// unavailable
+{
+   close();
+
+   for( int i = 0; i < count; i++ )
+   {
+      perf_event_attr attr;
+      memset( &attr, 0, sizeof(attr) );
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = events[i];
+      attr.disabled = ( i == 0 ); // the group starts when its leader is enabled
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP |
+                         PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fd[i] = syscall( __NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fd[0], 0 );
+      if( fd[i] < 0 )
+      {
+         close();
+         return false;
+      }
+   }
+
+   if( ioctl( fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP ) != 0 )
+   {
+      close();
+      return false;
+   }
+
+   return true;
+}
+
+bool PerfCounters :: read( unsigned long long values[count] ) const
+// stores the current counts; returns false on failure
+{
+   if( fd[0] < 0 )
+   {
+      return false;
+   }
+
+   // layout for PERF_FORMAT_GROUP with both times: nr, time_enabled,
+   // time_running, then one value per counter
+   unsigned long long data[3+count];
+   if( ::read( fd[0], data, sizeof(data) ) != (ssize_t) sizeof(data) || data[0] != count )
+   {
+      return false;
+   }
+
+   // scale up if the group only ran for part of the time it was enabled
+   double scale = 1.;
+   if( data[2] > 0 && data[2] < data[1] )
+   {
+      scale = (double) data[1] / data[2];
+   }
+
+   for( int i = 0; i < count; i++ )
+   {
+      values[i] = (unsigned long long)( scale * data[3+i] );
+   }
+   return true;
+}
+
+const char* PerfCounters :: name( int counter )
+// returns the name of a counter as used in reports
+{
+   static const char* names[count] =
+   {
+      "cycles",
+      "instructions",
+      "llc_misses",
+      "branch_misses"
+   };
+
+   return names[counter];
+}
+
+void PerfCounters :: close( void )
+// stops counting
+{
+   for( int i = count-1; i >= 0; i-- )
+   {
+      if( fd[i] >= 0 )
+      {
+         ::close( fd[i] );
+         fd[i] = -1;
+      }
+   }
+}
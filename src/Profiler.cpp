@@ -0,0 +1,508 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- Profiler.cpp
+//
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+class PhaseRecord
+// accumulated timings of one phase
+{
+   public:
+      const char* name;
+      int calls;
+      double total, min, max; // seconds
+      int counted; // calls that also measured hardware counters
+      unsigned long long counters[PerfCounters::count]; // totals over those calls
+      int measured; // calls that also measured heap activity
+      PhaseMemory memory; // totals (peakBytes: maximum) over those calls
+};
+
+class SolveRecord
+// one linear solve
+{
+   public:
+      const char* name;
+      double start, duration; // seconds
+      int iterations;
+      double residual;
+      bool converged;
+      double spmvBytes; // traffic of one matrix-vector product
+};
+
+class TraceEvent
+// one interval on the timeline
+{
+   public:
+      const char* name;
+      double start, duration; // seconds
+      int thread; // index of the recording thread
+      int iteration; // solver iteration (-1 for phases)
+      double residual; // solver residual after that iteration
+      atomic<size_t> sequence; // 1 + number of the event stored here (0: none)
+};
+
+enum
+{
+   profilingFlag = 1,
+   tracingFlag = 2,
+   countersFlag = 4
+};
+
+static atomic<int> flags( 0 ); // what is being recorded
+static chrono::steady_clock::time_point epoch;
+
+static mutex recordMutex; // guards the lists below
+static vector<PhaseRecord> phases;
+static vector<SolveRecord> solves;
+
+static unique_ptr<TraceEvent[]> traceBuffer; // ring of traceCapacity events
+static size_t traceCapacity = 0;
+static atomic<size_t> traceCount( 0 ); // events ever claimed
+static atomic<int> threadCount( 0 ); // threads that have traced so far
+static thread_local int threadIndex = -1;
+
+static thread_local PerfCounters* threadCounters = NULL; // opened on first use
+static thread_local bool threadCountersFailed = false;
+
+static void startClock( void )
+// starts the clock when the first kind of recording is enabled
+{
+   if( flags.load() == 0 )
+   {
+      epoch = chrono::steady_clock::now();
+   }
+}
+
+static void appendEvent( const char* name, double start, double duration,
+                         int iteration, double residual )
+// stores an event in the next slot of the ring buffer
+{
+   if( threadIndex < 0 )
+   {
+      threadIndex = threadCount.fetch_add( 1, memory_order_relaxed );
+   }
+
+   // the sequence number is cleared while the slot is being filled, so
+   // that a dump skips an event overwritten while it reads it (see
+   // writeTrace()) rather than writing a torn one
+   size_t n = traceCount.fetch_add( 1, memory_order_relaxed );
+   TraceEvent& e( traceBuffer[ n % traceCapacity ] );
+   e.sequence.store( 0, memory_order_relaxed );
+   atomic_thread_fence( memory_order_release );
+   e.name = name;
+   e.start = start;
+   e.duration = duration;
+   e.thread = threadIndex;
+   e.iteration = iteration;
+   e.residual = residual;
+   e.sequence.store( n+1, memory_order_release );
+}
+
+void Profiler :: enable( void )
+// starts recording phase totals and solves
+{
+   lock_guard<mutex> lock( recordMutex );
+   startClock();
+   phases.clear();
+   solves.clear();
+   MemoryTracker::enable();
+   flags |= profilingFlag;
+}
+
+void Profiler :: enableTrace( size_t capacity )
+// starts recording a timeline of up to capacity events
+{
+   if( capacity == 0 || tracing() )
+   {
+      return;
+   }
+
+   traceBuffer.reset( new TraceEvent[ capacity ] );
+   for( size_t i = 0; i < capacity; i++ )
+   {
+      traceBuffer[i].sequence.store( 0, memory_order_relaxed );
+   }
+   traceCapacity = capacity;
+   traceCount = 0;
+
+   startClock();
+   flags |= tracingFlag;
+}
+
+bool Profiler :: enableCounters( void )
+// also records hardware counters per phase (once enable() has been called);
+// returns false if they are unavailable on this thread
+{
+   flags |= countersFlag;
+
+   unsigned long long values[PerfCounters::count];
+   if( !readCounters( values ))
+   {
+      flags &= ~countersFlag;
+      return false;
+   }
+   return true;
+}
+
+bool Profiler :: readCounters( unsigned long long values[PerfCounters::count] )
+// stores the hardware counters of the calling thread; returns false if
+// counters are off or unavailable
+{
+   if( !( flags.load( memory_order_relaxed ) & countersFlag ) || threadCountersFailed )
+   {
+      return false;
+   }
+
+   // each thread counts itself, so open its counters the first time it
+   // reads them (they are never closed, as threads live until exit)
+   if( threadCounters == NULL )
+   {
+      threadCounters = new PerfCounters();
+      if( !threadCounters->open() )
+      {
+         delete threadCounters;
+         threadCounters = NULL;
+         threadCountersFailed = true;
+         return false;
+      }
+   }
+
+   return threadCounters->read( values );
+}
+
+bool Profiler :: enabled( void )
+// returns whether timings are being recorded in any form
+{
+   return flags.load( memory_order_relaxed ) != 0;
+}
+
+bool Profiler :: tracing( void )
+// returns whether a timeline is being recorded
+{
+   return ( flags.load( memory_order_relaxed ) & tracingFlag ) != 0;
+}
+
+double Profiler :: now( void )
+// returns seconds since recording started
+{
+   return chrono::duration<double>( chrono::steady_clock::now() - epoch ).count();
+}
+
+void Profiler :: record( const char* name, double start, double duration,
+                         const unsigned long long* counters,
+                         const PhaseMemory* memory )
+// adds one call of phase name that began at time start (in seconds), along
+// with the change in hardware counters and the heap activity if given
+{
+   int f = flags.load( memory_order_relaxed );
+   if( f & tracingFlag )
+   {
+      appendEvent( name, start, duration, -1, 0. );
+   }
+   if( !( f & profilingFlag ))
+   {
+      return;
+   }
+
+   lock_guard<mutex> lock( recordMutex );
+
+   // there are only a few dozen phases, and names are string literals
+   for( size_t i = 0; i < phases.size(); i++ )
+   {
+      PhaseRecord& p( phases[i] );
+      if( strcmp( p.name, name ) == 0 )
+      {
+         p.calls++;
+         p.total += duration;
+         if( duration < p.min ) p.min = duration;
+         if( duration > p.max ) p.max = duration;
+         if( counters != NULL )
+         {
+            p.counted++;
+            for( int c = 0; c < PerfCounters::count; c++ )
+            {
+               p.counters[c] += counters[c];
+            }
+         }
+         if( memory != NULL )
+         {
+            p.measured++;
+            p.memory.allocations += memory->allocations;
+            p.memory.allocatedBytes += memory->allocatedBytes;
+            p.memory.netBytes += memory->netBytes;
+            p.memory.peakBytes = max( p.memory.peakBytes, memory->peakBytes );
+         }
+         return;
+      }
+   }
+
+   PhaseRecord p;
+   p.name = name;
+   p.calls = 1;
+   p.total = p.min = p.max = duration;
+   p.counted = ( counters != NULL );
+   for( int c = 0; c < PerfCounters::count; c++ )
+   {
+      p.counters[c] = counters != NULL ? counters[c] : 0;
+   }
+   p.measured = ( memory != NULL );
+   if( memory != NULL )
+   {
+      p.memory = *memory;
+   }
+   else
+   {
+      p.memory.allocations = p.memory.allocatedBytes = 0;
+      p.memory.netBytes = p.memory.peakBytes = 0;
+   }
+   phases.push_back( p );
+}
+
+void Profiler :: recordSolve( const char* name, double start, double duration,
+                              int iterations, double residual, bool converged,
+                              double spmvBytes )
+// adds one linear solve, along with the outcome reported by the solver and
+// the bytes moved by one of its matrix-vector products
+{
+   record( name, start, duration );
+   if( !( flags.load( memory_order_relaxed ) & profilingFlag ))
+   {
+      return;
+   }
+
+   SolveRecord s;
+   s.name = name;
+   s.start = start;
+   s.duration = duration;
+   s.iterations = iterations;
+   s.residual = residual;
+   s.converged = converged;
+   s.spmvBytes = spmvBytes;
+
+   lock_guard<mutex> lock( recordMutex );
+   solves.push_back( s );
+}
+
+bool Profiler :: write( const string& filename )
+// writes the JSON report to filename ("-" for standard output); returns
+// false on failure
+{
+   FILE* out = ( filename == "-" ) ? stdout : fopen( filename.c_str(), "w" );
+   if( out == NULL )
+   {
+      return false;
+   }
+
+   lock_guard<mutex> lock( recordMutex );
+
+   fprintf( out, "{\n   \"phases\": [" );
+   for( size_t i = 0; i < phases.size(); i++ )
+   {
+      const PhaseRecord& p( phases[i] );
+      fprintf( out, "%s\n      { \"name\": \"%s\", \"calls\": %d, \"total_ms\": %.6g, \"min_ms\": %.6g, \"max_ms\": %.6g",
+               i ? "," : "", p.name, p.calls, 1e3*p.total, 1e3*p.min, 1e3*p.max );
+      if( p.counted > 0 )
+      {
+         for( int c = 0; c < PerfCounters::count; c++ )
+         {
+            fprintf( out, ", \"%s\": %llu", PerfCounters::name( c ), p.counters[c] );
+         }
+         double cycles = p.counters[PerfCounters::cycles];
+         fprintf( out, ", \"ipc\": %.4g", cycles > 0. ? p.counters[PerfCounters::instructions] / cycles : 0. );
+      }
+      if( p.measured > 0 )
+      {
+         fprintf( out, ", \"alloc_count\": %llu, \"alloc_bytes\": %llu, \"peak_bytes\": %lld, \"net_bytes\": %lld",
+                  p.memory.allocations, p.memory.allocatedBytes, p.memory.peakBytes, p.memory.netBytes );
+      }
+      fprintf( out, " }" );
+   }
+   fprintf( out, "\n   ],\n   \"solves\": [" );
+   for( size_t i = 0; i < solves.size(); i++ )
+   {
+      const SolveRecord& s( solves[i] );
+      double bandwidth = s.duration > 0. ? s.iterations * s.spmvBytes / s.duration : 0.;
+      fprintf( out, "%s\n      { \"name\": \"%s\", \"start_ms\": %.6g, \"ms\": %.6g, \"iterations\": %d, \"residual\": %.6g, \"converged\": %s, \"spmv_bytes\": %.6g, \"spmv_gb_per_s\": %.4g }",
+               i ? "," : "", s.name, 1e3*s.start, 1e3*s.duration, s.iterations, s.residual, s.converged ? "true" : "false",
+               s.spmvBytes, 1e-9*bandwidth );
+   }
+   long long heapPeak = MemoryTracker::peakBytes(); // this thread's; its phases hand their peaks back up
+   fprintf( out, "\n   ],\n   \"memory\": { \"heap_bytes\": %lld, \"heap_peak_bytes\": %lld, \"alloc_count\": %llu, \"alloc_bytes\": %llu",
+            MemoryTracker::currentBytes(), heapPeak, MemoryTracker::allocations(), MemoryTracker::allocatedBytes() );
+   long long rss, peakRss;
+   if( MemoryTracker::readStatus( rss, peakRss ))
+   {
+      fprintf( out, ", \"rss_kb\": %lld, \"peak_rss_kb\": %lld", rss, peakRss );
+   }
+   fprintf( out, " }" );
+
+   // PerfCounters only counts the thread that opened it, so a phase's
+   // counters leave out the OpenMP workers of its parallel loops
+   bool counted = false;
+   for( size_t i = 0; i < phases.size(); i++ )
+   {
+      counted = counted || phases[i].counted > 0;
+   }
+   if( counted )
+   {
+      fprintf( out, ",\n   \"counter_scope\": \"calling thread\"" );
+   }
+   fprintf( out, "\n}\n" );
+
+   bool ok = !ferror( out );
+   if( out == stdout )
+   {
+      fflush( out );
+   }
+   else if( fclose( out ) != 0 )
+   {
+      ok = false;
+   }
+   return ok;
+}
+
+void Profiler :: trace( const char* name, double start, double duration,
+                        int iteration, double residual )
+// adds one solver iteration to the timeline only
+{
+   if( tracing() )
+   {
+      appendEvent( name, start, duration, iteration, residual );
+   }
+}
+
+bool Profiler :: writeTrace( const string& filename )
+// writes the timeline as Chrome trace JSON to filename; returns false on
+// failure
+{
+   if( !tracing() )
+   {
+      return true;
+   }
+
+   FILE* out = ( filename == "-" ) ? stdout : fopen( filename.c_str(), "w" );
+   if( out == NULL )
+   {
+      return false;
+   }
+
+   // "X" events are complete intervals with microsecond times; the
+   // metadata events name the threads
+   fprintf( out, "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n" );
+   bool comma = false;
+   int nThreads = threadCount.load();
+   for( int t = 0; t < nThreads; t++ )
+   {
+      fprintf( out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+               comma ? ",\n" : "", t, t );
+      comma = true;
+   }
+
+   size_t count = traceCount.load( memory_order_acquire );
+   size_t first = count > traceCapacity ? count - traceCapacity : 0;
+   for( size_t n = first; n < count; n++ )
+   {
+      const TraceEvent& e( traceBuffer[ n % traceCapacity ] );
+      if( e.sequence.load( memory_order_acquire ) != n+1 )
+      {
+         continue; // still being written (or already overwritten)
+      }
+
+      // a thread may reclaim the slot while it is being read, so copy the
+      // event and use the copy only if the sequence number is unchanged
+      // afterwards (the fence keeps the copy before the second load)
+      const char* name = e.name;
+      double start = e.start, duration = e.duration, residual = e.residual;
+      int thread = e.thread, iteration = e.iteration;
+      atomic_thread_fence( memory_order_acquire );
+      if( e.sequence.load( memory_order_relaxed ) != n+1 )
+      {
+         continue; // overwritten while being copied
+      }
+
+      fprintf( out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+               comma ? ",\n" : "", name, thread, 1e6*start, 1e6*duration );
+      if( iteration >= 0 )
+      {
+         fprintf( out, ",\"args\":{\"iteration\":%d,\"residual\":%.6g}", iteration, residual );
+      }
+      fprintf( out, "}" );
+      comma = true;
+   }
+   fprintf( out, "\n],\n\"otherData\": { \"events\": %zu, \"dropped\": %zu }\n}\n", count - first, first );
+
+   bool ok = !ferror( out );
+   if( out == stdout )
+   {
+      fflush( out );
+   }
+   else if( fclose( out ) != 0 )
+   {
+      ok = false;
+   }
+   return ok;
+}
+
+ScopedTimer :: ScopedTimer( const char* _name )
+: name( NULL ),
+  start( 0. ),
+  counting( false ),
+  threadBytes( 0 ),
+  outerPeak( 0 )
+{
+   if( Profiler::enabled() )
+   {
+      name = _name;
+      counting = Profiler::readCounters( counters );
+
+      // the peak restarts for this phase, and is handed back to the
+      // enclosing phases when it ends
+      memory.allocations = MemoryTracker::allocations();
+      memory.allocatedBytes = MemoryTracker::allocatedBytes();
+      memory.netBytes = MemoryTracker::currentBytes();
+      threadBytes = MemoryTracker::threadBytes();
+      outerPeak = MemoryTracker::resetPeak();
+
+      start = Profiler::now();
+   }
+}
+
+ScopedTimer :: ~ScopedTimer( void )
+{
+   if( name != NULL )
+   {
+      double end = Profiler::now();
+
+      PhaseMemory change;
+      change.allocations = MemoryTracker::allocations() - memory.allocations;
+      change.allocatedBytes = MemoryTracker::allocatedBytes() - memory.allocatedBytes;
+      change.netBytes = MemoryTracker::currentBytes() - memory.netBytes;
+      change.peakBytes = MemoryTracker::peakBytes() - threadBytes;
+      MemoryTracker::raisePeak( outerPeak );
+
+      unsigned long long after[PerfCounters::count];
+      if( counting && Profiler::readCounters( after ))
+      {
+         for( int c = 0; c < PerfCounters::count; c++ )
+         {
+            after[c] -= counters[c];
+         }
+         Profiler::record( name, start, end - start, after, &change );
+         return;
+      }
+
+      Profiler::record( name, start, end - start, NULL, &change );
+   }
+}
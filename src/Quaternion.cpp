@@ -18,51 +18,59 @@ using namespace std;
 
 // CONSTRUCTORS ----------------------------------------------------------
 
-Quaternion :: Quaternion( void )
+template <class T>
+Quaternion<T> :: Quaternion( void )
 // initializes all components to zero
 : s( 0. ),
   v( 0., 0., 0. )
 {}
 
-Quaternion :: Quaternion( const Quaternion& q )
+template <class T>
+Quaternion<T> :: Quaternion( const Quaternion& q )
 // initializes from existing quaternion
 : s( q.s ),
   v( q.v )
 {}
 
-Quaternion :: Quaternion( float s_, float vi, float vj, float vk )
+template <class T>
+Quaternion<T> :: Quaternion( T s_, T vi, T vj, T vk )
 // initializes with specified float (s) and imaginary (v) components
 : s( s_ ),
   v( vi, vj, vk )
 {}
 
-Quaternion :: Quaternion( float s_, const Vector& v_ )
+template <class T>
+Quaternion<T> :: Quaternion( T s_, const Vector<T>& v_ )
 // initializes with specified float(s) and imaginary (v) components
 : s( s_ ),
   v( v_ )
 {}
 
-Quaternion :: Quaternion( float s_ )
+template <class T>
+Quaternion<T> :: Quaternion( T s_ )
 : s( s_ )
 {}
 
-Quaternion :: Quaternion( const Vector& v_ )
+template <class T>
+Quaternion<T> :: Quaternion( const Vector<T>& v_ )
 : v( v_ )
 {}
 
 
 // ASSIGNMENT OPERATORS --------------------------------------------------
 
-const Quaternion& Quaternion :: operator=( float _s )
+template <class T>
+const Quaternion<T>& Quaternion<T> :: operator=( T _s )
 // assigns a purely real quaternion with real value s
 {
    s = _s;
-   v = Vector( 0., 0., 0. );
+   v = Vector<T>( 0., 0., 0. );
 
    return *this;
 }
 
-const Quaternion& Quaternion :: operator=( const Vector& _v )
+template <class T>
+const Quaternion<T>& Quaternion<T> :: operator=( const Vector<T>& _v )
 // assigns a purely real quaternion with imaginary value v
 {
    s = 0.;
@@ -74,19 +82,22 @@ const Quaternion& Quaternion :: operator=( const Vector& _v )
 
 // ACCESSORS -------------------------------------------------------------
 
-float& Quaternion::operator[]( int index )
+template <class T>
+T& Quaternion<T>::operator[]( int index )
 // returns reference to the specified component (0-based indexing: float, i, j, k)
 {
    return ( &s )[ index ];
 }
 
-const float& Quaternion::operator[]( int index ) const
+template <class T>
+const T& Quaternion<T>::operator[]( int index ) const
 // returns const reference to the specified component (0-based indexing: float, i, j, k)
 {
    return ( &s )[ index ];
 }
 
-void Quaternion::toMatrix( float Q[4][4] ) const
+template <class T>
+void Quaternion<T>::toMatrix( T Q[4][4] ) const
 // returns 4x4 matrix representation
 {
    Q[0][0] =   s; Q[0][1] = -v.x; Q[0][2] = -v.y; Q[0][3] = -v.z;
@@ -95,25 +106,29 @@ void Quaternion::toMatrix( float Q[4][4] ) const
    Q[3][0] = v.z; Q[3][1] = -v.y; Q[3][2] =  v.x; Q[3][3] =    s;
 }
 
-float& Quaternion::re( void )
+template <class T>
+T& Quaternion<T>::re( void )
 // returns reference to float part
 {
    return s;
 }
 
-const float& Quaternion::re( void ) const
+template <class T>
+const T& Quaternion<T>::re( void ) const
 // returns const reference to float part
 {
    return s;
 }
 
-Vector& Quaternion::im( void )
+template <class T>
+Vector<T>& Quaternion<T>::im( void )
 // returns reference to imaginary part
 {
    return v;
 }
 
-const Vector& Quaternion::im( void ) const
+template <class T>
+const Vector<T>& Quaternion<T>::im( void ) const
 // returns const reference to imaginary part
 {
    return v;
@@ -122,76 +137,88 @@ const Vector& Quaternion::im( void ) const
 
 // VECTOR SPACE OPERATIONS -----------------------------------------------
 
-Quaternion Quaternion::operator+( const Quaternion& q ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator+( const Quaternion& q ) const
 // addition
 {
    return Quaternion( s+q.s, v+q.v );
 }
 
-Quaternion Quaternion::operator-( const Quaternion& q ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator-( const Quaternion& q ) const
 // subtraction
 {
    return Quaternion( s-q.s, v-q.v );
 }
 
-Quaternion Quaternion::operator-( void ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator-( void ) const
 // negation
 {
    return Quaternion( -s, -v );
 }
 
-Quaternion Quaternion::operator*( float c ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator*( T c ) const
 // scalar multiplication
 {
    return Quaternion( s*c, v*c );
 }
 
-Quaternion operator*( float c, const Quaternion& q )
+template <class T>
+Quaternion<T> operator*( typename Quaternion<T>::ValueType c, const Quaternion<T>& q )
 // scalar multiplication
 {
    return q*c;
 }
 
-Quaternion Quaternion::operator/( float c ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator/( T c ) const
 // scalar division
 {
    return Quaternion( s/c, v/c );
 }
 
-void Quaternion::operator+=( const Quaternion& q )
+template <class T>
+void Quaternion<T>::operator+=( const Quaternion& q )
 // addition / assignment
 {
    s += q.s;
    v += q.v;
 }
 
-void Quaternion::operator+=( float c )
+template <class T>
+void Quaternion<T>::operator+=( T c )
 // addition / assignment of pure real
 {
    s += c;
 }
 
-void Quaternion::operator-=( const Quaternion& q )
+template <class T>
+void Quaternion<T>::operator-=( const Quaternion& q )
 // subtraction / assignment
 {
    s -= q.s;
    v -= q.v;
 }
 
-void Quaternion::operator-=( float c )
+template <class T>
+void Quaternion<T>::operator-=( T c )
 // subtraction / assignment of pure real
 {
    s -= c;
 }
 
-void Quaternion::operator*=( float c )
+template <class T>
+void Quaternion<T>::operator*=( T c )
 // scalar multiplication / assignment
 {
    s *= c;
    v *= c;
 }
 
-void Quaternion::operator/=( float c )
+template <class T>
+void Quaternion<T>::operator/=( T c )
 // scalar division / assignment
 {
    s /= c;
@@ -201,30 +228,34 @@ void Quaternion::operator/=( float c )
 
 // ALGEBRAIC OPERATIONS --------------------------------------------------
 
-Quaternion Quaternion::operator*( const Quaternion& q ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator*( const Quaternion& q ) const
 // Hamilton product
 {
-   const float& s1( s );
-   const float& s2( q.s );
-   const Vector& v1( v );
-   const Vector& v2( q.v );
+   const T& s1( s );
+   const T& s2( q.s );
+   const Vector<T>& v1( v );
+   const Vector<T>& v2( q.v );
 
    return Quaternion( s1*s2 - v1*v2, s1*v2 + s2*v1 + (v1^v2) );
 }
 
-void Quaternion::operator*=( const Quaternion& q )
+template <class T>
+void Quaternion<T>::operator*=( const Quaternion& q )
 // Hamilton product / assignment
 {
    *this = ( *this * q );
 }
 
-Quaternion Quaternion::operator~( void ) const
+template <class T>
+Quaternion<T> Quaternion<T>::operator~( void ) const
 // conjugation
 {
    return Quaternion( s, -v );
 }
 
-Quaternion Quaternion::inv( void ) const
+template <class T>
+Quaternion<T> Quaternion<T>::inv( void ) const
 {
    return ( ~( *this )) / this->norm2();
 }
@@ -232,25 +263,29 @@ Quaternion Quaternion::inv( void ) const
 
 // NORMS -----------------------------------------------------------------
 
-float Quaternion::norm( void ) const
+template <class T>
+T Quaternion<T>::norm( void ) const
 // returns Euclidean length
 {
    return sqrt( s*s + v.x*v.x + v.y*v.y + v.z*v.z );
 }
 
-float Quaternion::norm2( void ) const
+template <class T>
+T Quaternion<T>::norm2( void ) const
 // returns Euclidean length squared
 {
    return s*s + v*v;
 }
 
-Quaternion Quaternion::unit( void ) const
+template <class T>
+Quaternion<T> Quaternion<T>::unit( void ) const
 // returns unit quaternion
 {
    return *this / norm();
 }
 
-void Quaternion::normalize( void )
+template <class T>
+void Quaternion<T>::normalize( void )
 // divides by Euclidean length
 {
    *this /= norm();
@@ -259,19 +294,20 @@ void Quaternion::normalize( void )
 
 // GEOMETRIC OPERATIONS --------------------------------------------------
 
-Quaternion slerp( const Quaternion& q0, const Quaternion& q1, float t )
+template <class T>
+Quaternion<T> slerp( const Quaternion<T>& q0, const Quaternion<T>& q1, T t )
 // spherical-linear interpolation
 {
    // interpolate length
-   float m0 = q0.norm();
-   float m1 = q1.norm();
-   float m = (1-t)*m0 + t*m1;
+   T m0 = q0.norm();
+   T m1 = q1.norm();
+   T m = (1-t)*m0 + t*m1;
 
    // interpolate direction
-   Quaternion p0 = q0 / m0;
-   Quaternion p1 = q1 / m1;
-   float theta = acos(( (~p0)*p1 ).re() );
-   Quaternion p = ( sin((1-t)*theta)*p0 + sin(t*theta)*p1 )/sin(theta);
+   Quaternion<T> p0 = q0 / m0;
+   Quaternion<T> p1 = q1 / m1;
+   T theta = acos(( (~p0)*p1 ).re() );
+   Quaternion<T> p = ( sin((1-t)*theta)*p0 + sin(t*theta)*p1 )/sin(theta);
 
    return m*p;
 }
@@ -279,7 +315,8 @@ Quaternion slerp( const Quaternion& q0, const Quaternion& q1, float t )
 
 // I/O -------------------------------------------------------------------------
 
-std::ostream& operator<<( std::ostream& os, const Quaternion& q )
+template <class T>
+std::ostream& operator<<( std::ostream& os, const Quaternion<T>& q )
 // prints components
 {
    os << "( " << q.re() << ", " << q.im() << " )";
@@ -287,3 +324,17 @@ std::ostream& operator<<( std::ostream& os, const Quaternion& q )
    return os;
 }
 
+
+// EXPLICIT INSTANTIATIONS -----------------------------------------------------
+
+template class Quaternion<float>;
+template class Quaternion<double>;
+
+template Quaternion<float>  operator*( float  c, const Quaternion<float>&  q );
+template Quaternion<double> operator*( double c, const Quaternion<double>& q );
+
+template Quaternion<float>  slerp( const Quaternion<float>&  q0, const Quaternion<float>&  q1, float  t );
+template Quaternion<double> slerp( const Quaternion<double>& q0, const Quaternion<double>& q1, double t );
+
+template std::ostream& operator<<( std::ostream& os, const Quaternion<float>&  q );
+template std::ostream& operator<<( std::ostream& os, const Quaternion<double>& q );
@@ -6,7 +6,7 @@
 // http://users.cms.caltech.edu/~keenan/src/spinxform_commandline.zip
 // at http://users.cms.caltech.edu/~keenan/project_spinxform.html
 //
-// This version has been modified so that it returns a real matrix in CUSP's COO
+// This version has been modified so that it returns a real matrix in CUSP's CSR
 // format.
 //
 // =============================================================================
@@ -18,23 +18,62 @@
 #include "QuaternionMatrix.h"
 #include <iostream>
 #include <fstream>
+#include <cassert>
 
 //#include <cusp/print.h>
 
 using namespace std;
 
-Quaternion QuaternionMatrix::zero( 0., 0., 0., 0. );
+template <class T, class Index>
+Quaternion<T> QuaternionMatrix<T,Index>::zero( 0., 0., 0., 0. );
 // dummy value for const access of zeros
 
-void QuaternionMatrix :: resize( int _m, int _n )
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: resize( int _m, int _n )
 // initialize an mxn matrix of zeros
 {
    m = _m;
    n = _n;
    data.clear();
+   realValid = false;
+   changed.clear();
 }
 
-int QuaternionMatrix :: size( int dim ) const
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: setSymmetric( bool _symmetric )
+// selects symmetric storage of a Hermitian matrix; clears the matrix
+{
+   symmetric = _symmetric;
+   data.clear();
+   realValid = false;
+   changed.clear();
+}
+
+template <class T, class Index>
+bool QuaternionMatrix<T,Index> :: isSymmetric( void ) const
+// returns whether symmetric storage is used
+{
+   return symmetric;
+}
+
+template <class T, class Index>
+bool QuaternionMatrix<T,Index> :: stores( int row, int col ) const
+// returns whether element (row,col) is stored explicitly
+{
+   return !symmetric || row <= col;
+}
+
+template <class T, class Index>
+bool QuaternionMatrix<T,Index> :: storesReal( int i, int j, int u, int v ) const
+// returns whether the real matrix holds entry (u,v) of the block of
+// element (i,j) -- in symmetric storage, only the upper triangle of
+// diagonal blocks is kept
+{
+   return !symmetric || i != j || u <= v;
+}
+
+template <class T, class Index>
+int QuaternionMatrix<T,Index> :: size( int dim ) const
 // returns the size of the dimension specified by scalar dim
 {
    if( dim == 1 ) return m;
@@ -42,28 +81,41 @@ int QuaternionMatrix :: size( int dim ) const
    return 0;
 }
 
-Quaternion& QuaternionMatrix :: operator()( int& row, int& col )
+template <class T, class Index>
+Quaternion<T>& QuaternionMatrix<T,Index> :: operator()( int& row, int& col )
 // return reference to element (row,col)
 // note: uses 0-based indexing
 {
+   assert( stores( row, col ));
+
+   // the caller may change the entry, so the real matrix must be rebuilt
+   realValid = false;
+
    EntryIndex index( col, row ); // typedef std::pair<int,int> EntryIndex;
             
-   EntryMap::const_iterator entry = data.find( index );
+   typename EntryMap::const_iterator entry = data.find( index );
    if( entry == data.end())
    {
-      data[ index ] = Quaternion( 0., 0., 0., 0. );
+      data[ index ] = Quaternion<T>( 0., 0., 0., 0. );
    }
  
    return data[ index ];
 }
 
-const Quaternion& QuaternionMatrix :: operator()( int row, int col ) const
-// return const reference to element (row,col)
+template <class T, class Index>
+Quaternion<T> QuaternionMatrix<T,Index> :: operator()( int row, int col ) const
+// return value of element (row,col)
 // note: uses 0-based indexing
 {
+   // the lower triangle of a symmetric matrix mirrors the upper one
+   if( !stores( row, col ))
+   {
+      return ~(*this)( col, row );
+   }
+
    EntryIndex index( col, row );
 
-   EntryMap::const_iterator entry = data.find( index );
+   typename EntryMap::const_iterator entry = data.find( index );
    if( entry == data.end())
    {
       return zero;
@@ -72,16 +124,159 @@ const Quaternion& QuaternionMatrix :: operator()( int row, int col ) const
    return entry->second;
 }
 
-typedef cusp::coo_matrix<size_t, float, cusp::host_memory> coo_cusp;
-coo_cusp QuaternionMatrix :: toRealCooFormat( void ) {
-// return coo_cusp by value is *expensive*, but W is locally defined so cannot return it by reference    
-    
-   float Q[4][4];
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: add( int row, int col, const Quaternion<T>& q )
+// adds q to element (row,col), keeping track of the change so that the
+// real matrix can be patched rather than rebuilt
+{
+   if( !stores( row, col ))
+   {
+      return;
+   }
+
+   EntryIndex index( col, row );
+
+   typename EntryMap::iterator entry = data.find( index );
+   if( entry == data.end() )
+   {
+      data[ index ] = q;
+      realValid = false;
+   }
+   else
+   {
+      entry->second += q;
+   }
+
+   changed.push_back( index );
+}
+
+template <class T, class Index>
+QuaternionMatrix<T,Index> :: QuaternionMatrix( void )
+: m( 0 ),
+  n( 0 ),
+  symmetric( false ),
+  realValid( false ),
+  sellValid( false ),
+  rebuilds( 0 )
+{}
+
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: multiply( const vector< Quaternion<T> >& x,
+                                            vector< Quaternion<T> >& y ) const
+// computes y = Ax
+{
+   y.assign( m, Quaternion<T>( 0., 0., 0., 0. ));
 
-   // convert quaternionic matrix to real matrix
-   A.resize( n*4 );
-  
-   for( EntryMap::iterator e = data.begin(); e != data.end(); e++ )
+   for( typename EntryMap::const_iterator e = data.begin(); e != data.end(); e++ )
+   {
+      int i = e->first.second; // row
+      int j = e->first.first;  // column
+      y[i] += e->second * x[j];
+
+      // apply the implied lower triangle of a symmetric matrix
+      if( i != j && symmetric )
+      {
+         y[j] += (~e->second) * x[i];
+      }
+   }
+}
+
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: getEntries( vector<EntryIndex>& indices,
+                                        vector< Quaternion<T> >& values ) const
+// returns all stored entries in storage order (sorted by column, then row)
+{
+   indices.clear();
+   values.clear();
+   indices.reserve( data.size() );
+   values.reserve( data.size() );
+
+   for( typename EntryMap::const_iterator e = data.begin(); e != data.end(); e++ )
+   {
+      indices.push_back( e->first );
+      values.push_back( e->second );
+   }
+}
+
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: setEntries( const vector<EntryIndex>& indices,
+                                        const vector< Quaternion<T> >& values )
+// replaces the matrix contents; indices must be in storage order
+{
+   data.clear();
+   realValid = false;
+   changed.clear();
+
+   // inserting just before end() with sorted keys takes amortized constant time
+   for( size_t k = 0; k < indices.size(); k++ )
+   {
+      data.insert( data.end(), make_pair( indices[k], values[k] ));
+   }
+}
+
+template <class T, class Index>
+const typename QuaternionMatrix<T,Index>::csr_cusp& QuaternionMatrix<T,Index> :: toRealCsrFormat( void )
+// returns real matrix in CUSP's CSR format where each quaternion becomes
+// a 4x4 block; the result is cached, and entries changed through add()
+// since the last call are patched in place as long as they don't introduce
+// new nonzeros
+{
+   // whichever way the real matrix changes, its SELL form is stale
+   if( !realValid || !changed.empty() )
+   {
+      sellValid = false;
+   }
+
+   if( realValid && !changed.empty() )
+   {
+      patchRealCsrFormat();
+   }
+
+   if( !realValid )
+   {
+      buildRealCsrFormat();
+   }
+
+   // leave an up-to-date matrix untouched, so that threads sharing it
+   // can call this concurrently
+   if( !changed.empty() )
+   {
+      changed.clear();
+   }
+   return real;
+}
+
+template <class T, class Index>
+const SellMatrix<T>& QuaternionMatrix<T,Index> :: toSellFormat( void )
+// returns the real matrix in SELL-C-sigma format, converting it only if it
+// changed since the last call
+{
+   const csr_cusp& A = toRealCsrFormat();
+   if( !sellValid )
+   {
+      sell.build( A, symmetric );
+      sellValid = true;
+   }
+   return sell;
+}
+
+template <class T, class Index>
+size_t QuaternionMatrix<T,Index> :: realRebuilds( void ) const
+// returns the number of full conversions to real CSR format so far
+{
+   return rebuilds;
+}
+
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: buildRealCsrFormat( void )
+// converts the whole matrix to real CSR format, with columns sorted within
+// each row
+{
+   T Q[4][4];
+
+   // count nonzeros in each real row
+   vector<size_t> count( 4*m+1, 0 );
+   for( typename EntryMap::const_iterator e = data.begin(); e != data.end(); e++ )
    {
       int i = e->first.second; // row
       int j = e->first.first;  // column
@@ -90,106 +285,96 @@ coo_cusp QuaternionMatrix :: toRealCooFormat( void ) {
       for( int u = 0; u < 4; u++ )
       for( int v = 0; v < 4; v++ )
       {
-         if( Q[u][v] != 0. )
+         if( Q[u][v] != 0. && storesReal( i, j, u, v )) count[ i*4+u+1 ]++;
+      }
+   }
+
+   for( int r = 0; r < 4*m; r++ )
+   {
+      count[r+1] += count[r];
+   }
+
+   real.resize( 4*m, 4*n, count[4*m] );
+   for( int r = 0; r <= 4*m; r++ )
+   {
+      real.row_offsets[r] = count[r];
+   }
+
+   // entries are stored by column, so each real row is filled in order
+   vector<size_t> next( count.begin(), count.end()-1 );
+   for( typename EntryMap::const_iterator e = data.begin(); e != data.end(); e++ )
+   {
+      int i = e->first.second; // row
+      int j = e->first.first;  // column
+      e->second.toMatrix( Q );
+
+      for( int u = 0; u < 4; u++ )
+      for( int v = 0; v < 4; v++ )
+      {
+         if( Q[u][v] != 0. && storesReal( i, j, u, v ))
+         {
+            size_t k = next[ i*4+u ]++;
+            real.column_indices[k] = j*4+v;
+            real.values[k]         = Q[u][v];
+         }
+      }
+   }
+
+   realValid = true;
+   rebuilds++;
+}
+
+template <class T, class Index>
+void QuaternionMatrix<T,Index> :: patchRealCsrFormat( void )
+// copies changed entries into the cached real matrix; if a change creates a
+// nonzero that isn't stored yet, the cache is invalidated instead
+{
+   T Q[4][4];
+
+   for( size_t c = 0; c < changed.size(); c++ )
+   {
+      int i = changed[c].second; // row
+      int j = changed[c].first;  // column
+
+      // read the entry directly: the non-const operator() would mark the
+      // cache invalid and turn every patch into a rebuild
+      data.find( changed[c] )->second.toMatrix( Q );
+
+      for( int u = 0; u < 4; u++ )
+      {
+         size_t begin = real.row_offsets[ i*4+u ];
+         size_t end   = real.row_offsets[ i*4+u+1 ];
+
+         for( int v = 0; v < 4; v++ )
          {
-             A.set_element( i*4+u, j*4+v, Q[u][v] );
+            if( !storesReal( i, j, u, v ))
+            {
+               continue;
+            }
+
+            // binary search for column j*4+v within real row i*4+u
+            Index col = j*4+v;
+            size_t lo = begin, hi = end;
+            while( lo < hi )
+            {
+               size_t mid = ( lo + hi ) / 2;
+               if( real.column_indices[mid] < col ) lo = mid+1;
+               else hi = mid;
+            }
+
+            if( lo < end && real.column_indices[lo] == col )
+            {
+               real.values[lo] = Q[u][v];
+            }
+            else if( Q[u][v] != 0. )
+            {
+               realValid = false;
+               return;
+            }
          }
       }
    }
-   
-   //std::cout <<  "dim of Sparse Matrix: " <<   A.n  << "\n";
-	
-	// CUSP's COO rows ----------------------------------------------------------
-
-   // save the index of each matrix's row for each pair of row and column indices in a nested 2D vector
-   std::vector<int> rows;
-   std::vector< std::vector<size_t> > cusp_rows = A.coo_format_rows( rows );
-   //std::cout << cusp_rows.size() << "\n"; // 32016
-   
-   // hack to erase 0 content
-	//cusp_rows.erase( cusp_rows.begin(), cusp_rows.begin() + 84648 );
-   //cusp_rows.erase( cusp_rows.begin(), cusp_rows.begin() + 16008 ); // hard-coded
-   cusp_rows.erase( cusp_rows.begin(), cusp_rows.begin() + n*4 ); // generic
-   
-   // uncomment the 3 lines below to get a feel how the cusp_rows index looks like
-   // for ( size_t i = 0; i < cusp_rows.size(); ++i )
-    //   for ( size_t int j =0; j < cusp_rows[i].size(); ++j )
-     //      std::cout << "\n" << "cusp_rows[" << i << ", " << j <<  "]= " << cusp_rows[i][j] << " ";   
-   
-   // convert nested 2D cusp_rows to 1D vector
-   std::vector<size_t> cusp_rows_1D; // *CAREFUL* not to use resize(), it adds a line of 0's in the beginning
-   
-   for ( size_t i=0; i < cusp_rows.size(); ++i )
-      copy( cusp_rows[i].begin(), cusp_rows[i].end(), back_inserter(cusp_rows_1D) );
-      
-   cout << "\n" << "CUSP_COO_rows_1D_size: " << cusp_rows_1D.size() << "\n";
-   
-	// CUSP's COO columns -------------------------------------------------------
-	
-   // save the index of each matrix's column for each pair of row and column indices in a nested 2D vector
-   std::vector<int> cols;
-   std::vector< std::vector<size_t> > cusp_columns = A.coo_format_columns( cols );
-   //std::cout << "cusp_columns size: " << cusp_columns.size() << "\n"; // 32016
-   
-   // hack to erase 0 content 
-	cusp_columns.erase( cusp_columns.begin(), cusp_columns.begin() + 84648 );
-   //cusp_columns.erase( cusp_columns.begin(), cusp_columns.begin() + 16008 ); // hard-coded
-   //cusp_rows.erase( cusp_columns.begin(), cusp_columns.begin() + n*4 ); // generic
-  
-   /*
-   // uncomment the 3 lines below to get a feel how the cusp_columns index looks like
-   for ( size_t i = 0; i < cusp_columns.size(); ++i )
-      for  ( size_t  int j =0; j < cusp_columns[i].size(); ++j )
-         std::cout << "\n" << "cusp_columns[" << i << ", " << j <<  "]= " << cusp_columns[i][j] << " ";
-   */
-   //std::cout << "cusp_columns size: " << cusp_columns.size() << "\n";
-
-   // convert nested 2D cusp columns to 1D vector
-   std::vector<size_t> cusp_columns_1D; // *CAREFUL* not to use resize(), it adds a line of 0's in the beginning
-   
-   for ( size_t i=0; i < cusp_columns.size(); ++i )
-      copy( cusp_columns[i].begin(), cusp_columns[i].end(), back_inserter( cusp_columns_1D ) );
-      
-   cout << "\n" << "CUSP_COO_columns_1D_size: " << cusp_columns_1D.size() << "\n";
-   
-   // CUSP's COO values --------------------------------------------------------
-   
-   // save each matrix's value for each pair of row 
-   // and column indices in a nested 2D vector
-   std::vector<float> vals;
-   std::vector< std::vector<float> > cusp_values = A.coo_format_values( vals );   
-
-   // hack to erase 0 content
-	//cusp_values.erase( cusp_values.begin(), cusp_values.begin() + 84648 );
-   //cusp_values.erase( cusp_values.begin(), cusp_values.begin() + 16008 ); // hard-coded
-   cusp_values.erase( cusp_values.begin(), cusp_values.begin() + n*4 ); // generic
-   
-   // convert nested 2D cusp_values to 1D vector
-   std::vector<float> cusp_values_1D; // careful with resize() adds a line of 0's in the beginning
-     
-   for ( size_t i=0; i < cusp_values.size(); ++i )
-      copy( cusp_values[i].begin(), cusp_values[i].end(), back_inserter( cusp_values_1D ) );
-	
-   // uncomment the 3 lines to get a feel how the cusp_columns index looks like
-   //for ( size_t i = 0; i < cusp_values.size(); ++i )    
-     // for ( size_t j =0; j < cusp_values[i].size(); ++j )
-       // std::cout << "\n" << "cusp_values[" << i << ", " << j <<  "]= " << cusp_values[i][j] << " ";
-
-   cout << "\n" << "CUSP_COO_values_1D_size: " << cusp_values_1D.size() << "\n";
-   
-   // combine CUSP's COO rows, columns and values into a single COO matrix
-   coo_cusp W( cusp_rows_1D.size(), cusp_columns_1D.size(), cusp_values_1D.size() ); 
-   
-   for( size_t i = 0; i < cusp_rows_1D.size(); ++i ) { // cusp_values_1D.size() gives same to cusp_rows_1D.size()   
-        
-      W.row_indices[i]    = cusp_rows_1D[i];
-      W.column_indices[i] = cusp_columns_1D[i];
-      W.values[i]         = cusp_values_1D[i];
-   }
-               
-   //cusp::print(W);
-   //cusp::io::write_matrix_market_file( W, "W.mtx" );
-          
-   return W;
-   // return coo_cusp by value is *expensive*, but W is locally defined so cannot return it by reference  
-} 
+}
+
+template class QuaternionMatrix<float>;
+template class QuaternionMatrix<double>;
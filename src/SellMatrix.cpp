@@ -0,0 +1,241 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SellMatrix.cpp
+//
+
+#include "SellMatrix.h"
+#include "cusp_device.h"
+#include <algorithm>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// width of the SIMD registers the kernels are written for
+#if defined(__AVX512F__)
+static const int simdBytes = 64;
+static const char* simdName = "avx512";
+#elif defined(__AVX2__)
+static const int simdBytes = 32;
+static const char* simdName = "avx2";
+#else
+static const int simdBytes = 32;
+static const char* simdName = "scalar";
+#endif
+
+static void multiplyChunk( const float* values, const int* columns, int width,
+                           const float* x, float* sum )
+// sets sum[l] to the product of lane l of a chunk of the given width with x
+{
+#if defined(__AVX512F__)
+   // the masked gathers are the unmasked ones with a defined pass-through
+   // value, which GCC's maybe-uninitialized check otherwise trips over
+   const __m512 zero = _mm512_setzero_ps();
+   const __mmask16 all = 0xffff;
+   __m512 acc = zero;
+   for( int k = 0; k < width; k++, values += 16, columns += 16 )
+   {
+      __m512i j = _mm512_loadu_si512( columns );
+      acc = _mm512_fmadd_ps( _mm512_loadu_ps( values ), _mm512_mask_i32gather_ps( zero, all, j, x, sizeof(float) ), acc );
+   }
+   _mm512_storeu_ps( sum, acc );
+#elif defined(__AVX2__)
+   const __m256 zero = _mm256_setzero_ps();
+   const __m256 all = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ));
+   __m256 acc = zero;
+   for( int k = 0; k < width; k++, values += 8, columns += 8 )
+   {
+      __m256i j = _mm256_loadu_si256( (const __m256i*) columns );
+      acc = _mm256_add_ps( acc, _mm256_mul_ps( _mm256_loadu_ps( values ), _mm256_mask_i32gather_ps( zero, x, j, all, sizeof(float) )));
+   }
+   _mm256_storeu_ps( sum, acc );
+#else
+   const int C = simdBytes / sizeof(float);
+   for( int l = 0; l < C; l++ ) sum[l] = 0.f;
+   for( int k = 0; k < width; k++, values += C, columns += C )
+   {
+      for( int l = 0; l < C; l++ ) sum[l] += values[l] * x[ columns[l] ];
+   }
+#endif
+}
+
+static void multiplyChunk( const double* values, const int* columns, int width,
+                           const double* x, double* sum )
+// sets sum[l] to the product of lane l of a chunk of the given width with x
+{
+#if defined(__AVX512F__)
+   const __m512d zero = _mm512_setzero_pd();
+   const __mmask8 all = 0xff;
+   __m512d acc = zero;
+   for( int k = 0; k < width; k++, values += 8, columns += 8 )
+   {
+      __m256i j = _mm256_loadu_si256( (const __m256i*) columns );
+      acc = _mm512_fmadd_pd( _mm512_loadu_pd( values ), _mm512_mask_i32gather_pd( zero, all, j, x, sizeof(double) ), acc );
+   }
+   _mm512_storeu_pd( sum, acc );
+#elif defined(__AVX2__)
+   const __m256d zero = _mm256_setzero_pd();
+   const __m256d all = _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ));
+   __m256d acc = zero;
+   for( int k = 0; k < width; k++, values += 4, columns += 4 )
+   {
+      __m128i j = _mm_loadu_si128( (const __m128i*) columns );
+      acc = _mm256_add_pd( acc, _mm256_mul_pd( _mm256_loadu_pd( values ), _mm256_mask_i32gather_pd( zero, x, j, all, sizeof(double) )));
+   }
+   _mm256_storeu_pd( sum, acc );
+#else
+   const int C = simdBytes / sizeof(double);
+   for( int l = 0; l < C; l++ ) sum[l] = 0.;
+   for( int k = 0; k < width; k++, values += C, columns += C )
+   {
+      for( int l = 0; l < C; l++ ) sum[l] += values[l] * x[ columns[l] ];
+   }
+#endif
+}
+
+template <class T>
+SellMatrix<T> :: SellMatrix( void )
+: rows( 0 ),
+  nonzeros( 0 )
+{}
+
+template <class T>
+int SellMatrix<T> :: chunkHeight( void )
+// returns C
+{
+   return simdBytes / sizeof(T);
+}
+
+template <class T>
+const char* SellMatrix<T> :: kernel( void )
+// returns the instruction set of the kernel
+{
+   return simdName;
+}
+
+template <class T>
+void SellMatrix<T> :: build( const cusp::csr_matrix<int, T, cusp::host_memory>& upper,
+                             bool symmetric, int sigma )
+// converts a CSR matrix (or the upper triangle of a symmetric one)
+{
+   // SIMD lanes can't scatter to the mirrored entries of a symmetric matrix
+   // without conflicts, so the lower triangle is stored explicitly
+   cusp::csr_matrix<int, T, cusp::host_memory> full;
+   if( symmetric )
+   {
+      expand_symmetric( upper, full );
+   }
+   const cusp::csr_matrix<int, T, cusp::host_memory>& A( symmetric ? full : upper );
+
+   const int C = chunkHeight();
+   rows = A.num_rows;
+   nonzeros = A.num_entries;
+   int chunks = ( rows + C-1 ) / C;
+
+   // sort rows by decreasing length within each window, so that the rows
+   // of a chunk have similar lengths but rows don't move far from x
+   sigma = max( C, ( sigma + C-1 ) / C * C );
+   laneRow.assign( chunks*C, -1 );
+   for( int i = 0; i < rows; i++ )
+   {
+      laneRow[i] = i;
+   }
+   for( int w = 0; w < rows; w += sigma )
+   {
+      int end = min( rows, w + sigma );
+      stable_sort( laneRow.begin()+w, laneRow.begin()+end,
+                   [&A]( int a, int b )
+                   {
+                      return A.row_offsets[a+1] - A.row_offsets[a] >
+                             A.row_offsets[b+1] - A.row_offsets[b];
+                   } );
+   }
+
+   // each chunk is as wide as its longest row
+   chunkStart.resize( chunks+1 );
+   chunkStart[0] = 0;
+   for( int c = 0; c < chunks; c++ )
+   {
+      int width = 0;
+      for( int l = 0; l < C; l++ )
+      {
+         int r = laneRow[ c*C+l ];
+         if( r >= 0 ) width = max( width, A.row_offsets[r+1] - A.row_offsets[r] );
+      }
+      chunkStart[c+1] = chunkStart[c] + width*C;
+   }
+
+   columns.assign( chunkStart[chunks], 0 );
+   values.assign( chunkStart[chunks], (T) 0. );
+   for( int c = 0; c < chunks; c++ )
+   {
+      for( int l = 0; l < C; l++ )
+      {
+         int r = laneRow[ c*C+l ];
+         if( r < 0 ) continue;
+
+         int slot = chunkStart[c] + l;
+         for( int k = A.row_offsets[r]; k < A.row_offsets[r+1]; k++, slot += C )
+         {
+            columns[slot] = A.column_indices[k];
+            values[slot] = A.values[k];
+         }
+      }
+   }
+}
+
+template <class T>
+void SellMatrix<T> :: multiply( const T* x, T* y ) const
+// computes y = Ax
+{
+   const int C = chunkHeight();
+   int chunks = (int) chunkStart.size() - 1;
+
+   #pragma omp parallel for
+   for( int c = 0; c < chunks; c++ )
+   {
+      T sum[ simdBytes / sizeof(T) ];
+      int width = ( chunkStart[c+1] - chunkStart[c] ) / C;
+      multiplyChunk( &values[ chunkStart[c] ], &columns[ chunkStart[c] ], width, x, sum );
+
+      for( int l = 0; l < C; l++ )
+      {
+         int r = laneRow[ c*C+l ];
+         if( r >= 0 ) y[r] = sum[l];
+      }
+   }
+}
+
+template <class T>
+int SellMatrix<T> :: size( void ) const
+// returns the number of rows
+{
+   return rows;
+}
+
+template <class T>
+size_t SellMatrix<T> :: entries( void ) const
+// returns the number of nonzeros
+{
+   return nonzeros;
+}
+
+template <class T>
+size_t SellMatrix<T> :: slots( void ) const
+// returns the number of stored entries, including padding
+{
+   return values.size();
+}
+
+template <class T>
+double SellMatrix<T> :: bytes( void ) const
+// returns the matrix and vector bytes one multiply reads and writes
+{
+   return (double) slots() * ( sizeof(int) + sizeof(T) ) +
+          (double) chunkStart.size() * sizeof(int) +
+          (double) laneRow.size() * sizeof(int) +
+          2. * rows * sizeof(T);
+}
+
+template class SellMatrix<float>;
+template class SellMatrix<double>;
@@ -0,0 +1,320 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- Server.cpp
+//
+
+#include "Server.h"
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+template <class T>
+Server<T> :: Server( void )
+: useCache( true ),
+  fd( -1 ),
+  stopping( false ),
+  serial( 0 ),
+  imageUses( 0 )
+{}
+
+template <class T>
+Server<T> :: ~Server( void )
+{
+   if( fd >= 0 )
+   {
+      close( fd );
+      unlink( path.c_str() );
+   }
+}
+
+template <class T>
+bool Server<T> :: listen( const string& socketPath )
+// binds the socket (replacing a stale one); returns false on failure
+{
+   sockaddr_un address;
+   memset( &address, 0, sizeof(address) );
+   address.sun_family = AF_UNIX;
+   if( socketPath.size() >= sizeof(address.sun_path) )
+   {
+      return false;
+   }
+   strcpy( address.sun_path, socketPath.c_str() );
+
+   fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+   if( fd < 0 )
+   {
+      return false;
+   }
+
+   // replace a socket left behind by a previous server, but nothing else
+   struct stat info;
+   if( lstat( socketPath.c_str(), &info ) == 0 )
+   {
+      if( !S_ISSOCK( info.st_mode ))
+      {
+         cerr << "Error: " << socketPath << " exists and is not a socket!" << endl;
+         close( fd );
+         fd = -1;
+         return false;
+      }
+      unlink( socketPath.c_str() );
+   }
+
+   if( ::bind( fd, (sockaddr*) &address, sizeof(address) ) != 0 ||
+       ::listen( fd, 16 ) != 0 )
+   {
+      close( fd );
+      fd = -1;
+      return false;
+   }
+
+   path = socketPath;
+   return true;
+}
+
+template <class T>
+void Server<T> :: run( void )
+// serves connections until a shutdown request arrives
+{
+   while( !stopping )
+   {
+      int connection = accept4( fd, NULL, NULL, SOCK_CLOEXEC );
+      if( connection < 0 )
+      {
+         if( errno == EINTR ) continue;
+         cerr << "Error: couldn't accept connection (" << strerror( errno ) << ")" << endl;
+         return;
+      }
+
+      serve( connection );
+      close( connection );
+   }
+}
+
+template <class T>
+void Server<T> :: serve( int connection )
+// answers requests on connection until the client hangs up
+{
+   string pending;
+   char buffer[4096];
+
+   while( !stopping )
+   {
+      ssize_t n = recv( connection, buffer, sizeof(buffer), 0 );
+      if( n < 0 && errno == EINTR ) continue;
+      if( n <= 0 ) return;
+      pending.append( buffer, n );
+
+      // answer every complete line received so far
+      size_t begin = 0, end;
+      while( !stopping && ( end = pending.find( '\n', begin )) != string::npos )
+      {
+         string reply = handle( pending.substr( begin, end-begin )) + "\n";
+         begin = end+1;
+
+         for( size_t sent = 0; sent < reply.size(); )
+         {
+            ssize_t k = send( connection, reply.data()+sent, reply.size()-sent, MSG_NOSIGNAL );
+            if( k < 0 && errno == EINTR ) continue;
+            if( k <= 0 ) return;
+            sent += k;
+         }
+      }
+      pending.erase( 0, begin );
+   }
+}
+
+template <class T>
+string Server<T> :: handle( const string& request )
+// carries out one request and returns the reply line
+{
+   stringstream in( request );
+   string command, id;
+   in >> command;
+
+   if( command == "load" )
+   {
+      string meshFile;
+      if( in >> id >> meshFile ) return load( id, meshFile );
+   }
+   else if( command == "deform" )
+   {
+      string source, name;
+      T scale;
+      if( in >> id >> source >> name >> scale ) return deform( id, source, name, scale );
+   }
+   else if( command == "unload" )
+   {
+      if( in >> id ) return unload( id );
+   }
+   else if( command == "shutdown" )
+   {
+      stopping = true;
+      return "ok";
+   }
+   else
+   {
+      return "error unknown command";
+   }
+
+   return "error malformed " + command + " request";
+}
+
+template <class T>
+string Server<T> :: load( const string& id, const string& meshFile )
+// loads meshFile under the name id, along with its Laplacian
+{
+   shared_ptr<Resident> resident( new Resident() );
+   Mesh<T>& mesh( resident->mesh );
+   mesh.useCache = useCache;
+   if( !mesh.read( meshFile ))
+   {
+      return "error couldn't read " + meshFile;
+   }
+   mesh.prepareOperators();
+
+   stringstream name;
+   name << "/spinxform." << getpid() << "." << serial++;
+   if( !resident->result.create( name.str(), 3 * mesh.vertices.size() * sizeof(T) ))
+   {
+      return "error couldn't create shared memory " + name.str();
+   }
+
+   meshes[id] = resident; // replaces (and releases) any mesh loaded before as id
+
+   stringstream reply;
+   reply << "ok " << mesh.vertices.size() << " " << mesh.faces.size() << " ";
+   reply << sizeof(T) << " " << name.str();
+   return reply.str();
+}
+
+template <class T>
+string Server<T> :: deform( const string& id, const string& source, const string& name, T scale )
+// sets rho on mesh id from an image file or a shared array, computes the
+// deformation and copies it into the mesh's result object
+{
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   typename map< string, shared_ptr<Resident> >::iterator r = meshes.find( id );
+   if( r == meshes.end() )
+   {
+      return "error unknown mesh " + id;
+   }
+   Resident& resident( *r->second );
+   Mesh<T>& mesh( resident.mesh );
+
+   // set rho
+   if( source == "image" )
+   {
+      const Image* rhoImage = image( name );
+      if( rhoImage == NULL )
+      {
+         return "error couldn't read " + name;
+      }
+      mesh.setCurvatureChange( *rhoImage, scale );
+   }
+   else if( source == "rho" )
+   {
+      SharedMemory rho;
+      if( !rho.open( name ))
+      {
+         return "error couldn't open shared memory " + name;
+      }
+      if( rho.size() < mesh.faces.size() * sizeof(T) )
+      {
+         return "error " + name + " holds fewer values than there are faces";
+      }
+
+      const T* values = (const T*) rho.data();
+      for( size_t i = 0; i < mesh.faces.size(); i++ )
+      {
+         mesh.rho[i] = scale * values[i];
+      }
+   }
+   else
+   {
+      return "error unknown rho source " + source;
+   }
+
+   // solve, and hand the result back
+   mesh.updateDeformation();
+
+   T* result = (T*) resident.result.data();
+   for( size_t i = 0; i < mesh.newVertices.size(); i++ )
+   {
+      const Vector<T>& p( mesh.newVertices[i].im() );
+      result[3*i+0] = p.x;
+      result[3*i+1] = p.y;
+      result[3*i+2] = p.z;
+   }
+
+   double elapsed = chrono::duration<double,milli>( chrono::steady_clock::now() - start ).count();
+
+   stringstream reply;
+   reply << "ok " << resident.result.name() << " " << mesh.newVertices.size() << " " << elapsed;
+   return reply.str();
+}
+
+template <class T>
+string Server<T> :: unload( const string& id )
+// releases mesh id and its result object
+{
+   if( meshes.erase( id ) == 0 )
+   {
+      return "error unknown mesh " + id;
+   }
+
+   return "ok";
+}
+
+template <class T>
+const Image* Server<T> :: image( const string& filename )
+// returns the resident copy of an image, (re)loading it if it is new or
+// has changed on disk; returns NULL if it can't be read
+{
+   struct stat info;
+   if( stat( filename.c_str(), &info ) != 0 )
+   {
+      images.erase( filename );
+      return NULL;
+   }
+
+   long long modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+
+   shared_ptr<ResidentImage>& resident( images[filename] );
+   if( !resident || resident->modified != modified )
+   {
+      resident.reset( new ResidentImage() );
+      if( !resident->image.read( filename.c_str() ))
+      {
+         images.erase( filename );
+         return NULL;
+      }
+      resident->modified = modified;
+   }
+   resident->used = ++imageUses;
+
+   // keep the most recently used images only
+   while( images.size() > maxImages )
+   {
+      typename map< string, shared_ptr<ResidentImage> >::iterator oldest = images.begin();
+      for( typename map< string, shared_ptr<ResidentImage> >::iterator i = images.begin(); i != images.end(); i++ )
+      {
+         if( i->second->used < oldest->second->used ) oldest = i;
+      }
+      images.erase( oldest );
+   }
+
+   return &images[filename]->image;
+}
+
+template class Server<float>;
+template class Server<double>;
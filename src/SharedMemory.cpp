@@ -0,0 +1,124 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SharedMemory.cpp
+//
+
+#include "SharedMemory.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+SharedMemory :: SharedMemory( void )
+: start( NULL ),
+  length( 0 ),
+  owner( false )
+{}
+
+SharedMemory :: ~SharedMemory( void )
+{
+   close();
+}
+
+bool SharedMemory :: create( const std::string& name, size_t size )
+// creates (or replaces) the object name with the given size and maps it
+// read-write; returns false on failure
+{
+   close();
+
+   shm_unlink( name.c_str() );
+   int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600 );
+   if( fd < 0 )
+   {
+      return false;
+   }
+
+   if( ftruncate( fd, size ) != 0 || !map( fd, size, true ))
+   {
+      ::close( fd );
+      shm_unlink( name.c_str() );
+      return false;
+   }
+
+   objectName = name;
+   owner = true;
+   return true;
+}
+
+bool SharedMemory :: open( const std::string& name )
+// maps an existing object read-only; returns false on failure
+{
+   close();
+
+   int fd = shm_open( name.c_str(), O_RDONLY, 0 );
+   if( fd < 0 )
+   {
+      return false;
+   }
+
+   struct stat info;
+   if( fstat( fd, &info ) != 0 || !map( fd, info.st_size, false ))
+   {
+      ::close( fd );
+      return false;
+   }
+
+   objectName = name;
+   owner = false;
+   return true;
+}
+
+bool SharedMemory :: map( int fd, size_t size, bool writable )
+// maps size bytes of fd and closes it
+{
+   if( size > 0 )
+   {
+      void* p = mmap( NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+      if( p == MAP_FAILED )
+      {
+         return false;
+      }
+      start = (char*) p;
+   }
+
+   ::close( fd ); // the mapping keeps its own reference to the object
+   length = size;
+   return true;
+}
+
+void SharedMemory :: close( void )
+// releases the mapping (and removes the object if it was created here)
+{
+   if( start != NULL )
+   {
+      munmap( start, length );
+   }
+
+   if( owner )
+   {
+      shm_unlink( objectName.c_str() );
+   }
+
+   start = NULL;
+   length = 0;
+   objectName.clear();
+   owner = false;
+}
+
+char* SharedMemory :: data( void ) const
+// returns pointer to the first byte of the object
+{
+   return start;
+}
+
+size_t SharedMemory :: size( void ) const
+// returns object size in bytes
+{
+   return length;
+}
+
+const std::string& SharedMemory :: name( void ) const
+// returns the name of the object
+{
+   return objectName;
+}
@@ -0,0 +1,232 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- SystemCapture.cpp
+//
+
+#include "SystemCapture.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char captureMagic[8] = { 'S', 'P', 'X', 'S', 'Y', 'S', 'T', 'M' };
+static const unsigned int captureVersion = 1;
+
+static string captureDirectory;
+static bool captureMatrixMarket = false;
+static atomic<bool> captureEnabled( false );
+static atomic<int> captureCount( 0 );
+
+template <class T>
+CapturedSystem<T> :: CapturedSystem( void )
+: initialGuess( false ),
+  iterations( 0 ),
+  residual( 0. )
+{}
+
+template <class S>
+static void writeArray( ostream& out, const vector<S>& a )
+{
+   if( !a.empty() )
+   {
+      out.write( (const char*) &a[0], a.size()*sizeof(S) );
+   }
+}
+
+template <class T>
+bool CapturedSystem<T> :: write( const string& filename ) const
+// saves the system in the binary format
+{
+   ofstream out( filename.c_str(), ios_base::binary );
+   if( !out.is_open() )
+   {
+      return false;
+   }
+
+   CapturedSystemHeader header;
+   memset( &header, 0, sizeof(CapturedSystemHeader) );
+   memcpy( header.magic, captureMagic, sizeof(captureMagic) );
+   header.version = captureVersion;
+   header.scalarSize = sizeof(T);
+   header.rows = rhs.size();
+   header.entries = values.size();
+   header.initialGuess = initialGuess;
+   header.iterations = iterations;
+   header.residual = residual;
+   strncpy( header.name, name.c_str(), sizeof(header.name)-1 );
+   out.write( (const char*) &header, sizeof(CapturedSystemHeader) );
+
+   writeArray( out, rowStart );
+   writeArray( out, columns );
+   writeArray( out, values );
+   writeArray( out, rhs );
+   writeArray( out, guess );
+   writeArray( out, solution );
+
+   out.close();
+   return out.good();
+}
+
+template <class T, class S>
+static const char* readArray( const char* p, size_t n, vector<T>& a )
+// copies n values of type S starting at p into a; returns the end
+{
+   a.resize( n );
+   const S* s = (const S*) p;
+   for( size_t i = 0; i < n; i++ )
+   {
+      a[i] = (T) s[i];
+   }
+   return p + n*sizeof(S);
+}
+
+template <class T, class S>
+static const char* readScalars( const char* p, size_t rows, size_t entries, CapturedSystem<T>& system )
+// reads the scalar arrays stored with precision S
+{
+   p = readArray<T,S>( p, entries, system.values );
+   p = readArray<T,S>( p, rows, system.rhs );
+   p = readArray<T,S>( p, rows, system.guess );
+   p = readArray<T,S>( p, rows, system.solution );
+   return p;
+}
+
+template <class T>
+bool CapturedSystem<T> :: read( const string& filename )
+// loads a system saved by write()
+{
+   MappedFile in;
+   if( !in.open( filename ) || in.size() < sizeof(CapturedSystemHeader) )
+   {
+      return false;
+   }
+
+   CapturedSystemHeader header;
+   memcpy( &header, in.data(), sizeof(CapturedSystemHeader) );
+   if( memcmp( header.magic, captureMagic, sizeof(captureMagic) ) != 0 ||
+       header.version != captureVersion ||
+       ( header.scalarSize != sizeof(float) && header.scalarSize != sizeof(double) ))
+   {
+      return false;
+   }
+
+   size_t rows = header.rows;
+   size_t entries = header.entries;
+   size_t expected = sizeof(CapturedSystemHeader) +
+                     ( rows+1 + entries )*sizeof(int) +
+                     ( entries + 3*rows )*header.scalarSize;
+   if( in.size() != expected )
+   {
+      return false;
+   }
+
+   header.name[ sizeof(header.name)-1 ] = '\0';
+   name = header.name;
+   initialGuess = header.initialGuess != 0;
+   iterations = header.iterations;
+   residual = header.residual;
+
+   const char* p = in.data() + sizeof(CapturedSystemHeader);
+   p = readArray<int,int>( p, rows+1, rowStart );
+   p = readArray<int,int>( p, entries, columns );
+   if( header.scalarSize == sizeof(float) ) readScalars<T,float>( p, rows, entries, *this );
+   else                                     readScalars<T,double>( p, rows, entries, *this );
+
+   // reject index arrays that would send a solver out of bounds
+   if( rowStart[0] != 0 || rowStart[rows] != (int) entries )
+   {
+      return false;
+   }
+   for( size_t i = 0; i < rows; i++ )
+   {
+      if( rowStart[i] > rowStart[i+1] ) return false;
+   }
+   for( size_t k = 0; k < entries; k++ )
+   {
+      if( columns[k] < 0 || columns[k] >= (int) rows ) return false;
+   }
+
+   return true;
+}
+
+template <class T>
+static bool writeVectorMarket( const string& filename, const vector<T>& x )
+// writes a dense column vector in Matrix Market array format
+{
+   FILE* out = fopen( filename.c_str(), "w" );
+   if( out == NULL ) return false;
+
+   fprintf( out, "%%%%MatrixMarket matrix array real general\n" );
+   fprintf( out, "%d 1\n", (int) x.size() );
+   for( size_t i = 0; i < x.size(); i++ )
+   {
+      fprintf( out, "%.17g\n", (double) x[i] );
+   }
+
+   return fclose( out ) == 0;
+}
+
+template <class T>
+bool CapturedSystem<T> :: writeMatrixMarket( const string& prefix ) const
+// saves the matrix and vectors in Matrix Market format
+{
+   FILE* out = fopen( ( prefix + ".A.mtx" ).c_str(), "w" );
+   if( out == NULL ) return false;
+
+   // Matrix Market indices are 1-based
+   int rows = rhs.size();
+   fprintf( out, "%%%%MatrixMarket matrix coordinate real general\n" );
+   fprintf( out, "%d %d %d\n", rows, rows, (int) values.size() );
+   for( int i = 0; i < rows; i++ )
+   {
+      for( int k = rowStart[i]; k < rowStart[i+1]; k++ )
+      {
+         fprintf( out, "%d %d %.17g\n", i+1, columns[k]+1, (double) values[k] );
+      }
+   }
+
+   bool ok = fclose( out ) == 0;
+   ok = writeVectorMarket( prefix + ".b.mtx", rhs ) && ok;
+   ok = writeVectorMarket( prefix + ".x0.mtx", guess ) && ok;
+   ok = writeVectorMarket( prefix + ".x.mtx", solution ) && ok;
+   return ok;
+}
+
+void SystemCapture :: enable( const string& directory, bool matrixMarket )
+// starts capturing systems into directory
+{
+   captureDirectory = directory;
+   captureMatrixMarket = matrixMarket;
+   captureEnabled = true;
+}
+
+bool SystemCapture :: enabled( void )
+// returns whether systems are being captured
+{
+   return captureEnabled.load( memory_order_relaxed );
+}
+
+bool SystemCapture :: matrixMarket( void )
+// returns whether Matrix Market files are written too
+{
+   return captureMatrixMarket;
+}
+
+string SystemCapture :: nextPrefix( const string& name )
+// returns the path, without extension, of the next capture
+{
+   char number[16];
+   snprintf( number, sizeof(number), "%04d", captureCount++ );
+
+   string file = string( number ) + "-" + name;
+   for( size_t i = 0; i < file.size(); i++ )
+   {
+      if( file[i] == ' ' || file[i] == '/' ) file[i] = '_';
+   }
+
+   return captureDirectory + "/" + file;
+}
+
+template class CapturedSystem<float>;
+template class CapturedSystem<double>;
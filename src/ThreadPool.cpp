@@ -0,0 +1,159 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- ThreadPool.cpp
+//
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+static thread_local int currentWorker = -1;
+// index of the worker running on this thread (-1 outside the pool)
+
+static thread_local const void* currentPool = 0;
+// pool the worker running on this thread belongs to
+
+ThreadPool :: ThreadPool( int nThreads )
+: queues( nThreads > 0 ? nThreads : max( 1u, thread::hardware_concurrency() )),
+  queued( 0 ),
+  pending( 0 ),
+  next( 0 ),
+  stopping( false )
+{
+   for( size_t i = 0; i < queues.size(); i++ )
+   {
+      workers.push_back( thread( &ThreadPool::work, this, (int) i ));
+   }
+}
+
+ThreadPool :: ~ThreadPool( void )
+{
+   wait();
+
+   {
+      lock_guard<std::mutex> lock( mutex );
+      stopping = true;
+   }
+   wake.notify_all();
+
+   for( size_t i = 0; i < workers.size(); i++ )
+   {
+      workers[i].join();
+   }
+}
+
+int ThreadPool :: size( void ) const
+// returns the number of workers
+{
+   return workers.size();
+}
+
+void ThreadPool :: submit( const function<void()>& task )
+// schedules task to be run by some worker
+{
+   // workers keep their own tasks local; outside tasks are dealt round-robin
+   size_t index;
+   if( currentPool == this )
+   {
+      index = currentWorker;
+   }
+   else
+   {
+      lock_guard<std::mutex> lock( mutex );
+      index = next;
+      next = ( next + 1 ) % queues.size();
+   }
+
+   {
+      lock_guard<std::mutex> lock( queues[index].mutex );
+      queues[index].tasks.push_back( task );
+   }
+
+   {
+      lock_guard<std::mutex> lock( mutex );
+      queued++;
+      pending++;
+   }
+   wake.notify_one();
+}
+
+void ThreadPool :: wait( void )
+// blocks until every submitted task has finished
+{
+   unique_lock<std::mutex> lock( mutex );
+   idle.wait( lock, [this]{ return pending == 0; } );
+}
+
+bool ThreadPool :: take( int index, function<void()>& task )
+// pops from the back of the worker's own queue or, failing that, steals
+// from the front of another queue; returns false if all queues are empty
+{
+   {
+      Queue& own( queues[index] );
+      lock_guard<std::mutex> lock( own.mutex );
+      if( !own.tasks.empty() )
+      {
+         task = own.tasks.back();
+         own.tasks.pop_back();
+         return true;
+      }
+   }
+
+   for( size_t k = 1; k < queues.size(); k++ )
+   {
+      Queue& other( queues[( index + k ) % queues.size()] );
+      lock_guard<std::mutex> lock( other.mutex );
+      if( !other.tasks.empty() )
+      {
+         task = other.tasks.front();
+         other.tasks.pop_front();
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void ThreadPool :: work( int index )
+// main loop of worker index
+{
+   currentWorker = index;
+   currentPool = this;
+
+   while( true )
+   {
+      // sleep until something is queued (or the pool shuts down), then
+      // claim one task so that other workers don't wait for it too
+      {
+         unique_lock<std::mutex> lock( mutex );
+         wake.wait( lock, [this]{ return stopping || queued > 0; } );
+         if( queued == 0 )
+         {
+            return;
+         }
+         queued--;
+      }
+
+      // submit() queues a task before counting it, so there are at least
+      // as many queued tasks as claims; but a scan can miss a task that
+      // lands in a queue it has already passed while other claimants
+      // empty the rest, so scan again until one turns up
+      function<void()> task;
+      while( !take( index, task ))
+      {
+         this_thread::yield();
+      }
+
+      task();
+
+      {
+         lock_guard<std::mutex> lock( mutex );
+         pending--;
+         if( pending == 0 )
+         {
+            idle.notify_all();
+         }
+      }
+   }
+}
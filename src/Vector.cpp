@@ -15,23 +15,26 @@
 
 // CONSTRUCTORS ----------------------------------------------------------------
 
-Vector :: Vector( void )
+template <class T>
+Vector<T> :: Vector( void )
 // initializes all components to zero
 : x( 0. ),
   y( 0. ),
   z( 0. )
 {}
 
-Vector :: Vector( float x0,
-                  float y0,
-                  float z0 )
+template <class T>
+Vector<T> :: Vector( T x0,
+                     T y0,
+                     T z0 )
 // initializes with specified components
 : x( x0 ),
   y( y0 ),
   z( z0 )
 {}
 
-Vector :: Vector( const Vector& v )
+template <class T>
+Vector<T> :: Vector( const Vector& v )
 // initializes from existing vector
 : x( v.x ),
   y( v.y ),
@@ -41,13 +44,15 @@ Vector :: Vector( const Vector& v )
 
 // ACCESSORS -------------------------------------------------------------------
 
-float& Vector :: operator[]( int index )
+template <class T>
+T& Vector<T> :: operator[]( int index )
   // returns reference to the specified component (0-based indexing: x, y, z )
 {
    return ( &x )[ index ];
 }
 
-const float& Vector :: operator[]( int index ) const
+template <class T>
+const T& Vector<T> :: operator[]( int index ) const
   // returns const reference to the specified component (0-based indexing: x, y, z )
 {
    return ( &x )[ index ];
@@ -56,7 +61,8 @@ const float& Vector :: operator[]( int index ) const
 
 // VECTOR SPACE OPERATIONS -----------------------------------------------------
 
-Vector Vector :: operator+( const Vector& v ) const
+template <class T>
+Vector<T> Vector<T> :: operator+( const Vector& v ) const
   // addition
 {
    return Vector( x + v.x,
@@ -64,7 +70,8 @@ Vector Vector :: operator+( const Vector& v ) const
                   z + v.z );
 }
 
-Vector Vector :: operator-( const Vector& v ) const
+template <class T>
+Vector<T> Vector<T> :: operator-( const Vector& v ) const
   // subtraction
 {
    return Vector( x - v.x,
@@ -72,7 +79,8 @@ Vector Vector :: operator-( const Vector& v ) const
                   z - v.z );
 }
 
-Vector Vector :: operator-( void ) const
+template <class T>
+Vector<T> Vector<T> :: operator-( void ) const
   // negation
 {
    return Vector( -x,
@@ -80,7 +88,8 @@ Vector Vector :: operator-( void ) const
                   -z );
 }
 
-Vector Vector :: operator*( const float& c ) const
+template <class T>
+Vector<T> Vector<T> :: operator*( const T& c ) const
   // scalar multiplication
 {
    return Vector( x*c,
@@ -88,19 +97,22 @@ Vector Vector :: operator*( const float& c ) const
                   z*c );
 }
 
-Vector operator*( const float& c, const Vector& v )
+template <class T>
+Vector<T> operator*( const typename Vector<T>::ValueType& c, const Vector<T>& v )
   // scalar multiplication
 {
    return v*c;
 }
 
-Vector Vector :: operator/( const float& c ) const
+template <class T>
+Vector<T> Vector<T> :: operator/( const T& c ) const
   // scalar division
 {
    return (*this) * ( 1./c );
 }
 
-void Vector :: operator+=( const Vector& v )
+template <class T>
+void Vector<T> :: operator+=( const Vector& v )
   // addition / assignment
 {
    x += v.x;
@@ -108,7 +120,8 @@ void Vector :: operator+=( const Vector& v )
    z += v.z;
 }
 
-void Vector :: operator-=( const Vector& v )
+template <class T>
+void Vector<T> :: operator-=( const Vector& v )
   // subtraction / assignment
 {
    x -= v.x;
@@ -116,7 +129,8 @@ void Vector :: operator-=( const Vector& v )
    z -= v.z;
 }
 
-void Vector :: operator*=( const float& c )
+template <class T>
+void Vector<T> :: operator*=( const T& c )
   // scalar multiplication / assignment
 {
    x *= c;
@@ -124,7 +138,8 @@ void Vector :: operator*=( const float& c )
    z *= c;
 }
 
-void Vector :: operator/=( const float& c )
+template <class T>
+void Vector<T> :: operator/=( const T& c )
   // scalar division / assignment
 {
    (*this) *= ( 1./c );
@@ -133,7 +148,8 @@ void Vector :: operator/=( const float& c )
 
 // ALGEBRAIC OPERATIONS --------------------------------------------------------
 
-float Vector :: operator*( const Vector& v ) const
+template <class T>
+T Vector<T> :: operator*( const Vector& v ) const
   // dot product
 {
    return x*v.x +
@@ -141,7 +157,8 @@ float Vector :: operator*( const Vector& v ) const
           z*v.z ;
 }
 
-Vector Vector :: operator^( const Vector& v ) const
+template <class T>
+Vector<T> Vector<T> :: operator^( const Vector& v ) const
   // cross product
 {
    return Vector( y*v.z - z*v.y,
@@ -152,31 +169,36 @@ Vector Vector :: operator^( const Vector& v ) const
 
 // NORMS -----------------------------------------------------------------------
 
-float Vector :: norm( void ) const
+template <class T>
+T Vector<T> :: norm( void ) const
   // returns Euclidean length
 {
    return sqrt( norm2());
 }
 
-float Vector :: norm2( void ) const
+template <class T>
+T Vector<T> :: norm2( void ) const
   // returns Euclidean length squared
 {
    return (*this) * (*this);
 }
 
-Vector Vector :: unit( void ) const
+template <class T>
+Vector<T> Vector<T> :: unit( void ) const
   // returns unit vector
 {
    return (*this) / norm();
 }
 
-void Vector :: normalize( void )
+template <class T>
+void Vector<T> :: normalize( void )
   // divides by Euclidean length
 {
    (*this) /= norm();
 }
 
-std::ostream& operator<<( std::ostream& os, const Vector& o )
+template <class T>
+std::ostream& operator<<( std::ostream& os, const Vector<T>& o )
   // scalar multiplication
 {
    os << "[ "
@@ -186,4 +208,16 @@ std::ostream& operator<<( std::ostream& os, const Vector& o )
       << " ]";
 
    return os;
-}
\ No newline at end of file
+}
+
+
+// EXPLICIT INSTANTIATIONS -----------------------------------------------------
+
+template class Vector<float>;
+template class Vector<double>;
+
+template Vector<float>  operator*( const float&  c, const Vector<float>&  v );
+template Vector<double> operator*( const double& c, const Vector<double>& v );
+
+template std::ostream& operator<<( std::ostream& os, const Vector<float>&  o );
+template std::ostream& operator<<( std::ostream& os, const Vector<double>& o );
@@ -11,35 +11,529 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <omp.h>
 #include "Mesh.h"
 #include "Image.h"
+#include "FileWatcher.h"
+#include "ThreadPool.h"
+#include "Server.h"
+#include "Profiler.h"
+#include "SystemCapture.h"
 
 using namespace std;
 
-int main( int argc, char **argv )
+class Options
+// command line options
 {
-   if( argc != 4 )
+   public:
+      Options( void )
+      : useDouble( false ),
+        useCache( true ),
+        watch( false ),
+        rings( -1 ),
+        threads( 0 ),
+        frames( 0 ),
+        firstScale( 5. ),
+        lastScale( 5. ),
+        counters( false ),
+        captureMatrixMarket( false )
+      {}
+
+      bool useDouble; // solve in double rather than single precision
+      bool useCache; // read and write the binary mesh cache
+      bool watch; // keep running and recompute whenever the inputs change
+      int rings; // in watch mode, size of the local update region (-1: global)
+      int threads; // in batch mode, number of jobs run at once (0: one per core)
+      int frames; // number of frames in sequence mode (0: single run)
+      double firstScale, lastScale; // scale of the first and last frame
+      string meshFile, imageFile, resultFile;
+      string manifestFile; // job list for batch mode (empty: single run)
+      string socketFile; // socket to serve requests on (empty: single run)
+      string profileFile; // JSON timing report (empty: no profiling)
+      string traceFile; // Chrome trace of the run (empty: no tracing)
+      bool counters; // add hardware counters to the profile
+      string captureDirectory; // where to save each solved system (empty: nowhere)
+      bool captureMatrixMarket; // save captured systems in Matrix Market format too
+};
+
+class Job
+// one line of a batch manifest
+{
+   public:
+      string meshFile, imageFile, resultFile;
+      double scale;
+};
+
+void readManifest( const string& filename, vector<Job>& jobs )
+// reads a batch manifest, which has one job per line in the form
+//
+//    mesh.obj image.tga scale result.obj
+//
+// blank lines and lines starting with # are ignored
+{
+   ifstream in( filename.c_str() );
+   if( !in.is_open() )
    {
-      cerr << "usage: " << argv[0] << " mesh.obj image.tga result.obj" << endl;
-      return 1;
+      cerr << "Error: couldn't open file ";
+      cerr << filename;
+      cerr << " for input!" << endl;
+      exit( 1 );
    }
 
+   string line;
+   int lineNumber = 0;
+   while( getline( in, line ))
+   {
+      lineNumber++;
+
+      stringstream ss( line );
+      string first;
+      if( !( ss >> first ) || first[0] == '#' )
+      {
+         continue;
+      }
+
+      Job job;
+      job.meshFile = first;
+      string rest;
+      if( !( ss >> job.imageFile >> job.scale >> job.resultFile ) || ( ss >> rest ))
+      {
+         cerr << "Error: " << filename << ":" << lineNumber;
+         cerr << ": expected \"mesh image scale result\"" << endl;
+         exit( 1 );
+      }
+      jobs.push_back( job );
+   }
+}
+
+template <class T>
+int runBatch( const Options& options )
+// runs every job in the manifest on a thread pool -- each distinct mesh
+// and image is loaded only once, and all jobs on the same mesh share its
+// Laplacian (which depends only on the mesh, not on the image or scale)
+{
+   vector<Job> jobs;
+   readManifest( options.manifestFile, jobs );
+
+   map< string, shared_ptr< Mesh<T> > > meshes;
+   map< string, shared_ptr< Image > > images;
+   for( size_t i = 0; i < jobs.size(); i++ )
+   {
+      meshes[ jobs[i].meshFile ];
+      images[ jobs[i].imageFile ];
+   }
+
+   {
+      ThreadPool pool( options.threads );
+
+      // load the inputs on the pool too; each task fills in its own entry,
+      // which stays empty if the file can't be read, and splits the pool's
+      // threads with the other loads
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      int loadThreads = max( 1, (int) ( pool.size() / ( meshes.size() + images.size() )));
+      for( typename map< string, shared_ptr< Mesh<T> > >::iterator m = meshes.begin(); m != meshes.end(); m++ )
+      {
+         const string& meshFile( m->first );
+         shared_ptr< Mesh<T> >& prototype( m->second );
+         pool.submit( [&options,&meshFile,&prototype,loadThreads]
+         {
+            omp_set_num_threads( loadThreads );
+
+            shared_ptr< Mesh<T> > mesh( new Mesh<T>() );
+            mesh->useCache = options.useCache;
+            if( mesh->read( meshFile ))
+            {
+               mesh->prepareOperators();
+               prototype = mesh;
+            }
+         });
+      }
+      for( map< string, shared_ptr< Image > >::iterator i = images.begin(); i != images.end(); i++ )
+      {
+         const string& imageFile( i->first );
+         shared_ptr< Image >& prototype( i->second );
+         pool.submit( [&imageFile,&prototype,loadThreads]
+         {
+            omp_set_num_threads( loadThreads );
+
+            shared_ptr< Image > image( new Image() );
+            if( image->read( imageFile.c_str() ))
+            {
+               prototype = image;
+            }
+         });
+      }
+      pool.wait();
+
+      for( typename map< string, shared_ptr< Mesh<T> > >::iterator m = meshes.begin(); m != meshes.end(); m++ )
+      {
+         if( !m->second ) return 1;
+      }
+      for( map< string, shared_ptr< Image > >::iterator i = images.begin(); i != images.end(); i++ )
+      {
+         if( !i->second ) return 1;
+      }
+
+      chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+
+      // jobs already run concurrently, so each one uses a single thread
+      for( size_t i = 0; i < jobs.size(); i++ )
+      {
+         const Job& job( jobs[i] );
+         const Mesh<T>& prototype( *meshes[ job.meshFile ] );
+         const Image& image( *images[ job.imageFile ] );
+
+         pool.submit( [&job,&prototype,&image]
+         {
+            omp_set_num_threads( 1 );
+
+            Mesh<T> mesh( prototype );
+            mesh.setCurvatureChange( image, (T) job.scale );
+            mesh.updateDeformation();
+            mesh.write( job.resultFile );
+         });
+      }
+      pool.wait();
+
+      chrono::steady_clock::time_point done = chrono::steady_clock::now();
+      double loadTime = chrono::duration<double>( loaded - start ).count();
+      double runTime = chrono::duration<double>( done - loaded ).count();
+
+      cout << jobs.size() << " jobs on " << meshes.size() << " meshes and ";
+      cout << images.size() << " images, " << pool.size() << " threads" << endl;
+      cout << "load: " << loadTime << " s, run: " << runTime << " s, ";
+      cout << jobs.size() / runTime << " jobs/sec (";
+      cout << jobs.size() / ( loadTime + runTime ) << " including loading)" << endl;
+   }
+
+   return 0;
+}
+
+void writeProfile( const Options& options )
+// writes the timing report and trace, if they were asked for
+{
+   if( !options.profileFile.empty() && !Profiler::write( options.profileFile ))
+   {
+      cerr << "Error: couldn't write profile to " << options.profileFile << "!" << endl;
+   }
+
+   if( !options.traceFile.empty() && !Profiler::writeTrace( options.traceFile ))
+   {
+      cerr << "Error: couldn't write trace to " << options.traceFile << "!" << endl;
+   }
+}
+
+template <class T>
+int run( const Options& options )
+// loads the mesh and image, applies the transformation in precision T
+// and writes the result; in watch mode, repeats whenever the mesh or
+// image file is rewritten
+{
    // load mesh
-   Mesh mesh;
-   mesh.read( argv[1] );
+   Mesh<T> mesh;
+   mesh.useCache = options.useCache;
+   if( !mesh.read( options.meshFile ))
+   {
+      return 1;
+   }
 
    // load image
    Image image;
-   image.read( argv[2] );
+   if( !image.read( options.imageFile.c_str() ))
+   {
+      return 1;
+   }
 
    // apply transformation
-   const float scale = 5.;
+   const T scale = options.firstScale;
    mesh.setCurvatureChange( image, scale );
    mesh.updateDeformation();
 
    // write result
-   mesh.write( argv[3] );
+   mesh.write( options.resultFile );
+
+   if( !options.watch )
+   {
+      return 0;
+   }
+
+   FileWatcher watcher;
+   bool watchMesh = ( options.meshFile != options.resultFile );
+   if( !watcher.add( options.imageFile ) ||
+       ( watchMesh && !watcher.add( options.meshFile )))
+   {
+      cerr << "Error: couldn't watch input files for changes!" << endl;
+      return 1;
+   }
+   cout << "watching " << options.imageFile;
+   if( watchMesh ) cout << " and " << options.meshFile;
+   cout << " for changes" << endl;
+
+   while( true )
+   {
+      vector<string> changed = watcher.wait();
+
+      bool meshChanged = false;
+      bool imageChanged = false;
+      for( size_t i = 0; i < changed.size(); i++ )
+      {
+         if( changed[i] == options.meshFile ) meshChanged = true;
+         if( changed[i] == options.imageFile ) imageChanged = true;
+      }
+
+      // a new mesh invalidates everything; a new image only changes rho,
+      // so the previous solution is a good starting point
+      if(( meshChanged && !mesh.read( options.meshFile )) ||
+          ( imageChanged && !image.reload() ))
+      {
+         return 1;
+      }
+
+      int nChanged = mesh.setCurvatureChange( image, scale );
+      if( !meshChanged && nChanged == 0 )
+      {
+         cout << "no faces changed" << endl;
+         continue;
+      }
+      cout << nChanged << " faces changed" << endl;
+
+      if( !meshChanged && options.rings >= 0 )
+      {
+         bool accepted = mesh.updateDeformationLocal( options.rings );
+         cout << "local update of " << mesh.localVertices << " vertices";
+         if( mesh.localEigenResidual >= 0. )
+         {
+            cout << " (boundary residuals " << mesh.localEigenResidual << ", "
+                 << mesh.localPoissonResidual << ")";
+         }
+         cout << ": " << ( accepted ? "accepted" : "solved globally instead" ) << endl;
+      }
+      else
+      {
+         mesh.updateDeformation( !meshChanged );
+      }
+      mesh.write( options.resultFile );
+      writeProfile( options );
+   }
+
+   return 0;
+}
+
+string frameName( const string& pattern, int frame, bool insert )
+// replaces the first run of #'s in pattern by the zero-padded frame number;
+// if there is none and insert is set, ".####" goes before the extension
+{
+   size_t begin = pattern.find( '#' );
+   if( begin == string::npos )
+   {
+      if( !insert )
+      {
+         return pattern;
+      }
+
+      size_t dot = pattern.rfind( '.' );
+      size_t slash = pattern.rfind( '/' );
+      if( dot == string::npos || ( slash != string::npos && dot < slash ))
+      {
+         dot = pattern.size();
+      }
+      return frameName( pattern.substr( 0, dot ) + ".####" + pattern.substr( dot ), frame, false );
+   }
+
+   size_t end = pattern.find_first_not_of( '#', begin );
+   if( end == string::npos ) end = pattern.size();
+
+   string number = to_string( frame );
+   if( number.size() < end-begin )
+   {
+      number.insert( 0, end-begin-number.size(), '0' );
+   }
+
+   return pattern.substr( 0, begin ) + number + pattern.substr( end );
+}
+
+template <class T>
+int runSequence( const Options& options )
+// computes options.frames frames with the scale going linearly from
+// firstScale to lastScale and the image (if its name contains #'s) going
+// through an image sequence -- each frame starts from the solution of the
+// previous one, which is usually only a small step away
+{
+   Mesh<T> mesh;
+   mesh.useCache = options.useCache;
+   if( !mesh.read( options.meshFile ))
+   {
+      return 1;
+   }
+
+   Image image;
+   string currentImage;
+
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   for( int frame = 0; frame < options.frames; frame++ )
+   {
+      chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+
+      double t = options.frames > 1 ? (double) frame / ( options.frames-1 ) : 0.;
+      T scale = ( 1.-t ) * options.firstScale + t * options.lastScale;
+
+      string imageFile = frameName( options.imageFile, frame, false );
+      if( imageFile != currentImage )
+      {
+         if( !image.read( imageFile.c_str() ))
+         {
+            return 1;
+         }
+         currentImage = imageFile;
+      }
+
+      mesh.setCurvatureChange( image, scale );
+      mesh.updateDeformation( frame > 0 );
+
+      string resultFile = frameName( options.resultFile, frame, true );
+      mesh.write( resultFile );
+
+      double elapsed = chrono::duration<double>( chrono::steady_clock::now() - frameStart ).count();
+      cout << "frame " << frame << " (scale " << scale << "): " << resultFile << ", " << elapsed << " s" << endl;
+   }
+
+   double total = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+   cout << options.frames << " frames in " << total << " s" << endl;
+
+   return 0;
+}
+
+template <class T>
+int serve( const Options& options )
+// keeps meshes resident and serves deformation requests (see Server.h)
+{
+   Server<T> server;
+   server.useCache = options.useCache;
+   if( !server.listen( options.socketFile ))
+   {
+      cerr << "Error: couldn't listen on " << options.socketFile << "!" << endl;
+      return 1;
+   }
 
+   cout << "listening on " << options.socketFile << endl;
+   server.run();
    return 0;
 }
 
+template <class T>
+int runMode( const Options& options )
+// runs whichever mode the options select, in precision T
+{
+   if( !options.socketFile.empty() ) return serve<T>( options );
+   if( !options.manifestFile.empty() ) return runBatch<T>( options );
+   if( options.frames > 0 ) return runSequence<T>( options );
+   return run<T>( options );
+}
+
+int main( int argc, char **argv )
+{
+   // parse options
+   Options options;
+   int arg = 1;
+   while( arg < argc && argv[arg][0] == '-' )
+   {
+      string option( argv[arg] );
+
+      if( option == "-double" ) options.useDouble = true;
+      else if( option == "-float" ) options.useDouble = false;
+      else if( option == "-nocache" ) options.useCache = false;
+      else if( option == "-watch" ) options.watch = true;
+      else if( option == "-roi" && arg+1 < argc ) options.rings = atoi( argv[++arg] );
+      else if( option == "-batch" && arg+1 < argc ) options.manifestFile = argv[++arg];
+      else if( option == "-threads" && arg+1 < argc ) options.threads = atoi( argv[++arg] );
+      else if( option == "-serve" && arg+1 < argc ) options.socketFile = argv[++arg];
+      else if( option == "-profile" && arg+1 < argc ) options.profileFile = argv[++arg];
+      else if( option == "-trace" && arg+1 < argc ) options.traceFile = argv[++arg];
+      else if( option == "-counters" ) options.counters = true;
+      else if( option == "-capture" && arg+1 < argc ) options.captureDirectory = argv[++arg];
+      else if( option == "-capturemtx" && arg+1 < argc )
+      {
+         options.captureDirectory = argv[++arg];
+         options.captureMatrixMarket = true;
+      }
+      else if( option == "-scale" && arg+1 < argc ) options.firstScale = options.lastScale = atof( argv[++arg] );
+      else if( option == "-sequence" && arg+3 < argc )
+      {
+         options.frames = atoi( argv[++arg] );
+         options.firstScale = atof( argv[++arg] );
+         options.lastScale = atof( argv[++arg] );
+      }
+      else break;
+
+      arg++;
+   }
+
+   // batch and server modes take no file arguments
+   bool noFiles = !options.socketFile.empty() || !options.manifestFile.empty();
+
+   // counters are reported in the profile, so they need one
+   bool strayCounters = options.counters && options.profileFile.empty();
+   if( argc - arg != ( noFiles ? 0 : 3 ) || strayCounters )
+   {
+      if( strayCounters )
+      {
+         cerr << "Error: -counters needs -profile" << endl;
+      }
+      cerr << "usage: " << argv[0] << " [-float|-double] [-nocache] [-profile report.json [-counters]] [-trace trace.json] [-capture|-capturemtx dir] [-scale s] [-watch [-roi rings]] mesh.obj image.tga result.obj" << endl;
+      cerr << "       " << argv[0] << " [-float|-double] [-nocache] [-profile report.json [-counters]] [-trace trace.json] [-capture|-capturemtx dir] -sequence frames firstScale lastScale mesh.obj image###.tga result###.obj" << endl;
+      cerr << "       " << argv[0] << " [-float|-double] [-nocache] [-profile report.json [-counters]] [-trace trace.json] [-capture|-capturemtx dir] [-threads n] -batch manifest.txt" << endl;
+      cerr << "       " << argv[0] << " [-float|-double] [-nocache] [-profile report.json [-counters]] [-trace trace.json] [-capture|-capturemtx dir] -serve socket" << endl;
+      return 1;
+   }
+
+   if( !noFiles )
+   {
+      options.meshFile   = argv[arg];
+      options.imageFile  = argv[arg+1];
+      options.resultFile = argv[arg+2];
+   }
+
+   if( !options.profileFile.empty() )
+   {
+      Profiler::enable();
+
+      if( options.counters && !Profiler::enableCounters() )
+      {
+         cerr << "Warning: hardware performance counters are unavailable; profiling without them" << endl;
+      }
+   }
+
+   // a million events is enough for several hundred solves and takes
+   // about 50 MB; older events are overwritten beyond that
+   if( !options.traceFile.empty() )
+   {
+      Profiler::enableTrace( 1 << 20 );
+   }
+
+   if( !options.captureDirectory.empty() )
+   {
+      SystemCapture::enable( options.captureDirectory, options.captureMatrixMarket );
+   }
+
+   int status;
+   if( options.useDouble )
+   {
+      status = runMode<double>( options );
+   }
+   else
+   {
+      status = runMode<float>( options );
+   }
+
+   writeProfile( options );
+   return status;
+}
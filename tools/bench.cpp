@@ -0,0 +1,354 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- bench.cpp
+//
+// End-to-end benchmark: runs read -> setCurvatureChange -> updateDeformation
+// -> write on the example sphere and on generated meshes of increasing size,
+// reports the median, mean and spread of each phase, and optionally compares
+// the medians against a stored baseline.  Usage:
+//
+//    spinxformbench [-repeat n] [-warmup n] [-maxfaces n] [-double]
+//                   [-shape uvsphere|icosphere|torus]
+//                   [-mesh sphere.obj] [-image bumpy.tga]
+//                   [-json results.json] [-csv results.csv]
+//                   [-baseline baseline.json] [-threshold 0.1] [-floor 1]
+//
+// A phase regresses if its median exceeds the baseline median by more than
+// the threshold (a fraction) and by more than the floor (in milliseconds,
+// to ignore noise in very short phases); the exit status is 1 if any phase
+// regressed.  Baselines are simply earlier -json results, so they should be
+// recorded on the machine they are compared on ("make bench-baseline").
+//
+// Generated meshes come from MeshGenerator (a latitude-longitude sphere by
+// default); they are written to a temporary directory, so that the read
+// phase is timed on them too, and removed afterwards.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "Image.h"
+
+using namespace std;
+
+static const char* phaseNames[] = { "read", "rho", "deform", "write", "total" };
+static const int nPhases = 5;
+
+class BenchCase
+// one mesh to benchmark
+{
+   public:
+      string name; // as it appears in reports
+      string meshFile;
+      int faces; // requested size (0: the file as is)
+};
+
+class PhaseResult
+// statistics of one phase of one case, in milliseconds
+{
+   public:
+      string caseName, phase;
+      int runs;
+      double median, mean, stddev, min, max;
+};
+
+PhaseResult summarize( const string& caseName, const string& phase, vector<double> times )
+// computes statistics of a list of times (in milliseconds)
+{
+   PhaseResult r;
+   r.caseName = caseName;
+   r.phase = phase;
+   r.runs = times.size();
+
+   sort( times.begin(), times.end() );
+   size_t n = times.size();
+   r.median = ( n % 2 ) ? times[n/2] : .5*( times[n/2-1] + times[n/2] );
+   r.min = times.front();
+   r.max = times.back();
+
+   r.mean = 0.;
+   for( size_t i = 0; i < n; i++ ) r.mean += times[i];
+   r.mean /= n;
+
+   double variance = 0.;
+   for( size_t i = 0; i < n; i++ ) variance += ( times[i]-r.mean )*( times[i]-r.mean );
+   r.stddev = n > 1 ? sqrt( variance / ( n-1 )) : 0.;
+
+   return r;
+}
+
+template <class T>
+void runCase( const BenchCase& c, const Image& image, const string& outputFile,
+              int warmup, int repeat, vector<PhaseResult>& results )
+// times the pipeline on one mesh
+{
+   vector< vector<double> > times( nPhases );
+
+   for( int run = 0; run < warmup + repeat; run++ )
+   {
+      double t[nPhases];
+      chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+
+      Mesh<T> mesh;
+      mesh.useCache = false;
+      if( !mesh.read( c.meshFile ))
+      {
+         exit( 1 );
+      }
+      chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+
+      mesh.setCurvatureChange( image, 5. );
+      chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+      mesh.updateDeformation();
+      chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+
+      mesh.write( outputFile );
+      chrono::steady_clock::time_point t4 = chrono::steady_clock::now();
+
+      t[0] = chrono::duration<double,milli>( t1-t0 ).count();
+      t[1] = chrono::duration<double,milli>( t2-t1 ).count();
+      t[2] = chrono::duration<double,milli>( t3-t2 ).count();
+      t[3] = chrono::duration<double,milli>( t4-t3 ).count();
+      t[4] = chrono::duration<double,milli>( t4-t0 ).count();
+
+      if( run >= warmup )
+      {
+         for( int p = 0; p < nPhases; p++ )
+         {
+            times[p].push_back( t[p] );
+         }
+      }
+   }
+
+   for( int p = 0; p < nPhases; p++ )
+   {
+      results.push_back( summarize( c.name, phaseNames[p], times[p] ));
+   }
+}
+
+bool writeJson( const string& filename, const vector<PhaseResult>& results )
+// writes one object per line, which is also what readBaseline() expects
+{
+   FILE* out = fopen( filename.c_str(), "w" );
+   if( out == NULL ) return false;
+
+   fprintf( out, "{ \"results\": [\n" );
+   for( size_t i = 0; i < results.size(); i++ )
+   {
+      const PhaseResult& r( results[i] );
+      fprintf( out, "   { \"case\": \"%s\", \"phase\": \"%s\", \"runs\": %d, \"median_ms\": %.6g, \"mean_ms\": %.6g, \"stddev_ms\": %.6g, \"min_ms\": %.6g, \"max_ms\": %.6g }%s\n",
+               r.caseName.c_str(), r.phase.c_str(), r.runs, r.median, r.mean, r.stddev, r.min, r.max,
+               i+1 < results.size() ? "," : "" );
+   }
+   fprintf( out, "] }\n" );
+
+   return fclose( out ) == 0;
+}
+
+bool writeCsv( const string& filename, const vector<PhaseResult>& results )
+{
+   FILE* out = fopen( filename.c_str(), "w" );
+   if( out == NULL ) return false;
+
+   fprintf( out, "case,phase,runs,median_ms,mean_ms,stddev_ms,min_ms,max_ms\n" );
+   for( size_t i = 0; i < results.size(); i++ )
+   {
+      const PhaseResult& r( results[i] );
+      fprintf( out, "%s,%s,%d,%.6g,%.6g,%.6g,%.6g,%.6g\n",
+               r.caseName.c_str(), r.phase.c_str(), r.runs, r.median, r.mean, r.stddev, r.min, r.max );
+   }
+
+   return fclose( out ) == 0;
+}
+
+bool readBaseline( const string& filename, vector<PhaseResult>& baseline )
+// reads the case, phase and median of each line written by writeJson()
+{
+   FILE* in = fopen( filename.c_str(), "r" );
+   if( in == NULL ) return false;
+
+   char line[1024];
+   while( fgets( line, sizeof(line), in ))
+   {
+      char caseName[256], phase[256];
+      PhaseResult r;
+      if( sscanf( line, " { \"case\": \"%255[^\"]\", \"phase\": \"%255[^\"]\", \"runs\": %d, \"median_ms\": %lf",
+                  caseName, phase, &r.runs, &r.median ) == 4 )
+      {
+         r.caseName = caseName;
+         r.phase = phase;
+         baseline.push_back( r );
+      }
+   }
+
+   fclose( in );
+   return true;
+}
+
+int compare( const vector<PhaseResult>& results, const vector<PhaseResult>& baseline,
+             double threshold, double floor )
+// prints the change of every phase found in the baseline; returns the
+// number of regressions
+{
+   int regressions = 0;
+
+   for( size_t i = 0; i < results.size(); i++ )
+   {
+      const PhaseResult& r( results[i] );
+      for( size_t j = 0; j < baseline.size(); j++ )
+      {
+         const PhaseResult& b( baseline[j] );
+         if( b.caseName != r.caseName || b.phase != r.phase ) continue;
+
+         double change = b.median > 0. ? r.median / b.median - 1. : 0.;
+         bool regressed = change > threshold && r.median - b.median > floor;
+         if( regressed ) regressions++;
+
+         printf( "%-14s %-7s %10.2f ms  (baseline %10.2f ms, %+6.1f%%)%s\n",
+                 r.caseName.c_str(), r.phase.c_str(), r.median, b.median, 100.*change,
+                 regressed ? "  REGRESSION" : "" );
+      }
+   }
+
+   return regressions;
+}
+
+int main( int argc, char** argv )
+{
+   int repeat = 5, warmup = 1, maxFaces = 5000000;
+   bool useDouble = false;
+   double threshold = .1, floor = 1.;
+   string meshFile = "sphere.obj", imageFile = "bumpy.tga", shape = "uvsphere";
+   string jsonFile, csvFile, baselineFile;
+
+   for( int arg = 1; arg < argc; arg++ )
+   {
+      string option( argv[arg] );
+      bool hasValue = arg+1 < argc;
+
+      if( option == "-repeat" && hasValue ) repeat = max( 1, atoi( argv[++arg] ));
+      else if( option == "-warmup" && hasValue ) warmup = max( 0, atoi( argv[++arg] ));
+      else if( option == "-maxfaces" && hasValue ) maxFaces = atoi( argv[++arg] );
+      else if( option == "-double" ) useDouble = true;
+      else if( option == "-shape" && hasValue ) shape = argv[++arg];
+      else if( option == "-mesh" && hasValue ) meshFile = argv[++arg];
+      else if( option == "-image" && hasValue ) imageFile = argv[++arg];
+      else if( option == "-json" && hasValue ) jsonFile = argv[++arg];
+      else if( option == "-csv" && hasValue ) csvFile = argv[++arg];
+      else if( option == "-baseline" && hasValue ) baselineFile = argv[++arg];
+      else if( option == "-threshold" && hasValue ) threshold = atof( argv[++arg] );
+      else if( option == "-floor" && hasValue ) floor = atof( argv[++arg] );
+      else
+      {
+         cerr << "usage: " << argv[0] << " [-repeat n] [-warmup n] [-maxfaces n] [-double] [-shape uvsphere|icosphere|torus] [-mesh sphere.obj] [-image bumpy.tga]" << endl;
+         cerr << "       [-json results.json] [-csv results.csv] [-baseline baseline.json] [-threshold 0.1] [-floor ms]" << endl;
+         return 1;
+      }
+   }
+
+   // scratch space for generated meshes and results
+   char directory[] = "/tmp/spinxformbench.XXXXXX";
+   if( mkdtemp( directory ) == NULL )
+   {
+      cerr << "Error: couldn't create a temporary directory!" << endl;
+      return 1;
+   }
+   string outputFile = string( directory ) + "/result.obj";
+
+   vector<BenchCase> cases;
+   BenchCase example;
+   example.name = "example";
+   example.meshFile = meshFile;
+   example.faces = 0;
+   cases.push_back( example );
+
+   const int sizes[] = { 10000, 100000, 1000000, 5000000 };
+   for( size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++ )
+   {
+      if( sizes[s] > maxFaces ) continue;
+
+      BenchCase c;
+      c.faces = sizes[s];
+      c.name = shape + to_string( sizes[s] );
+      c.meshFile = string( directory ) + "/" + c.name + ".obj";
+
+      Meshd generated;
+      if( !MeshGenerator<double>::generate( generated, shape, c.faces ))
+      {
+         cerr << "Error: unknown shape " << shape << "!" << endl;
+         return 1;
+      }
+      if( !MeshGenerator<double>::writeObj( generated, c.meshFile ))
+      {
+         cerr << "Error: couldn't write " << c.meshFile << "!" << endl;
+         return 1;
+      }
+      cases.push_back( c );
+   }
+
+   Image image;
+   if( !image.read( imageFile.c_str() ))
+   {
+      return 1;
+   }
+
+   vector<PhaseResult> results;
+   for( size_t i = 0; i < cases.size(); i++ )
+   {
+      cout << "running " << cases[i].name << "..." << endl;
+      if( useDouble ) runCase<double>( cases[i], image, outputFile, warmup, repeat, results );
+      else            runCase<float> ( cases[i], image, outputFile, warmup, repeat, results );
+
+      if( cases[i].faces > 0 ) unlink( cases[i].meshFile.c_str() );
+   }
+   unlink( outputFile.c_str() );
+   rmdir( directory );
+
+   printf( "%-14s %-7s %10s %10s %10s\n", "case", "phase", "median_ms", "mean_ms", "stddev_ms" );
+   for( size_t i = 0; i < results.size(); i++ )
+   {
+      const PhaseResult& r( results[i] );
+      printf( "%-14s %-7s %10.2f %10.2f %10.2f\n", r.caseName.c_str(), r.phase.c_str(), r.median, r.mean, r.stddev );
+   }
+
+   if( !jsonFile.empty() && !writeJson( jsonFile, results ))
+   {
+      cerr << "Error: couldn't write " << jsonFile << "!" << endl;
+      return 1;
+   }
+   if( !csvFile.empty() && !writeCsv( csvFile, results ))
+   {
+      cerr << "Error: couldn't write " << csvFile << "!" << endl;
+      return 1;
+   }
+
+   if( !baselineFile.empty() )
+   {
+      vector<PhaseResult> baseline;
+      if( !readBaseline( baselineFile, baseline ))
+      {
+         cerr << "Error: couldn't read baseline " << baselineFile << "!" << endl;
+         return 1;
+      }
+
+      cout << endl << "compared to " << baselineFile << " (threshold " << 100.*threshold << "%):" << endl;
+      int regressions = compare( results, baseline, threshold, floor );
+      if( regressions > 0 )
+      {
+         cout << regressions << " phase(s) regressed" << endl;
+         return 1;
+      }
+   }
+
+   return 0;
+}
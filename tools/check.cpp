@@ -0,0 +1,424 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- check.cpp
+//
+// Runs consistency checks of the solver's building blocks on small random
+// matrices and prints one line per check.  Usage:
+//
+//    spinxformcheck
+//
+// The exit status is 0 if every check passes and 1 otherwise.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "QuaternionMatrix.h"
+#include "SellMatrix.h"
+#include "cusp_device.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void report( const string& name, bool passed )
+{
+   printf( "%-48s %s\n", name.c_str(), passed ? "ok" : "FAILED" );
+   if( !passed ) failures++;
+}
+
+static int randomComponent( void )
+// returns one of -3..-1, 1..3
+{
+   int c = rand() % 6 - 3;
+   return c < 0 ? c : c+1;
+}
+
+template <class T>
+static Quaternion<T> randomQuaternion( void )
+// returns a quaternion without zero components, so that its 4x4 block is
+// fully stored in the real matrix and adding to it never adds nonzeros
+{
+   return Quaternion<T>( (T) randomComponent(), (T) randomComponent(),
+                         (T) randomComponent(), (T) randomComponent() );
+}
+
+template <class T>
+static bool sameMatrix( const cusp::csr_matrix<int, T, cusp::host_memory>& A,
+                        const cusp::csr_matrix<int, T, cusp::host_memory>& B )
+// returns whether A and B have the same nonzeros (a patched matrix keeps
+// explicit zeros where a rebuild leaves them out)
+{
+   if( A.num_rows != B.num_rows ) return false;
+   for( size_t r = 0; r < A.num_rows; r++ )
+   {
+      int a = A.row_offsets[r], b = B.row_offsets[r];
+      while( true )
+      {
+         while( a < A.row_offsets[r+1] && A.values[a] == 0 ) a++;
+         while( b < B.row_offsets[r+1] && B.values[b] == 0 ) b++;
+         if( a == A.row_offsets[r+1] || b == B.row_offsets[r+1] ) break;
+         if( A.column_indices[a] != B.column_indices[b] || A.values[a] != B.values[b] ) return false;
+         a++;
+         b++;
+      }
+      if( a != A.row_offsets[r+1] || b != B.row_offsets[r+1] ) return false;
+   }
+   return true;
+}
+
+template <class T>
+static void checkPatch( bool symmetric )
+// entries changed through add() must be patched into the cached real
+// matrix, and the patched matrix must equal a full rebuild
+{
+   const int n = 50;
+   QuaternionMatrix<T> A;
+   A.setSymmetric( symmetric );
+   A.resize( n, n );
+   for( int i = 0; i < n; i++ )
+   for( int j = 0; j < n; j++ )
+   {
+      if(( i == j || rand() % 8 == 0 ) && A.stores( i, j )) A.add( i, j, randomQuaternion<T>() );
+   }
+   A.toRealCsrFormat();
+
+   // add to existing entries only, so that the pattern doesn't change
+   vector< typename QuaternionMatrix<T>::EntryIndex > indices;
+   vector< Quaternion<T> > values;
+   A.getEntries( indices, values );
+   for( size_t k = 0; k < indices.size(); k += 3 )
+   {
+      A.add( indices[k].second, indices[k].first, randomQuaternion<T>() );
+   }
+   size_t rebuilds = A.realRebuilds();
+   const cusp::csr_matrix<int, T, cusp::host_memory>& patched = A.toRealCsrFormat();
+
+   QuaternionMatrix<T> B;
+   B.setSymmetric( symmetric );
+   B.resize( n, n );
+   A.getEntries( indices, values );
+   B.setEntries( indices, values );
+
+   string name = string( "patched real matrix, " ) +
+                 ( sizeof(T) == sizeof(float) ? "float" : "double" ) +
+                 ( symmetric ? ", symmetric" : ", full" );
+   report( name + ": patched, not rebuilt", A.realRebuilds() == rebuilds );
+   report( name + ": equals rebuild", sameMatrix( patched, B.toRealCsrFormat() ));
+}
+
+template <class T>
+static void randomSystem( int n, bool farEntry,
+                          cusp::csr_matrix<int, T, cusp::host_memory>& upper,
+                          cusp::array1d<T, cusp::host_memory>& b )
+// fills upper with the upper triangle of a random, strictly diagonally
+// dominant (so positive definite) banded matrix with a few scattered
+// entries, and b with a random right-hand side; if farEntry is set, row 0
+// also couples to row n-1
+{
+   vector< vector<int> > columns( n );
+   vector< vector<T> > values( n );
+   for( int i = 0; i < n; i++ )
+   {
+      columns[i].push_back( i );
+      values[i].push_back( (T) 0. );
+      for( int j = i+1; j < n && j < i+600; j++ )
+      {
+         if( j - i > 3 && rand() % 200 != 0 ) continue;
+         columns[i].push_back( j );
+         values[i].push_back( (T) randomComponent() );
+      }
+   }
+   if( farEntry && n > 1 && columns[0].back() != n-1 )
+   {
+      columns[0].push_back( n-1 );
+      values[0].push_back( (T) randomComponent() );
+   }
+
+   vector<T> diagonal( n, (T) 1. );
+   for( int i = 0; i < n; i++ )
+   for( size_t k = 1; k < columns[i].size(); k++ )
+   {
+      diagonal[i] += fabs( values[i][k] );
+      diagonal[ columns[i][k] ] += fabs( values[i][k] );
+   }
+
+   size_t entries = 0;
+   for( int i = 0; i < n; i++ ) entries += columns[i].size();
+   upper.resize( n, n, entries );
+   size_t k = 0;
+   for( int i = 0; i < n; i++ )
+   {
+      upper.row_offsets[i] = k;
+      values[i][0] = diagonal[i];
+      for( size_t l = 0; l < columns[i].size(); l++, k++ )
+      {
+         upper.column_indices[k] = columns[i][l];
+         upper.values[k] = values[i][l];
+      }
+   }
+   upper.row_offsets[n] = k;
+
+   b.resize( n );
+   for( int i = 0; i < n; i++ ) b[i] = (T) randomComponent();
+}
+
+template <class T>
+static bool close( const cusp::array1d<T, cusp::host_memory>& x,
+                   const cusp::array1d<T, cusp::host_memory>& y, double tolerance )
+// returns whether x and y are nonzero and differ by at most tolerance
+// relative to the largest entry of y
+{
+   double difference = 0., norm = 0.;
+   for( size_t i = 0; i < x.size(); i++ )
+   {
+      difference = max( difference, (double) fabs( x[i] - y[i] ));
+      norm = max( norm, (double) fabs( y[i] ));
+   }
+   return x.size() == y.size() && norm > 0. && difference <= tolerance * norm;
+}
+
+template <class T>
+static string precisionName( void )
+{
+   return sizeof(T) == sizeof(float) ? "float" : "double";
+}
+
+template <class T>
+static void checkSymmetricSolve( void )
+// CG on the upper triangle of a symmetric matrix (whose SpMV scatters the
+// mirrored entries to other rows) must take the same steps as CG on the
+// full matrix -- in particular when Thrust's host system runs rows on
+// several threads (build with -DTHRUST_HOST_SYSTEM=THRUST_HOST_SYSTEM_OMP)
+{
+   cusp::csr_matrix<int, T, cusp::host_memory> upper, full;
+   cusp::array1d<T, cusp::host_memory> b;
+   randomSystem( 2000, false, upper, b );
+   expand_symmetric( upper, full );
+
+   // a fixed number of iterations, so that both runs take the same steps
+   SolverOptions options;
+   options.backend = SolverOptions::host;
+   options.tolerance = 0.;
+   options.maxIterations = 20;
+   cusp::array1d<T, cusp::host_memory> x( b.size(), (T) 0. ), y( b.size(), (T) 0. );
+   solve_on_device( upper, b, x, options, true );
+   solve_on_device( full, b, y, options, false );
+
+   double tolerance = sizeof(T) == sizeof(float) ? 1e-4 : 1e-10;
+   report( "symmetric SpMV in CG, " + precisionName<T>() + ": equals full matrix", close( x, y, tolerance ));
+}
+
+template <class T>
+static void checkCompressedIndices( bool farEntry )
+// CG must take the same steps with column indices compressed to 16-bit
+// differences as without; if a difference within a row exceeds 65535 (as
+// the entry coupling rows 0 and n-1 of a large matrix does), the indices
+// must be kept as they are
+{
+   cusp::csr_matrix<int, T, cusp::host_memory> upper, full;
+   cusp::array1d<T, cusp::host_memory> b;
+   randomSystem( farEntry ? 70000 : 2000, farEntry, upper, b );
+   expand_symmetric( upper, full );
+
+   SolverOptions options;
+   options.backend = SolverOptions::host;
+   options.tolerance = 0.;
+   options.maxIterations = 20;
+
+   double tolerance = sizeof(T) == sizeof(float) ? 1e-4 : 1e-10;
+   for( int symmetric = 0; symmetric < 2; symmetric++ )
+   {
+      const cusp::csr_matrix<int, T, cusp::host_memory>& A( symmetric ? upper : full );
+      cusp::array1d<T, cusp::host_memory> x( b.size(), (T) 0. ), y( b.size(), (T) 0. );
+      options.compressIndices = false;
+      SolverStatistics plain = solve_on_device( A, b, x, options, symmetric );
+      options.compressIndices = true;
+      SolverStatistics compressed = solve_on_device( A, b, y, options, symmetric );
+
+      string name = "compressed indices, " + precisionName<T>() +
+                    ( symmetric ? ", symmetric" : ", full" ) +
+                    ( farEntry ? ", wide" : "" );
+      report( name + ": equals plain", close( y, x, tolerance ));
+      if( farEntry )
+      {
+         report( name + ": falls back", compressed.spmvBytes == plain.spmvBytes );
+      }
+      else
+      {
+         report( name + ": compressed", compressed.spmvBytes < plain.spmvBytes );
+      }
+   }
+}
+
+template <class T>
+static void checkMethods( SolverOptions::Preconditioner preconditioner )
+// the fused and pipelined reformulations of CG must take the same steps as
+// the standard one, up to rounding; 30 iterations take the pipelined
+// variant through a residual replacement and stop short of the (Jacobi
+// preconditioned) float solve reaching a zero residual, after which
+// standard CG divides by zero
+{
+   cusp::csr_matrix<int, T, cusp::host_memory> upper;
+   cusp::array1d<T, cusp::host_memory> b;
+   randomSystem( 2000, false, upper, b );
+
+   SolverOptions options;
+   options.backend = SolverOptions::host;
+   options.preconditioner = preconditioner;
+   options.tolerance = 0.;
+   options.maxIterations = 30;
+   cusp::array1d<T, cusp::host_memory> x( b.size(), (T) 0. );
+   solve_on_device( upper, b, x, options, true );
+
+   const SolverOptions::Method methods[] = { SolverOptions::fused, SolverOptions::pipelined };
+   const char* names[] = { "fused", "pipelined" };
+   for( int m = 0; m < 2; m++ )
+   {
+      options.method = methods[m];
+      cusp::array1d<T, cusp::host_memory> y( b.size(), (T) 0. );
+      solve_on_device( upper, b, y, options, true );
+
+      double tolerance = sizeof(T) == sizeof(float) ? 1e-3 : 1e-9;
+      report( string( names[m] ) + " CG, " + precisionName<T>() +
+              ( preconditioner == SolverOptions::identity ? "" : ", jacobi" ) +
+              ": equals standard", close( y, x, tolerance ));
+   }
+}
+
+template <class T>
+static void csrMultiply( const cusp::csr_matrix<int, T, cusp::host_memory>& A,
+                         const cusp::array1d<T, cusp::host_memory>& x,
+                         cusp::array1d<T, cusp::host_memory>& y )
+// computes y = Ax one row at a time
+{
+   y.resize( A.num_rows );
+   for( size_t r = 0; r < A.num_rows; r++ )
+   {
+      double sum = 0.;
+      for( int k = A.row_offsets[r]; k < A.row_offsets[r+1]; k++ )
+      {
+         sum += (double) A.values[k] * x[ A.column_indices[k] ];
+      }
+      y[r] = (T) sum;
+   }
+}
+
+template <class T>
+static void checkSell( void )
+// the SELL-C-sigma SpMV must equal a CSR one, whether it is built from the
+// full matrix or from its upper triangle, and the SELL form cached by
+// QuaternionMatrix must follow entries changed through add()
+{
+   cusp::csr_matrix<int, T, cusp::host_memory> upper, full;
+   cusp::array1d<T, cusp::host_memory> x, expected, y;
+   randomSystem( 2000, false, upper, x );
+   expand_symmetric( upper, full );
+   csrMultiply( full, x, expected );
+
+   double tolerance = sizeof(T) == sizeof(float) ? 1e-5 : 1e-12;
+   string name = "SELL SpMV, " + precisionName<T>();
+   for( int symmetric = 0; symmetric < 2; symmetric++ )
+   {
+      SellMatrix<T> S;
+      S.build( symmetric ? upper : full, symmetric );
+      y.resize( x.size() );
+      S.multiply( &x[0], &y[0] );
+      report( name + ( symmetric ? ", symmetric" : ", full" ) + ": equals CSR", close( y, expected, tolerance ));
+   }
+
+   // a Hermitian matrix (real diagonal), so that multiply() applies the
+   // same matrix as the real form of its upper triangle
+   const int n = 50;
+   QuaternionMatrix<T> A;
+   A.setSymmetric( true );
+   A.resize( n, n );
+   for( int i = 0; i < n; i++ )
+   {
+      A.add( i, i, Quaternion<T>( (T) randomComponent(), 0., 0., 0. ));
+      for( int j = i+1; j < n; j++ )
+      {
+         if( rand() % 8 == 0 ) A.add( i, j, randomQuaternion<T>() );
+      }
+   }
+   A.toSellFormat();
+
+   vector< typename QuaternionMatrix<T>::EntryIndex > indices;
+   vector< Quaternion<T> > values;
+   A.getEntries( indices, values );
+   for( size_t k = 0; k < indices.size(); k += 3 )
+   {
+      int i = indices[k].second, j = indices[k].first;
+      A.add( i, j, i == j ? Quaternion<T>( (T) randomComponent(), 0., 0., 0. ) : randomQuaternion<T>() );
+   }
+
+   vector< Quaternion<T> > q( n ), Aq;
+   for( int i = 0; i < n; i++ ) q[i] = randomQuaternion<T>();
+   A.multiply( q, Aq );
+   x.resize( 4*n );
+   expected.resize( 4*n );
+   for( int i = 0; i < n; i++ )
+   {
+      x[4*i+0] = q[i].re();   expected[4*i+0] = Aq[i].re();
+      x[4*i+1] = q[i].im().x; expected[4*i+1] = Aq[i].im().x;
+      x[4*i+2] = q[i].im().y; expected[4*i+2] = Aq[i].im().y;
+      x[4*i+3] = q[i].im().z; expected[4*i+3] = Aq[i].im().z;
+   }
+   y.resize( 4*n );
+   A.toSellFormat().multiply( &x[0], &y[0] );
+   report( name + ", cached: follows add()", close( y, expected, tolerance ));
+}
+
+static void checkThreadPool( void )
+// every task submitted while the workers are busy must run exactly once --
+// many workers racing for few tasks used to find every queue empty
+{
+   const int rounds = 200, tasks = 2000;
+   ThreadPool pool( 16 );
+   atomic<long> ran( 0 );
+   for( int r = 0; r < rounds; r++ )
+   {
+      for( int t = 0; t < tasks; t++ )
+      {
+         pool.submit( [&ran]{ ran.fetch_add( 1, memory_order_relaxed ); } );
+      }
+      pool.wait();
+   }
+
+   report( "thread pool: every task runs once", ran.load() == (long) rounds * tasks );
+}
+
+int main( int argc, char** argv )
+{
+   srand( 1 );
+
+   checkPatch<float>( false );
+   checkPatch<float>( true );
+   checkPatch<double>( false );
+   checkPatch<double>( true );
+
+   checkSymmetricSolve<float>();
+   checkSymmetricSolve<double>();
+
+   checkCompressedIndices<float>( false );
+   checkCompressedIndices<float>( true );
+   checkCompressedIndices<double>( false );
+   checkCompressedIndices<double>( true );
+
+   checkMethods<float>( SolverOptions::identity );
+   checkMethods<float>( SolverOptions::diagonal );
+   checkMethods<double>( SolverOptions::identity );
+   checkMethods<double>( SolverOptions::diagonal );
+
+   checkSell<float>();
+   checkSell<double>();
+
+   checkThreadPool();
+
+   return failures > 0 ? 1 : 0;
+}
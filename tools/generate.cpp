@@ -0,0 +1,49 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- generate.cpp
+//
+// Writes a procedural mesh with texture coordinates as an OBJ file that
+// spinxformgpu can deform.  Usage:
+//
+//    spinxformgenerate uvsphere|icosphere|torus faces output.obj
+//
+// The resolution is chosen to give about the requested number of faces
+// (see MeshGenerator::generate()).
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "MeshGenerator.h"
+
+using namespace std;
+
+int main( int argc, char** argv )
+{
+   if( argc != 4 || atoi( argv[2] ) <= 0 )
+   {
+      cerr << "usage: " << argv[0] << " uvsphere|icosphere|torus faces output.obj" << endl;
+      return 1;
+   }
+
+   string shape( argv[1] );
+   Meshd mesh;
+   mesh.useCache = false;
+
+   if( !MeshGenerator<double>::generate( mesh, shape, atoi( argv[2] )))
+   {
+      cerr << "Error: unknown shape " << shape << "!" << endl;
+      return 1;
+   }
+
+   if( !MeshGenerator<double>::writeObj( mesh, argv[3] ))
+   {
+      cerr << "Error: couldn't write file " << argv[3] << "!" << endl;
+      return 1;
+   }
+
+   cout << shape << ": " << mesh.vertices.size() << " vertices, "
+                         << mesh.faces.size() << " faces" << endl;
+
+   return 0;
+}
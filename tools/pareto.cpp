@@ -0,0 +1,372 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- pareto.cpp
+//
+// Accuracy-versus-time sweep: deforms sphere.obj with bumpy.tga under many
+// solver configurations (CG tolerance, CG iteration limit, number of inverse
+// iterations, precision and backend), measures each one's wall time and its
+// geometric error against reference_solution_sphere.obj, and reports the
+// configurations on the Pareto frontier, i.e., those that no other
+// configuration beats in both time and error.  Usage:
+//
+//    spinxformpareto [-quick] [-repeat n] [-scale s]
+//                    [-mesh sphere.obj] [-image bumpy.tga]
+//                    [-reference reference_solution_sphere.obj]
+//                    [-json results.json] [-csv results.csv]
+//
+// The error is measured after aligning the result to the reference with the
+// best similarity transformation (rotation, translation and uniform scale),
+// since spinxformgpu normalizes its output and the reference was written at
+// a different scale.  Both the largest and the RMS vertex distance are given
+// as fractions of the reference's RMS radius; the frontier uses the RMS.
+// Times cover setCurvatureChange() and updateDeformation() on a mesh whose
+// Laplacian is already built (the median of -repeat runs).
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+#include "Image.h"
+
+using namespace std;
+
+class Configuration
+// one point of the sweep and its outcome
+{
+   public:
+      bool useDouble;
+      SolverOptions options;
+      int eigenIterations;
+
+      double ms; // median time
+      double maxError, rmsError; // relative to the reference's RMS radius
+      bool pareto;
+};
+
+static void alignmentError( const vector< Quaternion<double> >& x,
+                            const vector< Quaternion<double> >& reference,
+                            double& maxError, double& rmsError )
+// finds the similarity transformation taking x closest to reference in the
+// least-squares sense (Horn's quaternion method) and returns the largest
+// and RMS distance after the transformation, divided by the RMS radius of
+// reference about its centroid
+{
+   size_t n = x.size();
+   Quaternion<double> cx, cr;
+   for( size_t i = 0; i < n; i++ )
+   {
+      cx += x[i];
+      cr += reference[i];
+   }
+   cx /= (double) n;
+   cr /= (double) n;
+
+   // cross-covariance S = sum a b^T of the centered point sets
+   double S[3][3] = { { 0. } };
+   double aa = 0., bb = 0.;
+   for( size_t i = 0; i < n; i++ )
+   {
+      Quaternion<double> a = x[i] - cx;
+      Quaternion<double> b = reference[i] - cr;
+      for( int r = 0; r < 3; r++ )
+      for( int c = 0; c < 3; c++ )
+      {
+         S[r][c] += a[r+1] * b[c+1];
+      }
+      aa += a.norm2();
+      bb += b.norm2();
+   }
+
+   // the optimal rotation is the unit quaternion maximizing q^T N q, i.e.,
+   // the eigenvector of N with the largest eigenvalue
+   double N[4][4] =
+   {
+      { S[0][0]+S[1][1]+S[2][2], S[1][2]-S[2][1],          S[2][0]-S[0][2],          S[0][1]-S[1][0]          },
+      { S[1][2]-S[2][1],         S[0][0]-S[1][1]-S[2][2],  S[0][1]+S[1][0],          S[2][0]+S[0][2]          },
+      { S[2][0]-S[0][2],         S[0][1]+S[1][0],         -S[0][0]+S[1][1]-S[2][2],  S[1][2]+S[2][1]          },
+      { S[0][1]-S[1][0],         S[2][0]+S[0][2],          S[1][2]+S[2][1],         -S[0][0]-S[1][1]+S[2][2]  }
+   };
+
+   // power iteration on N + shift*I, which the shift makes positive definite
+   double shift = 0.;
+   for( int r = 0; r < 4; r++ )
+   for( int c = 0; c < 4; c++ )
+   {
+      shift += fabs( N[r][c] );
+   }
+
+   Quaternion<double> q( 1., 0., 0., 0. );
+   for( int k = 0; k < 10000; k++ )
+   {
+      Quaternion<double> p;
+      for( int r = 0; r < 4; r++ )
+      {
+         p[r] = shift * q[r];
+         for( int c = 0; c < 4; c++ )
+         {
+            p[r] += N[r][c] * q[c];
+         }
+      }
+      p.normalize();
+
+      double change = ( p - q ).norm();
+      q = p;
+      if( change < 1e-15 ) break;
+   }
+
+   // optimal scale given the rotation
+   double ab = 0.;
+   for( size_t i = 0; i < n; i++ )
+   {
+      Quaternion<double> a = q * ( x[i] - cx ) * ~q;
+      ab += a.im() * ( reference[i] - cr ).im();
+   }
+   double scale = aa > 0. ? ab / aa : 1.;
+
+   double radius = sqrt( bb / n );
+   maxError = 0.;
+   rmsError = 0.;
+   for( size_t i = 0; i < n; i++ )
+   {
+      Quaternion<double> a = scale * ( q * ( x[i] - cx ) * ~q );
+      double d = ( a - ( reference[i] - cr )).norm();
+      maxError = max( maxError, d );
+      rmsError += d*d;
+   }
+   maxError /= radius;
+   rmsError = sqrt( rmsError / n ) / radius;
+}
+
+template <class T>
+static void run( Configuration& c, const Mesh<T>& prototype, const Image& image, double scale,
+                 int repeat, const vector< Quaternion<double> >& reference )
+// times one configuration and measures its error
+{
+   vector<double> times;
+   vector< Quaternion<double> > result;
+
+   for( int r = 0; r < repeat; r++ )
+   {
+      Mesh<T> mesh( prototype );
+      mesh.solverOptions = c.options;
+      mesh.eigenIterations = c.eigenIterations;
+
+      chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+      mesh.setCurvatureChange( image, (T) scale );
+      mesh.updateDeformation();
+      chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+      times.push_back( chrono::duration<double,milli>( t1-t0 ).count() );
+
+      if( r == 0 )
+      {
+         result.resize( mesh.newVertices.size() );
+         for( size_t i = 0; i < result.size(); i++ )
+         {
+            const Quaternion<T>& p( mesh.newVertices[i] );
+            result[i] = Quaternion<double>( p.re(), p.im().x, p.im().y, p.im().z );
+         }
+      }
+   }
+
+   sort( times.begin(), times.end() );
+   c.ms = times[ times.size()/2 ];
+
+   alignmentError( result, reference, c.maxError, c.rmsError );
+
+   // a failed solve (e.g., NaNs) never belongs on the frontier
+   if( !( c.rmsError == c.rmsError ) || !( c.maxError == c.maxError ))
+   {
+      c.maxError = c.rmsError = numeric_limits<double>::infinity();
+   }
+}
+
+static const char* backendName( SolverOptions::Backend backend )
+{
+   switch( backend )
+   {
+      case SolverOptions::host: return "host";
+      case SolverOptions::sell: return "sell";
+      default: return "device";
+   }
+}
+
+static void printConfiguration( FILE* out, const Configuration& c )
+{
+   fprintf( out, "%-6s %-6s %9.0e %7d %5d %10.2f %12.4e %12.4e%s\n",
+            c.useDouble ? "double" : "float", backendName( c.options.backend ),
+            c.options.tolerance, c.options.maxIterations, c.eigenIterations,
+            c.ms, c.maxError, c.rmsError, c.pareto ? "  *" : "" );
+}
+
+int main( int argc, char** argv )
+{
+   string meshFile = "sphere.obj", imageFile = "bumpy.tga";
+   string referenceFile = "reference_solution_sphere.obj";
+   string jsonFile, csvFile;
+   double scale = 5.;
+   int repeat = 3;
+   bool quick = false;
+
+   for( int arg = 1; arg < argc; arg++ )
+   {
+      string option( argv[arg] );
+      bool hasValue = arg+1 < argc;
+
+      if( option == "-quick" ) quick = true;
+      else if( option == "-repeat" && hasValue ) repeat = max( 1, atoi( argv[++arg] ));
+      else if( option == "-scale" && hasValue ) scale = atof( argv[++arg] );
+      else if( option == "-mesh" && hasValue ) meshFile = argv[++arg];
+      else if( option == "-image" && hasValue ) imageFile = argv[++arg];
+      else if( option == "-reference" && hasValue ) referenceFile = argv[++arg];
+      else if( option == "-json" && hasValue ) jsonFile = argv[++arg];
+      else if( option == "-csv" && hasValue ) csvFile = argv[++arg];
+      else
+      {
+         cerr << "usage: " << argv[0] << " [-quick] [-repeat n] [-scale s] [-mesh sphere.obj] [-image bumpy.tga]" << endl;
+         cerr << "       [-reference reference_solution_sphere.obj] [-json results.json] [-csv results.csv]" << endl;
+         return 1;
+      }
+   }
+
+   // the sweep; -quick keeps a coarse subset
+   vector<double> tolerances = { 1e-1, 3e-2, 1e-2, 3e-3, 1e-3, 1e-4 };
+   vector<int> iterationLimits = { 25, 50, 100, 200, 400 };
+   vector<int> eigenIterations = { 1, 2, 3, 4 };
+   if( quick )
+   {
+      tolerances = { 1e-1, 1e-2, 1e-3 };
+      iterationLimits = { 50, 100, 200 };
+      eigenIterations = { 2, 3 };
+   }
+   const SolverOptions::Backend backends[] = { SolverOptions::device, SolverOptions::host, SolverOptions::sell };
+
+   Meshd reference;
+   Meshf prototypef;
+   Meshd prototyped;
+   reference.useCache = prototypef.useCache = prototyped.useCache = false;
+   Image image;
+   if( !reference.read( referenceFile ) || !image.read( imageFile.c_str() ) ||
+       !prototypef.read( meshFile ) || !prototyped.read( meshFile ))
+   {
+      return 1;
+   }
+   prototypef.prepareOperators();
+   prototyped.prepareOperators();
+
+   if( prototyped.vertices.size() != reference.vertices.size() )
+   {
+      cerr << "Error: " << meshFile << " and " << referenceFile << " have different numbers of vertices!" << endl;
+      return 1;
+   }
+
+   vector<Configuration> configurations;
+   for( int p = 0; p < 2; p++ )
+   for( int b = 0; b < 3; b++ )
+   for( size_t t = 0; t < tolerances.size(); t++ )
+   for( size_t m = 0; m < iterationLimits.size(); m++ )
+   for( size_t e = 0; e < eigenIterations.size(); e++ )
+   {
+      Configuration c;
+      c.useDouble = ( p == 1 );
+      c.options.backend = backends[b];
+      c.options.tolerance = tolerances[t];
+      c.options.maxIterations = iterationLimits[m];
+      c.eigenIterations = eigenIterations[e];
+      c.pareto = false;
+      configurations.push_back( c );
+   }
+
+   cout << "running " << configurations.size() << " configurations..." << endl;
+   for( size_t i = 0; i < configurations.size(); i++ )
+   {
+      Configuration& c( configurations[i] );
+      if( c.useDouble ) run( c, prototyped, image, scale, repeat, reference.vertices );
+      else              run( c, prototypef, image, scale, repeat, reference.vertices );
+   }
+
+   // frontier: in order of increasing time, every configuration more
+   // accurate than all faster ones
+   vector<size_t> order( configurations.size() );
+   for( size_t i = 0; i < order.size(); i++ ) order[i] = i;
+   sort( order.begin(), order.end(), [&]( size_t a, size_t b )
+   {
+      const Configuration& ca( configurations[a] );
+      const Configuration& cb( configurations[b] );
+      return ca.ms < cb.ms || ( ca.ms == cb.ms && ca.rmsError < cb.rmsError );
+   });
+
+   double bestError = numeric_limits<double>::infinity();
+   for( size_t i = 0; i < order.size(); i++ )
+   {
+      Configuration& c( configurations[ order[i] ] );
+      if( c.rmsError < bestError )
+      {
+         c.pareto = true;
+         bestError = c.rmsError;
+      }
+   }
+
+   printf( "%-6s %-6s %9s %7s %5s %10s %12s %12s\n",
+           "prec", "backnd", "tolerance", "maxiter", "eigit", "ms", "max_error", "rms_error" );
+   for( size_t i = 0; i < order.size(); i++ )
+   {
+      if( configurations[ order[i] ].pareto )
+      {
+         printConfiguration( stdout, configurations[ order[i] ] );
+      }
+   }
+
+   if( !csvFile.empty() )
+   {
+      FILE* out = fopen( csvFile.c_str(), "w" );
+      if( out == NULL )
+      {
+         cerr << "Error: couldn't write " << csvFile << "!" << endl;
+         return 1;
+      }
+      fprintf( out, "precision,backend,tolerance,max_iterations,eigen_iterations,ms,max_error,rms_error,pareto\n" );
+      for( size_t i = 0; i < order.size(); i++ )
+      {
+         const Configuration& c( configurations[ order[i] ] );
+         fprintf( out, "%s,%s,%g,%d,%d,%.6g,%.6g,%.6g,%d\n",
+                  c.useDouble ? "double" : "float", backendName( c.options.backend ),
+                  c.options.tolerance, c.options.maxIterations, c.eigenIterations,
+                  c.ms, c.maxError, c.rmsError, (int) c.pareto );
+      }
+      fclose( out );
+   }
+
+   if( !jsonFile.empty() )
+   {
+      FILE* out = fopen( jsonFile.c_str(), "w" );
+      if( out == NULL )
+      {
+         cerr << "Error: couldn't write " << jsonFile << "!" << endl;
+         return 1;
+      }
+      fprintf( out, "{ \"configurations\": [\n" );
+      for( size_t i = 0; i < order.size(); i++ )
+      {
+         const Configuration& c( configurations[ order[i] ] );
+         char maxError[32] = "null", rmsError[32] = "null"; // for failed solves
+         if( !isinf( c.maxError )) snprintf( maxError, sizeof(maxError), "%.6g", c.maxError );
+         if( !isinf( c.rmsError )) snprintf( rmsError, sizeof(rmsError), "%.6g", c.rmsError );
+         fprintf( out, "   { \"precision\": \"%s\", \"backend\": \"%s\", \"tolerance\": %g, \"max_iterations\": %d, \"eigen_iterations\": %d, \"ms\": %.6g, \"max_error\": %s, \"rms_error\": %s, \"pareto\": %s }%s\n",
+                  c.useDouble ? "double" : "float", backendName( c.options.backend ),
+                  c.options.tolerance, c.options.maxIterations, c.eigenIterations,
+                  c.ms, maxError, rmsError,
+                  c.pareto ? "true" : "false", i+1 < order.size() ? "," : "" );
+      }
+      fprintf( out, "] }\n" );
+      fclose( out );
+   }
+
+   return 0;
+}
@@ -0,0 +1,268 @@
+// -----------------------------------------------------------------------------
+//
+// SpinXFormGPU -- replay.cpp
+//
+// Solves linear systems captured with "spinxformgpu -capture dir" again,
+// with any solver backend, preconditioner, tolerance or iteration limit, so
+// that solver settings can be tuned without rerunning assembly.  Usage:
+//
+//    spinxformreplay [-float|-double] [-backend device|host|sell]
+//                    [-precond identity|diagonal|ainv|aggregation]
+//                    [-cg standard|fused|pipelined] [-tolerance t] [-maxiter n] [-repeat n] [-cold]
+//                    [-compress] [-spmv n] dir/*.sys
+//
+// Each system starts from its captured initial guess (or from zero with
+// -cold).  For every system, the report lists the iterations and time of
+// the fastest of -repeat solves, the true relative residual |b - Ax| / |b|,
+// and the relative difference from the solution of the captured run.
+//
+// With -spmv n, nothing is solved; instead each matrix is multiplied n times
+// by CUSP's host CSR SpMV and by SellMatrix, and the report lists the
+// effective bandwidth of both, the fill ratio of the SELL format (stored
+// slots per nonzero) and the largest relative difference between the two
+// products.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Profiler.h"
+#include "SellMatrix.h"
+#include "SystemCapture.h"
+#include "cusp_device.h"
+#include <cusp/multiply.h>
+
+using namespace std;
+
+template <class T>
+static double residualNorm( const CapturedSystem<T>& system, const vector<T>& x )
+// returns |b - Ax| / |b|, accumulated in double precision
+{
+   double r2 = 0., b2 = 0.;
+   int rows = system.rhs.size();
+   for( int i = 0; i < rows; i++ )
+   {
+      double Ax = 0.;
+      for( int k = system.rowStart[i]; k < system.rowStart[i+1]; k++ )
+      {
+         Ax += (double) system.values[k] * x[ system.columns[k] ];
+      }
+      double r = system.rhs[i] - Ax;
+      r2 += r*r;
+      b2 += (double) system.rhs[i] * system.rhs[i];
+   }
+   return b2 > 0. ? sqrt( r2 / b2 ) : sqrt( r2 );
+}
+
+template <class T>
+static double difference( const vector<T>& x, const vector<T>& y )
+// returns |x - y| / |y|
+{
+   double d2 = 0., y2 = 0.;
+   for( size_t i = 0; i < x.size(); i++ )
+   {
+      d2 += ( (double) x[i] - y[i] ) * ( (double) x[i] - y[i] );
+      y2 += (double) y[i] * y[i];
+   }
+   return y2 > 0. ? sqrt( d2 / y2 ) : sqrt( d2 );
+}
+
+template <class T>
+static int replay( const vector<string>& files, const SolverOptions& options, int repeat, bool cold )
+// solves every captured system and prints one line per system
+{
+   printf( "%-32s %-16s %8s %10s %6s %6s %5s %10s %10s %10s\n",
+           "file", "solve", "rows", "entries", "cap_it", "iter", "conv",
+           "ms", "residual", "diff" );
+
+   int failures = 0;
+   for( size_t f = 0; f < files.size(); f++ )
+   {
+      CapturedSystem<T> system;
+      if( !system.read( files[f] ))
+      {
+         cerr << "Error: couldn't read captured system " << files[f] << "!" << endl;
+         failures++;
+         continue;
+      }
+
+      int rows = system.rhs.size();
+      int entries = system.values.size();
+
+      cusp::csr_matrix<int, T, cusp::host_memory> A( rows, rows, entries );
+      A.row_offsets = system.rowStart;
+      A.column_indices = system.columns;
+      A.values = system.values;
+      cusp::array1d<T, cusp::host_memory> rhs( system.rhs );
+
+      SolverStatistics best;
+      vector<T> x;
+      for( int run = 0; run < repeat; run++ )
+      {
+         cusp::array1d<T, cusp::host_memory> result( rows, (T) 0. );
+         if( system.initialGuess && !cold )
+         {
+            result = cusp::array1d<T, cusp::host_memory>( system.guess );
+         }
+
+         SolverStatistics stats = solve_on_device( A, rhs, result, options );
+         if( run == 0 || stats.seconds < best.seconds )
+         {
+            best = stats;
+         }
+         x.assign( result.begin(), result.end() );
+      }
+
+      string file( files[f] );
+      size_t slash = file.find_last_of( '/' );
+      if( slash != string::npos ) file = file.substr( slash+1 );
+
+      printf( "%-32s %-16s %8d %10d %6d %6d %5s %10.3f %10.3e %10.3e\n",
+              file.c_str(), system.name.c_str(), rows, entries,
+              system.iterations, best.iterations, best.converged ? "yes" : "no",
+              1000.*best.seconds, residualNorm( system, x ), difference( x, system.solution ));
+   }
+
+   return failures > 0 ? 1 : 0;
+}
+
+template <class T>
+static int compareSpmv( const vector<string>& files, int products )
+// times CSR and SELL-C-sigma SpMVs of every captured matrix
+{
+   printf( "%-32s %8s %10s %8s %6s %10s %10s %10s %10s %10s\n",
+           "file", "rows", "entries", "kernel", "fill", "csr_ms", "csr_GB/s",
+           "sell_ms", "sell_GB/s", "diff" );
+
+   int failures = 0;
+   for( size_t f = 0; f < files.size(); f++ )
+   {
+      CapturedSystem<T> system;
+      if( !system.read( files[f] ))
+      {
+         cerr << "Error: couldn't read captured system " << files[f] << "!" << endl;
+         failures++;
+         continue;
+      }
+
+      int rows = system.rhs.size();
+      int entries = system.values.size();
+
+      cusp::csr_matrix<int, T, cusp::host_memory> A( rows, rows, entries );
+      A.row_offsets = system.rowStart;
+      A.column_indices = system.columns;
+      A.values = system.values;
+
+      SellMatrix<T> S;
+      S.build( A );
+
+      cusp::array1d<T, cusp::host_memory> x( system.solution );
+      cusp::array1d<T, cusp::host_memory> y( rows ), z( rows );
+
+      double t0 = Profiler::now();
+      for( int n = 0; n < products; n++ ) cusp::multiply( A, x, y );
+      double csrSeconds = ( Profiler::now() - t0 ) / products;
+
+      t0 = Profiler::now();
+      for( int n = 0; n < products; n++ ) S.multiply( &x[0], &z[0] );
+      double sellSeconds = ( Profiler::now() - t0 ) / products;
+
+      double d = 0., ymax = 0.;
+      for( int i = 0; i < rows; i++ )
+      {
+         d = max( d, fabs( (double) y[i] - z[i] ));
+         ymax = max( ymax, fabs( (double) y[i] ));
+      }
+
+      // the CSR traffic counts the same way as SolverStatistics::spmvBytes
+      double csrBytes = (double) entries * ( sizeof(int) + sizeof(T) ) +
+                        ( rows + 1. ) * sizeof(int) + 2. * rows * sizeof(T);
+
+      string file( files[f] );
+      size_t slash = file.find_last_of( '/' );
+      if( slash != string::npos ) file = file.substr( slash+1 );
+
+      printf( "%-32s %8d %10d %8s %6.3f %10.4f %10.2f %10.4f %10.2f %10.3e\n",
+              file.c_str(), rows, entries, SellMatrix<T>::kernel(),
+              (double) S.slots() / max( 1, entries ),
+              1000.*csrSeconds, csrBytes / csrSeconds * 1e-9,
+              1000.*sellSeconds, S.bytes() / sellSeconds * 1e-9,
+              ymax > 0. ? d / ymax : d );
+   }
+
+   return failures > 0 ? 1 : 0;
+}
+
+int main( int argc, char** argv )
+{
+   SolverOptions options;
+   bool useDouble = false, cold = false;
+   int repeat = 1, products = 0;
+
+   int arg = 1;
+   while( arg < argc && argv[arg][0] == '-' )
+   {
+      string option( argv[arg] );
+      bool hasValue = arg+1 < argc;
+
+      if( option == "-double" ) useDouble = true;
+      else if( option == "-float" ) useDouble = false;
+      else if( option == "-cold" ) cold = true;
+      else if( option == "-compress" ) options.compressIndices = true;
+      else if( option == "-repeat" && hasValue ) repeat = max( 1, atoi( argv[++arg] ));
+      else if( option == "-tolerance" && hasValue ) options.tolerance = atof( argv[++arg] );
+      else if( option == "-maxiter" && hasValue ) options.maxIterations = atoi( argv[++arg] );
+      else if( option == "-spmv" && hasValue ) products = max( 1, atoi( argv[++arg] ));
+      else if( option == "-backend" && hasValue )
+      {
+         string value( argv[++arg] );
+         if( value == "device" ) options.backend = SolverOptions::device;
+         else if( value == "host" ) options.backend = SolverOptions::host;
+         else if( value == "sell" ) options.backend = SolverOptions::sell;
+         else break;
+      }
+      else if( option == "-cg" && hasValue )
+      {
+         string value( argv[++arg] );
+         if( value == "standard" ) options.method = SolverOptions::standard;
+         else if( value == "fused" ) options.method = SolverOptions::fused;
+         else if( value == "pipelined" ) options.method = SolverOptions::pipelined;
+         else break;
+      }
+      else if( option == "-precond" && hasValue )
+      {
+         string value( argv[++arg] );
+         if( value == "identity" ) options.preconditioner = SolverOptions::identity;
+         else if( value == "diagonal" ) options.preconditioner = SolverOptions::diagonal;
+         else if( value == "ainv" ) options.preconditioner = SolverOptions::ainv;
+         else if( value == "aggregation" ) options.preconditioner = SolverOptions::aggregation;
+         else break;
+      }
+      else break;
+
+      arg++;
+   }
+
+   if( arg >= argc || argv[arg][0] == '-' )
+   {
+      cerr << "usage: " << argv[0] << " [-float|-double] [-backend device|host|sell] [-precond identity|diagonal|ainv|aggregation]" << endl;
+      cerr << "       [-cg standard|fused|pipelined] [-tolerance t] [-maxiter n] [-repeat n] [-cold] [-compress] [-spmv n] system.sys..." << endl;
+      return 1;
+   }
+
+   vector<string> files( argv+arg, argv+argc );
+   if( products > 0 )
+   {
+      return useDouble ? compareSpmv<double>( files, products ) :
+                         compareSpmv<float>( files, products );
+   }
+   if( useDouble )
+   {
+      return replay<double>( files, options, repeat, cold );
+   }
+   return replay<float>( files, options, repeat, cold );
+}